@@ -0,0 +1,163 @@
+#include "common/Log.h"
+#include "common/MessageLogReader.h"
+#include "common/MessageLogWriter.h"
+#include "common/Protocol.h"
+#include "snake_server/ClientInbox.h"
+#include "snake_server/GameStateDiff.h"
+#include "snake_server/ServerConfig.h"
+#include "snake_server/SnakeServer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+// Sweeps arena size against player count. For each pair a synthetic recording is generated, with
+// every player joining (and rejoining each second once dead) and steering at random, then replayed
+// through the real engine, so runs are reproducible and need no sockets or bots. Usage:
+//
+//     snake_scaling_bench [seconds of play per run, default 3]
+
+namespace {
+
+    constexpr int64_t START_NS {1'000'000'000'000'000};
+    constexpr int64_t TICK_NS {10'000'000}; // clock steps between recorded batches
+    constexpr int TICKS_PER_REJOIN {100};
+    constexpr int TURN_ONE_IN {20}; // a player steers about once per move at the normal speed
+    constexpr int CELLS_PER_PLAYER {16};
+
+    const std::vector<int> ARENA_SIZES {40, 100, 250, 500, 1000, 2000};
+    const std::vector<int> PLAYER_COUNTS {10, 100, 1000, 10000};
+
+    template <typename T>
+    T at(const int64_t transactTime, const int clientId, T msg) {
+        msg.hdr.clientId = clientId;
+        msg.hdr.transactTime = transactTime;
+        return msg;
+    }
+
+    void writeRecording(const std::string & name, const int size, const int players, const int ticks) {
+        MessageLogWriter writer {name};
+        std::mt19937 gen {static_cast<std::uint32_t>(size * 100003 + players)};
+
+        protocol::ServerConfig config {};
+        config.hdr.messageType = protocol::MessageType::SERVER_CONFIG;
+        config.width = size;
+        config.height = size;
+        config.seed = static_cast<std::uint32_t>(gen());
+        config.minFoodInArena = scaledMinFoodInArena(size, size);
+        config.foodSpawnFromBodySegmentProbability = FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY;
+        config.speedBoostProbability = SPEED_BOOST_PROBABILITY;
+        config.speedBoostRatio = SPEED_BOOST_RATIO;
+        config.movementFrequencyMs = MOVEMENT_FREQUENCY_MS;
+        config.boostedMovementFrequencyMs = BOOSTED_MOVEMENT_FREQUENCY_MS;
+        config.boostDurationMs = SPEED_BOOST_DURATION_MS;
+        writer.log(protocol::serialise(at(START_NS, -1, config)));
+
+        protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN}, {}, 0};
+        std::strncpy(join.username, "bench", sizeof(join.username) - 1);
+        const char directions[] {'^', 'v', '<', '>'};
+        std::uniform_int_distribution<int> turn(0, TURN_ONE_IN - 1);
+        std::uniform_int_distribution<int> direction(0, 3);
+        // only the clock for the replay, which is told not to check its states against them
+        protocol::GameState clock {};
+        clock.hdr.messageType = protocol::MessageType::GAME_STATE;
+
+        for (int tick = 0; tick < ticks; tick++) {
+            const int64_t now {START_NS + (tick + 1) * TICK_NS};
+            for (int clientId = 1; clientId <= players; clientId++) {
+                if (tick % TICKS_PER_REJOIN == 0) {
+                    writer.log(protocol::serialise(at(now, clientId, join)));
+                } else if (turn(gen) == 0) {
+                    writer.log(protocol::serialise(at(
+                        now, clientId,
+                        protocol::ClientInput {{protocol::MessageType::CLIENT_INPUT}, directions[direction(gen)]})));
+                }
+            }
+            writer.log(protocol::serialise(at(now, -1, clock)));
+        }
+    }
+
+    struct BroadcastSizes {
+        double stateBytes; // a keyframe
+        double deltaBytes; // the GAME_STATE_DELTA against the previous broadcast
+    };
+
+    BroadcastSizes measureBroadcasts(const std::string & fileName) {
+        MessageLogReader reader {fileName};
+        std::optional<protocol::GameState> previous {};
+        int64_t states {0};
+        int64_t stateBytes {0};
+        int64_t deltas {0};
+        int64_t deltaBytes {0};
+        while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+            if (record->hdr.messageType != protocol::MessageType::GAME_STATE) {
+                continue;
+            }
+            protocol::GameState state {std::get<protocol::GameState>(protocol::deserialise(record->bytes))};
+            stateBytes += static_cast<int64_t>(record->bytes.size());
+            states++;
+            if (previous) {
+                deltaBytes += static_cast<int64_t>(protocol::serialise(diffGameStates(*previous, state)).size());
+                deltas++;
+            }
+            previous = std::move(state);
+        }
+        return {states ? static_cast<double>(stateBytes) / static_cast<double>(states) : 0.0,
+                deltas ? static_cast<double>(deltaBytes) / static_cast<double>(deltas) : 0.0};
+    }
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    const int seconds {argc > 1 ? std::max(1, std::atoi(argv[1])) : 3};
+    const int ticks {static_cast<int>(seconds * 1'000'000'000LL / TICK_NS)};
+
+    initLogging("snake_scaling_bench", false, true);
+    spdlog::set_level(spdlog::level::warn);
+
+    const std::filesystem::path workDir {std::filesystem::temp_directory_path() / "snake_scaling_bench"};
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+    const std::string input {(workDir / "input").string()};
+    const std::string output {(workDir / "output").string()};
+
+    std::printf("%10s %8s %8s %12s %14s %14s\n", "arena", "players", "ticks", "us_per_tick", "state_bytes",
+                "delta_bytes");
+    for (const int size : ARENA_SIZES) {
+        for (const int players : PLAYER_COUNTS) {
+            if (static_cast<int64_t>(players) * CELLS_PER_PLAYER > static_cast<int64_t>(size) * size) {
+                continue; // too crowded to spawn into
+            }
+            writeRecording(input, size, players, ticks);
+
+            SnakeServer::EngineStats stats {};
+            {
+                std::optional<MessageLogReader> reader {std::in_place, input + ".bin"};
+                const std::optional<protocol::MessageVariant> recordedConfig {reader->first()};
+                // the inbox means no listening socket, nothing connects to a replay anyway
+                auto server {std::make_unique<SnakeServer>(initServerConfig(output, recordedConfig),
+                                                           std::move(reader), std::make_shared<ClientInbox>())};
+                server->setVerifyReplayedStates(false);
+                server->run();
+                stats = server->engineStats();
+            }
+            const BroadcastSizes sizes {measureBroadcasts(output + ".bin")};
+
+            const double usPerTick {
+                stats.ticks ? static_cast<double>(stats.engineNs) / 1000.0 / static_cast<double>(stats.ticks) : 0.0};
+            std::printf("%5dx%-4d %8d %8lld %12.1f %14.0f %14.0f\n", size, size, players,
+                        static_cast<long long>(stats.ticks), usPerTick, sizes.stateBytes, sizes.deltaBytes);
+            std::fflush(stdout);
+        }
+    }
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
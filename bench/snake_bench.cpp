@@ -0,0 +1,240 @@
+#include "common/Json.h"
+#include "common/Log.h"
+#include "common/MessageLogReader.h"
+#include "snake_server/ClientInbox.h"
+#include "snake_server/ServerConfig.h"
+#include "snake_server/SnakeServer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Replays a recording through the engine over and over, with no sockets and no message log, and
+// reports how long each phase of a tick takes. Usage:
+//
+//     snake_bench <recording.bin> [--iterations N] [--warmup N] [--json out.json]
+//                 [--baseline base.json] [--tolerance 0.10]
+//
+// The JSON written by one run can be passed as the baseline of a later one. The run then fails if
+// the mean tick got slower than the baseline by more than the tolerance
+
+namespace {
+
+    using Samples = std::vector<int64_t>;
+    using Phase = int64_t SnakeServer::TickPhases::*;
+
+    const std::vector<std::pair<std::string, Phase>> PHASES {
+        {"poll", &SnakeServer::TickPhases::poll},
+        {"dispatch", &SnakeServer::TickPhases::dispatch},
+        {"updateSnakes", &SnakeServer::TickPhases::updateSnakes},
+        {"checkCollisions", &SnakeServer::TickPhases::checkCollisions},
+        {"buildGameState", &SnakeServer::TickPhases::buildGameState},
+        {"serialise", &SnakeServer::TickPhases::serialise},
+    };
+
+    struct Options {
+        std::string recording;
+        int iterations {10};
+        int warmup {1};
+        std::optional<std::string> jsonPath;
+        std::optional<std::string> baselinePath;
+        double tolerance {0.10};
+    };
+
+    Options parseOptions(int argc, char ** argv) {
+        if (argc < 2) {
+            throw std::invalid_argument("usage: snake_bench <recording.bin> [--iterations N] [--warmup N] "
+                                        "[--json out.json] [--baseline base.json] [--tolerance 0.10]");
+        }
+        Options options {};
+        options.recording = argv[1];
+        for (int i = 2; i < argc; i++) {
+            const std::string arg {argv[i]};
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            const std::string value {argv[++i]};
+            if (arg == "--iterations") {
+                options.iterations = std::max(1, std::stoi(value));
+            } else if (arg == "--warmup") {
+                options.warmup = std::max(0, std::stoi(value));
+            } else if (arg == "--json") {
+                options.jsonPath = value;
+            } else if (arg == "--baseline") {
+                options.baselinePath = value;
+            } else if (arg == "--tolerance") {
+                options.tolerance = std::stod(value);
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+        return options;
+    }
+
+    // one complete replay of the recording, calling back with the phase timings of every tick
+    void replay(const std::string & recording, const SnakeServer::TickObserver & observer) {
+        std::optional<MessageLogReader> reader {std::in_place, recording};
+        const std::optional<protocol::MessageVariant> recordedConfig {reader->first()};
+        // the inbox means no listening socket, nothing connects to a replay anyway
+        auto server {std::make_unique<SnakeServer>(initServerConfig("snake_bench", recordedConfig), std::move(reader),
+                                                   std::make_shared<ClientInbox>())};
+        server->setTickObserver(observer);
+        server->run();
+    }
+
+    // nearest rank, on sorted samples
+    double percentileUs(const Samples & sorted, const double p) {
+        if (sorted.empty()) {
+            return 0.0;
+        }
+        const auto rank {static_cast<std::size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5)};
+        return static_cast<double>(sorted[rank]) / 1000.0;
+    }
+
+    json summarise(Samples samples) {
+        std::sort(samples.begin(), samples.end());
+        int64_t total {0};
+        for (auto ns : samples) {
+            total += ns;
+        }
+        const double meanUs {
+            samples.empty() ? 0.0 : static_cast<double>(total) / 1000.0 / static_cast<double>(samples.size())};
+        return json {
+            {"mean_us", meanUs},
+            {"p50_us", percentileUs(samples, 50)},
+            {"p90_us", percentileUs(samples, 90)},
+            {"p99_us", percentileUs(samples, 99)},
+            {"p999_us", percentileUs(samples, 99.9)},
+            {"max_us", percentileUs(samples, 100)},
+        };
+    }
+
+    // in the order they run in a tick, then the whole tick
+    std::vector<std::string> phaseNames() {
+        std::vector<std::string> names {};
+        for (auto & [name, phase] : PHASES) {
+            names.push_back(name);
+        }
+        names.push_back("tick");
+        return names;
+    }
+
+    void printSummary(const json & result) {
+        std::printf("%-16s %10s %10s %10s %10s %10s %10s\n", "phase", "mean_us", "p50_us", "p90_us", "p99_us",
+                    "p999_us", "max_us");
+        for (auto & name : phaseNames()) {
+            const json & stats {result["phases"][name]};
+            std::printf("%-16s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", name.c_str(),
+                        stats["mean_us"].get<double>(), stats["p50_us"].get<double>(), stats["p90_us"].get<double>(),
+                        stats["p99_us"].get<double>(), stats["p999_us"].get<double>(), stats["max_us"].get<double>());
+        }
+    }
+
+    // prints the change in every phase, true if the mean tick regressed past the tolerance. A
+    // baseline without phases.tick.mean_us throws
+    bool compareWithBaseline(const json & result, const json & baseline, const double tolerance) {
+        const json & basePhases {baseline.at("phases")};
+        const double baseTick {basePhases.at("tick").at("mean_us").get<double>()};
+        std::printf("\n%-16s %12s %12s %8s\n", "vs baseline", "mean_us", "base_us", "change");
+        for (auto & name : phaseNames()) {
+            if (!basePhases.contains(name)) {
+                continue;
+            }
+            const double now {result["phases"][name]["mean_us"].get<double>()};
+            const double base {basePhases.at(name).at("mean_us").get<double>()};
+            std::printf("%-16s %12.2f %12.2f %+7.1f%%\n", name.c_str(), now, base,
+                        base > 0.0 ? (now / base - 1.0) * 100.0 : 0.0);
+        }
+        const double now {result["phases"]["tick"]["mean_us"].get<double>()};
+        if (baseTick > 0.0 && now > baseTick * (1.0 + tolerance)) {
+            std::printf("\nREGRESSION mean tick %.2fus is more than %.0f%% over the baseline %.2fus\n", now,
+                        tolerance * 100.0, baseTick);
+            return true;
+        }
+        return false;
+    }
+
+    // 0 when the run is within the baseline, 1 on a regression. Throws if the recording or the
+    // baseline can't be read
+    int bench(const Options & options) {
+        std::vector<Samples> phaseSamples(PHASES.size());
+        Samples tickSamples {};
+        const std::chrono::time_point<std::chrono::steady_clock> start {std::chrono::steady_clock::now()};
+        for (int i = 0; i < options.warmup + options.iterations; i++) {
+            const bool measured {i >= options.warmup};
+            replay(options.recording, [&](const SnakeServer::TickPhases & phases) {
+                if (!measured) {
+                    return;
+                }
+                int64_t tick {0};
+                for (std::size_t p = 0; p < PHASES.size(); p++) {
+                    phaseSamples[p].push_back(phases.*PHASES[p].second);
+                    tick += phases.*PHASES[p].second;
+                }
+                tickSamples.push_back(tick);
+            });
+        }
+        const std::chrono::microseconds elapsed {
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)};
+        const double elapsedMs {static_cast<double>(elapsed.count()) / 1000.0};
+
+        json result {
+            {"recording", options.recording},
+            {"iterations", options.iterations},
+            {"ticks_per_iteration", tickSamples.size() / static_cast<std::size_t>(options.iterations)},
+            {"elapsed_ms", elapsedMs},
+            {"phases", json::object()},
+        };
+        for (std::size_t p = 0; p < PHASES.size(); p++) {
+            result["phases"][PHASES[p].first] = summarise(std::move(phaseSamples[p]));
+        }
+        result["phases"]["tick"] = summarise(std::move(tickSamples));
+
+        std::printf("%s: %d iterations of %zu ticks in %.0fms\n\n", options.recording.c_str(), options.iterations,
+                    result["ticks_per_iteration"].get<std::size_t>(), elapsedMs);
+        printSummary(result);
+        if (options.jsonPath) {
+            std::ofstream {*options.jsonPath} << result.dump(2) << "\n";
+        }
+        if (options.baselinePath) {
+            std::ifstream in {*options.baselinePath};
+            if (!in) {
+                throw std::runtime_error("Failed to open baseline " + *options.baselinePath);
+            }
+            if (compareWithBaseline(result, json::parse(in), options.tolerance)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+} // namespace
+
+int main(int argc, char ** argv) {
+    Options options {};
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception & e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 2;
+    }
+
+    initLogging("snake_bench", false, true);
+    spdlog::set_level(spdlog::level::warn);
+    setenv("SNAKE_MESSAGE_LOG", "0", 1);
+
+    // an unreadable recording or baseline fails the run like a bad option, not as a crash
+    try {
+        return bench(options);
+    } catch (const std::exception & e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 2;
+    }
+}
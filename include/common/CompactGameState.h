@@ -0,0 +1,386 @@
+#pragma once
+
+#include "common/Constants.h"
+#include "common/Protocol.h"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <spdlog/fmt/fmt.h>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+// GAME_STATE_COMPACT, the encoding of a GAME_STATE for clients that offer to read it. Most of a
+// full keyframe is snake bodies at 8 bytes a cell, but each cell of a body is a unit step on from
+// the one before, so here a body is its head then 2 bits a step. Coordinates are 16 bit, colours
+// 8 bit, names length prefixed, and icons (and the speed boost colour) are left out as the list
+// an item is in implies them. After the header and a version byte:
+//
+//   highScore int32, highScoreUsername name
+//   food      count, then x uint16, y uint16, color uint8 each
+//   boosts    count, then x uint16, y uint16 each
+//   players   count, then clientId int32, color uint8, direction char, score int32, username name,
+//             segment count, then runs until that many segments are read
+//   run       x uint16, y uint16, steps uint32, then the steps 4 to a byte, the first in the low bits
+//   name      length uint8, then that many chars
+//
+// A body only needs a second run where a cell isn't a unit step on from the one before, which the
+// engine never produces, but any body can be encoded
+namespace protocol {
+
+    constexpr uint8_t COMPACT_STATE_VERSION {1};
+    constexpr int32_t COMPACT_MAX_COORDINATE {UINT16_MAX}; // arenas any bigger get the full encoding
+
+    namespace compact {
+
+        using Cell = GameState::Player::Segment;
+
+        constexpr size_t COORD_PACKED_SIZE {2 * sizeof(uint16_t)};
+        constexpr size_t FOOD_PACKED_SIZE {COORD_PACKED_SIZE + sizeof(uint8_t)};
+        constexpr size_t SPEED_BOOST_PACKED_SIZE {COORD_PACKED_SIZE};
+        constexpr size_t PLAYER_PACKED_SIZE {sizeof(GameState::Player::clientId) + sizeof(uint8_t) +
+                                             sizeof(GameState::Player::direction) +
+                                             sizeof(GameState::Player::score)}; // before its name and body
+        constexpr size_t RUN_PACKED_SIZE {COORD_PACKED_SIZE + sizeof(uint32_t)}; // before its steps
+        // the least a player can take, with an empty name and no body
+        constexpr size_t MIN_PLAYER_PACKED_SIZE {PLAYER_PACKED_SIZE + sizeof(uint8_t) + COUNT_PACKED_SIZE};
+
+        // the step a 2 bit code stands for, the high bit being which axis and the low bit which way
+        constexpr std::array<int32_t, 4> STEP_DX {0, 0, -1, 1};
+        constexpr std::array<int32_t, 4> STEP_DY {-1, 1, 0, 0};
+
+        inline bool isUnitStep(const Cell & from, const Cell & to) {
+            const int64_t dx {static_cast<int64_t>(to.first) - from.first};
+            const int64_t dy {static_cast<int64_t>(to.second) - from.second};
+            return (dx == 0 && (dy == 1 || dy == -1)) || (dy == 0 && (dx == 1 || dx == -1));
+        }
+
+        // only meaningful for a unit step
+        inline uint8_t stepCode(const Cell & from, const Cell & to) {
+            const int32_t dx {to.first - from.first};
+            const int32_t dy {to.second - from.second};
+            return static_cast<uint8_t>((dx != 0) << 1 | (dx + dy > 0));
+        }
+
+        // how many unit steps follow the cell at first before the body jumps or ends
+        inline size_t runSteps(const std::vector<Cell> & cells, const size_t first) {
+            size_t steps {0};
+            while (first + steps + 1 < cells.size() && isUnitStep(cells[first + steps], cells[first + steps + 1])) {
+                steps++;
+            }
+            return steps;
+        }
+
+        inline size_t packedStepsSize(const size_t steps) {
+            return (steps + 3) / 4;
+        }
+
+        inline size_t bodyPackedSize(const std::vector<Cell> & cells) {
+            size_t size {COUNT_PACKED_SIZE};
+            for (size_t first {0}; first < cells.size();) {
+                const size_t steps {runSteps(cells, first)};
+                size += RUN_PACKED_SIZE + packedStepsSize(steps);
+                first += steps + 1;
+            }
+            return size;
+        }
+
+        inline size_t namePackedSize(const char (&name)[16]) {
+            return sizeof(uint8_t) + strnlen(name, sizeof(name));
+        }
+
+        inline void writeCoord(const int32_t x, const int32_t y, char *& raw) {
+            if (x < 0 || y < 0 || x > COMPACT_MAX_COORDINATE || y > COMPACT_MAX_COORDINATE) {
+                throw std::invalid_argument(fmt::format("GAME_STATE_COMPACT: ({}, {}) out of range", x, y));
+            }
+            writeRawBytes(static_cast<uint16_t>(x), raw);
+            writeRawBytes(static_cast<uint16_t>(y), raw);
+        }
+
+        inline void writeColor(const int32_t color, char *& raw) {
+            if (color < 0 || color > UINT8_MAX) {
+                throw std::invalid_argument(fmt::format("GAME_STATE_COMPACT: color {} out of range", color));
+            }
+            writeRawBytes(static_cast<uint8_t>(color), raw);
+        }
+
+        inline void writeName(const char (&name)[16], char *& raw) {
+            const uint8_t length {static_cast<uint8_t>(strnlen(name, sizeof(name)))};
+            writeRawBytes(length, raw);
+            std::memcpy(raw, name, length);
+            raw += length;
+        }
+
+        // the steps out of cells[0], four to a byte, with no branches on the step taken
+        inline void packSteps(const Cell * cells, const size_t steps, char *& raw) {
+            const size_t whole {steps / 4};
+            for (size_t i {0}; i < whole; i++) {
+                const Cell * c {cells + 4 * i};
+                raw[i] = static_cast<char>(stepCode(c[0], c[1]) | stepCode(c[1], c[2]) << 2 |
+                                           stepCode(c[2], c[3]) << 4 | stepCode(c[3], c[4]) << 6);
+            }
+            raw += whole;
+            if (steps % 4 != 0) {
+                uint8_t last {0};
+                for (size_t k {0}; k < steps % 4; k++) {
+                    last |= static_cast<uint8_t>(stepCode(cells[4 * whole + k], cells[4 * whole + k + 1]) << (2 * k));
+                }
+                writeRawBytes(last, raw);
+            }
+        }
+
+        inline void writeBody(const std::vector<Cell> & cells, char *& raw) {
+            writeCount(cells.size(), raw);
+            for (size_t first {0}; first < cells.size();) {
+                const size_t steps {runSteps(cells, first)};
+                writeCoord(cells[first].first, cells[first].second, raw);
+                writeRawBytes(static_cast<uint32_t>(steps), raw);
+                packSteps(&cells[first], steps, raw);
+                first += steps + 1;
+            }
+        }
+
+        inline void readCoord(const char *& raw, int32_t & x, int32_t & y, const char * end) {
+            uint16_t packedX;
+            uint16_t packedY;
+            readRawBytes(raw, packedX, end);
+            readRawBytes(raw, packedY, end);
+            x = packedX;
+            y = packedY;
+        }
+
+        inline void readName(const char *& raw, char (&name)[16], const char * end) {
+            uint8_t length;
+            readRawBytes(raw, length, end);
+            if (length > sizeof(name) || static_cast<size_t>(end - raw) < length) {
+                throw std::runtime_error("deserialise: truncated frame");
+            }
+            std::memset(name, 0, sizeof(name));
+            std::memcpy(name, raw, length);
+            raw += length;
+        }
+
+        // A count read off the wire, checked against the bytes left before anything is reserved for
+        // it, as each item takes at least itemSize bytes
+        inline uint32_t readCount(const char *& raw, const size_t itemSize, const char * end) {
+            uint32_t count;
+            readRawBytes(raw, count, end);
+            if (static_cast<size_t>(end - raw) / itemSize < count) {
+                throw std::runtime_error("deserialise: truncated frame");
+            }
+            return count;
+        }
+
+        // appends the cells the steps lead to from the last one in cells
+        template <typename CELLS>
+        inline void unpackSteps(const char *& raw, const size_t steps, CELLS & cells, const char * end) {
+            if (static_cast<size_t>(end - raw) < packedStepsSize(steps)) {
+                throw std::runtime_error("deserialise: truncated frame");
+            }
+            int32_t x {cells.back().first};
+            int32_t y {cells.back().second};
+            for (size_t i {0}; i < steps; i++) {
+                const uint8_t code {static_cast<uint8_t>(static_cast<uint8_t>(raw[i / 4]) >> (2 * (i % 4)) & 3)};
+                x += STEP_DX[code];
+                y += STEP_DY[code];
+                cells.emplace_back(x, y);
+            }
+            raw += packedStepsSize(steps);
+        }
+
+        // into any container of cells, eg the client's deque. A body of count cells takes at least
+        // one run and a step for each cell after the first
+        template <typename CELLS>
+        inline void readBody(const char *& raw, CELLS & cells, const char * end) {
+            uint32_t count;
+            readRawBytes(raw, count, end);
+            if (count > 0 && static_cast<size_t>(end - raw) < RUN_PACKED_SIZE + packedStepsSize(count - 1)) {
+                throw std::runtime_error("deserialise: truncated frame");
+            }
+            cells.clear();
+            if constexpr (requires { cells.reserve(count); }) {
+                cells.reserve(count);
+            }
+            while (cells.size() < count) {
+                Cell first;
+                readCoord(raw, first.first, first.second, end);
+                uint32_t steps;
+                readRawBytes(raw, steps, end);
+                if (steps >= count - cells.size()) {
+                    throw std::runtime_error("deserialise: body run longer than its segment count");
+                }
+                cells.push_back(first);
+                unpackSteps(raw, steps, cells, end);
+            }
+        }
+
+    } // namespace compact
+
+    inline size_t compactEncodedSize(const GameState & msg) {
+        size_t size {HEADER_PACKED_SIZE + sizeof(COMPACT_STATE_VERSION) + sizeof(msg.highScore) +
+                     compact::namePackedSize(msg.highScoreUsername) + COUNT_PACKED_SIZE +
+                     msg.food.size() * compact::FOOD_PACKED_SIZE + COUNT_PACKED_SIZE +
+                     msg.speedBoosts.size() * compact::SPEED_BOOST_PACKED_SIZE + COUNT_PACKED_SIZE};
+        for (auto & p : msg.players) {
+            size += compact::PLAYER_PACKED_SIZE + compact::namePackedSize(p.username) +
+                    compact::bodyPackedSize(p.segments);
+        }
+        return size;
+    }
+
+    // Replaces the contents of buf with msg as a GAME_STATE_COMPACT, sized once like serialiseInto.
+    // Throws std::invalid_argument for a state the encoding can't carry, eg a coordinate past
+    // COMPACT_MAX_COORDINATE or an item with an icon other than its list implies
+    inline void serialiseCompactInto(const GameState & msg, Bytes & buf) {
+        buf.resize(compactEncodedSize(msg));
+        char * raw = buf.data();
+        Header hdr {msg.hdr};
+        hdr.messageType = MessageType::GAME_STATE_COMPACT;
+        writeHeader(hdr, raw);
+        writeRawBytes(COMPACT_STATE_VERSION, raw);
+        writeRawBytes(msg.highScore, raw);
+        compact::writeName(msg.highScoreUsername, raw);
+
+        writeCount(msg.food.size(), raw);
+        for (auto & f : msg.food) {
+            if (f.icon != SnakeConstants::FOOD_ICON) {
+                throw std::invalid_argument("GAME_STATE_COMPACT: food with an unexpected icon");
+            }
+            compact::writeCoord(f.x, f.y, raw);
+            compact::writeColor(f.color, raw);
+        }
+        writeCount(msg.speedBoosts.size(), raw);
+        for (auto & s : msg.speedBoosts) {
+            if (s.icon != SnakeConstants::SPEED_BOOST_ICON || s.color != static_cast<int32_t>(SPEED_BOOST_COLOR)) {
+                throw std::invalid_argument("GAME_STATE_COMPACT: speed boost with an unexpected icon or color");
+            }
+            compact::writeCoord(s.x, s.y, raw);
+        }
+
+        writeCount(msg.players.size(), raw);
+        for (auto & p : msg.players) {
+            writeRawBytes(p.clientId, raw);
+            compact::writeColor(p.color, raw);
+            writeRawBytes(p.direction, raw);
+            writeRawBytes(p.score, raw);
+            compact::writeName(p.username, raw);
+            compact::writeBody(p.segments, raw);
+        }
+        assert(raw == buf.data() + buf.size() && "serialiseCompactInto: compactEncodedSize disagrees with the writer");
+    }
+
+    inline Bytes serialiseCompact(const GameState & msg) {
+        Bytes buf;
+        serialiseCompactInto(msg, buf);
+        return buf;
+    }
+
+    // Walks a GAME_STATE_COMPACT frame, handing each item to reader as it is decoded, so a frame can
+    // be read straight into whatever state its reader fills. The reader is told how many of each
+    // list follow once the count has been checked against the bytes left, and gives player() the
+    // container the body goes in. Returns the header the frame was sent with, other than its
+    // messageType, which is GAME_STATE as for any other game state
+    template <typename READER>
+    inline Header readCompact(const std::string_view frame, READER & reader) {
+        Header hdr {deserialiseHeader(frame)};
+        if (hdr.messageType != MessageType::GAME_STATE_COMPACT) {
+            throw std::runtime_error("deserialiseCompact: not a GAME_STATE_COMPACT");
+        }
+        hdr.messageType = MessageType::GAME_STATE;
+        const char * raw = frame.data() + HEADER_PACKED_SIZE;
+        const char * end = frame.data() + frame.size();
+
+        uint8_t version;
+        readRawBytes(raw, version, end);
+        if (version != COMPACT_STATE_VERSION) {
+            throw std::runtime_error(fmt::format("GAME_STATE_COMPACT version {} unsupported, expected {}", version,
+                                                 COMPACT_STATE_VERSION));
+        }
+        int32_t highScore;
+        char name[sizeof(GameState::highScoreUsername)];
+        readRawBytes(raw, highScore, end);
+        compact::readName(raw, name, end);
+        reader.highScore(highScore, name);
+
+        uint32_t count {compact::readCount(raw, compact::FOOD_PACKED_SIZE, end)};
+        reader.foodCount(count);
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t x;
+            int32_t y;
+            uint8_t color;
+            compact::readCoord(raw, x, y, end);
+            readRawBytes(raw, color, end);
+            reader.food(x, y, color);
+        }
+        count = compact::readCount(raw, compact::SPEED_BOOST_PACKED_SIZE, end);
+        reader.speedBoostCount(count);
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t x;
+            int32_t y;
+            compact::readCoord(raw, x, y, end);
+            reader.speedBoost(x, y);
+        }
+
+        count = compact::readCount(raw, compact::MIN_PLAYER_PACKED_SIZE, end);
+        reader.playerCount(count);
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t clientId;
+            uint8_t color;
+            char direction;
+            int32_t score;
+            readRawBytes(raw, clientId, end);
+            readRawBytes(raw, color, end);
+            readRawBytes(raw, direction, end);
+            readRawBytes(raw, score, end);
+            compact::readName(raw, name, end);
+            compact::readBody(raw, reader.player(clientId, color, direction, score, name), end);
+        }
+        return hdr;
+    }
+
+    namespace compact {
+
+        struct GameStateReader {
+            GameState & msg;
+
+            void highScore(const int32_t score, const char (&username)[16]) {
+                msg.highScore = score;
+                std::memcpy(msg.highScoreUsername, username, sizeof(username));
+            }
+            void foodCount(const uint32_t count) { msg.food.reserve(count); }
+            void food(const int32_t x, const int32_t y, const uint8_t color) {
+                msg.food.push_back({color, SnakeConstants::FOOD_ICON, x, y});
+            }
+            void speedBoostCount(const uint32_t count) { msg.speedBoosts.reserve(count); }
+            void speedBoost(const int32_t x, const int32_t y) {
+                msg.speedBoosts.push_back(
+                    {static_cast<int32_t>(SPEED_BOOST_COLOR), SnakeConstants::SPEED_BOOST_ICON, x, y});
+            }
+            void playerCount(const uint32_t count) { msg.players.reserve(count); }
+            std::vector<Cell> & player(const int32_t clientId, const uint8_t color, const char direction,
+                                       const int32_t score, const char (&username)[16]) {
+                GameState::Player & p {msg.players.emplace_back()};
+                p.clientId = clientId;
+                p.color = color;
+                p.direction = direction;
+                p.score = score;
+                std::memcpy(p.username, username, sizeof(username));
+                return p.segments;
+            }
+        };
+
+    } // namespace compact
+
+    // The GameState a GAME_STATE_COMPACT frame encodes, with the header it was sent with other than
+    // its messageType, which is GAME_STATE as for any other game state
+    inline GameState deserialiseCompact(const std::string_view frame) {
+        GameState msg {};
+        compact::GameStateReader reader {msg};
+        msg.hdr = readCompact(frame, reader);
+        return msg;
+    }
+
+} // namespace protocol
@@ -7,7 +7,11 @@ inline constexpr int INPUT_BLOCKING_TIMEOUT_MS {10};
 inline constexpr int MOVEMENT_FREQUENCY_MS {200};
 inline constexpr int ARENA_WIDTH {40};
 inline constexpr int ARENA_HEIGHT {40};
+inline constexpr int ARENA_MIN_SIDE {12};   // players start 6 cells in from the edges
+inline constexpr int ARENA_MAX_SIDE {4096}; // the engine keeps a few bytes per cell
 inline constexpr int CLIENT_HORIZONTAL_SCALING {2};
+inline constexpr int CLIENT_VIEWPORT_WIDTH {40}; // bigger arenas are shown as a window that follows the player
+inline constexpr int CLIENT_VIEWPORT_HEIGHT {40};
 inline constexpr int MIN_FOOD_IN_ARENA {6};
 inline constexpr int FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY {3};
 inline constexpr int SPEED_BOOST_PROBABILITY {80};
@@ -17,16 +21,27 @@ inline constexpr int BOOSTED_MOVEMENT_FREQUENCY_MS {static_cast<int>(MOVEMENT_FR
 
 // network
 inline constexpr int SERVER_PORT {8170};
+inline constexpr int MAX_ROOMS {256}; // each room runs its own simulation thread
 inline constexpr int MAX_EVENTS {10};
 inline constexpr int EPOLL_BLOCKING_TIMEOUT_MS {10};
 inline constexpr size_t SERVER_RECV_BUFFER_SIZE {4096};
 inline constexpr size_t SERVER_RECV_MAX_MESSAGE_SIZE {64};
 inline constexpr size_t CLIENT_RECV_BUFFER_SIZE {32768};
 inline constexpr size_t CLIENT_RECV_MAX_MESSAGE_SIZE {32768};
+inline constexpr int GAME_STATE_KEYFRAME_INTERVAL {100};
+inline constexpr size_t SERVER_OUTBOUND_QUEUE_MAX_BYTES {1 << 20};
+inline constexpr int GAME_STATE_INTEREST_RADIUS {0}; // cells around a client's head it is sent, 0 for the whole arena
+inline constexpr int INTEREST_BUCKET_SIZE {16};
+inline constexpr int LEADERBOARD_SIZE {10};
 
 // logging
 inline constexpr int STATS_FREQUENCY_SECONDS {15};
 inline constexpr int LOGGING_FLUSH_INTERVAL_SECONDS {3};
+inline constexpr int CHECKPOINT_INTERVAL_MS {60000}; // engine state written into the message log, 0 for never
+inline constexpr size_t MESSAGE_LOG_BLOCK_BYTES {1 << 20};
+inline constexpr size_t MESSAGE_LOG_MAX_QUEUED_BYTES {64 << 20}; // past this the game loop waits for the disk
+inline constexpr int MESSAGE_LOG_FLUSH_INTERVAL_MS {200};         // a part filled block is written after this long
+inline constexpr int MESSAGE_LOG_FSYNC_INTERVAL_MS {1000};
 inline std::string LOGGING_FORMAT {"[%Y-%m-%d %H:%M:%S.%f] [{}] [%l] %v"};
 
 namespace SnakeConstants {
@@ -35,6 +50,8 @@ namespace SnakeConstants {
     inline const char PLAYER_KEY_DOWN = 'v';
     inline const char PLAYER_KEY_LEFT = '<';
     inline const char PLAYER_KEY_RIGHT = '>';
+    inline const char FOOD_ICON = '@';
+    inline const char SPEED_BOOST_ICON = '*';
 } // namespace SnakeConstants
 
 enum class Color : int32_t {
@@ -44,4 +61,6 @@ enum class Color : int32_t {
     GREEN = 4,
     CYAN = 5,
     MAGENTA = 6,
-};
\ No newline at end of file
+};
+
+inline constexpr Color SPEED_BOOST_COLOR {Color::WHITE};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+// Bytes read off one socket, split into the length prefixed frames they carry. Frames are handed
+// out as views into the buffer, so a burst of them costs the one copy out of the kernel. Only the
+// partial frame left at the end is ever moved, back to the front before the next read, which
+// leaves room for at least readSize more bytes. The buffer grows to fit the biggest frame seen,
+// up to maxFrameSize
+class FrameBuffer {
+public:
+    enum class FillResult {
+        DRAINED, // read everything the socket had
+        FULL,    // stopped with the buffer full, the socket may still have more
+        CLOSED,  // the peer shut the connection
+        ERROR,   // the connection is broken
+    };
+
+    FrameBuffer(const std::size_t maxFrameSize, const std::size_t readSize);
+
+    // Reads until the socket would block or the buffer is full. Views from next() are only good
+    // until the following fill or append
+    FillResult fill(const int fd);
+    // for bytes that were read off the socket before it was handed to us
+    void append(const std::string_view bytes);
+    // the payload of the next complete frame
+    std::optional<std::string_view> next();
+    // the length the front frame claims, if it is over maxFrameSize. Nothing after it can be
+    // trusted to be framed, so next() stops there
+    std::optional<uint32_t> oversizedFrame() const;
+    // leaves the frames already handed out where they are, the buffer only grows on the next fill
+    void setMaxFrameSize(const std::size_t size) { maxFrameSize = size; };
+    std::size_t buffered() const { return end - begin; };
+
+private:
+    void compact();
+    std::optional<uint32_t> frontLength() const;
+
+    std::size_t maxFrameSize;
+    const std::size_t readSize;
+    std::string storage;
+    std::size_t begin {0}; // start of the first frame not yet handed out
+    std::size_t end {0};   // end of the bytes read
+};
+
+inline FrameBuffer::FrameBuffer(const std::size_t maxFrameSize_, const std::size_t readSize_)
+    : maxFrameSize {maxFrameSize_},
+      readSize {readSize_},
+      storage(sizeof(uint32_t) + readSize_, '\0') {}
+
+inline FrameBuffer::FillResult FrameBuffer::fill(const int fd) {
+    compact();
+    // room to read, and for all of the frame at the front once its length is known
+    std::size_t wanted {end + readSize};
+    if (const std::optional<uint32_t> len {frontLength()}; len && *len <= maxFrameSize) {
+        wanted = std::max(wanted, sizeof(*len) + *len);
+    }
+    if (storage.size() < wanted) {
+        storage.resize(wanted);
+    }
+    while (end < storage.size()) {
+        const ssize_t bytesRead {recv(fd, storage.data() + end, storage.size() - end, 0)};
+        if (bytesRead < 0) {
+            return errno == EAGAIN ? FillResult::DRAINED : FillResult::ERROR; // same value as EWOULDBLOCK on Linux
+        }
+        if (bytesRead == 0) {
+            return FillResult::CLOSED;
+        }
+        end += static_cast<std::size_t>(bytesRead);
+    }
+    return FillResult::FULL;
+}
+
+inline void FrameBuffer::append(const std::string_view bytes) {
+    compact();
+    if (storage.size() - end < bytes.size()) {
+        storage.resize(end + bytes.size());
+    }
+    std::memcpy(storage.data() + end, bytes.data(), bytes.size());
+    end += bytes.size();
+}
+
+inline std::optional<std::string_view> FrameBuffer::next() {
+    const std::optional<uint32_t> len {frontLength()};
+    // not here in full yet, or over the limit and left for oversizedFrame to report
+    if (!len || *len > maxFrameSize || end - begin - sizeof(*len) < *len) {
+        return std::nullopt;
+    }
+    const std::string_view frame {storage.data() + begin + sizeof(*len), *len};
+    begin += sizeof(*len) + *len;
+    return frame;
+}
+
+inline std::optional<uint32_t> FrameBuffer::oversizedFrame() const {
+    const std::optional<uint32_t> len {frontLength()};
+    return len && *len > maxFrameSize ? len : std::nullopt;
+}
+
+inline std::optional<uint32_t> FrameBuffer::frontLength() const {
+    uint32_t len;
+    if (end - begin < sizeof(len)) {
+        return std::nullopt;
+    }
+    std::memcpy(&len, storage.data() + begin, sizeof(len));
+    return len;
+}
+
+inline void FrameBuffer::compact() {
+    if (begin == end) {
+        begin = end = 0;
+    } else if (begin > 0) {
+        std::memmove(storage.data(), storage.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+}
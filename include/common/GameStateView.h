@@ -0,0 +1,222 @@
+#pragma once
+
+#include "common/Protocol.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+namespace protocol {
+
+    namespace view {
+
+        // the offsets the accessors below read at
+        static_assert(FOOD_PACKED_SIZE == 4 + 1 + 4 + 4);
+        static_assert(PLAYER_PACKED_SIZE == 4 + 4 + 1 + 4 + sizeof(GameState::Player::username));
+
+        template <typename T>
+        inline T readAt(const char * raw) {
+            T value;
+            std::memcpy(&value, raw, sizeof(value));
+            return value;
+        }
+
+        inline GameState::Player::Segment decodeCell(const char * raw) {
+            return {readAt<int32_t>(raw), readAt<int32_t>(raw + sizeof(int32_t))};
+        }
+
+        inline GameState::Food decodeFood(const char * raw) {
+            return {readAt<int32_t>(raw), readAt<char>(raw + 4), readAt<int32_t>(raw + 5), readAt<int32_t>(raw + 9)};
+        }
+
+        // up to the first NUL, as the fixed size name fields are padded
+        inline std::string_view name(const char * raw, const std::size_t size) {
+            return {raw, strnlen(raw, size)};
+        }
+
+        // A counted list of fixed size entries, each decoded as the iterator reaches it
+        template <typename T, std::size_t STRIDE, T (*decode)(const char *)>
+        class PackedRange {
+        public:
+            class iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = T;
+                using difference_type = std::ptrdiff_t;
+                using pointer = void;
+                using reference = T;
+
+                iterator() : raw {nullptr} {}
+                explicit iterator(const char * raw_) : raw {raw_} {}
+                T operator*() const { return decode(raw); }
+                iterator & operator++() {
+                    raw += STRIDE;
+                    return *this;
+                }
+                iterator operator++(int) {
+                    iterator before {*this};
+                    raw += STRIDE;
+                    return before;
+                }
+                bool operator==(const iterator &) const = default;
+
+            private:
+                const char * raw;
+            };
+
+            PackedRange(const char * first_, const uint32_t count_) : first {first_}, count {count_} {}
+            iterator begin() const { return iterator {first}; }
+            iterator end() const { return iterator {first + count * STRIDE}; }
+            std::size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+
+        private:
+            const char * first;
+            uint32_t count;
+        };
+
+    } // namespace view
+
+    using CellRange = view::PackedRange<GameState::Player::Segment, CELL_PACKED_SIZE, view::decodeCell>;
+    using FoodRange = view::PackedRange<GameState::Food, FOOD_PACKED_SIZE, view::decodeFood>;
+
+    // One player of a GameStateView, its fields read from the frame as they are asked for
+    class PlayerView {
+    public:
+        explicit PlayerView(const char * raw_) : raw {raw_} {}
+        int32_t clientId() const { return view::readAt<int32_t>(raw); }
+        int32_t color() const { return view::readAt<int32_t>(raw + 4); }
+        char direction() const { return view::readAt<char>(raw + 8); }
+        int32_t score() const { return view::readAt<int32_t>(raw + 9); }
+        std::string_view username() const { return view::name(raw + 13, sizeof(GameState::Player::username)); }
+        CellRange segments() const { return {raw + PLAYER_PACKED_SIZE + COUNT_PACKED_SIZE, segmentCount()}; }
+        // where the next player starts
+        const char * end() const {
+            return raw + PLAYER_PACKED_SIZE + COUNT_PACKED_SIZE + segmentCount() * CELL_PACKED_SIZE;
+        }
+
+    private:
+        uint32_t segmentCount() const { return view::readAt<uint32_t>(raw + PLAYER_PACKED_SIZE); }
+
+        const char * raw;
+    };
+
+    class PlayerRange {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = PlayerView;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = PlayerView;
+
+            iterator() : raw {nullptr} {}
+            explicit iterator(const char * raw_) : raw {raw_} {}
+            PlayerView operator*() const { return PlayerView {raw}; }
+            iterator & operator++() {
+                raw = PlayerView {raw}.end();
+                return *this;
+            }
+            iterator operator++(int) {
+                iterator before {*this};
+                ++*this;
+                return before;
+            }
+            bool operator==(const iterator &) const = default;
+
+        private:
+            const char * raw;
+        };
+
+        PlayerRange(const char * first_, const char * last_, const uint32_t count_)
+            : first {first_}, last {last_}, count {count_} {}
+        iterator begin() const { return iterator {first}; }
+        iterator end() const { return iterator {last}; }
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+    private:
+        const char * first;
+        const char * last;
+        uint32_t count;
+    };
+
+    // A GAME_STATE read in place from its frame, rather than deserialised into vectors. The
+    // constructor walks the frame once, checking every count against the bytes that follow, so
+    // the ranges decode fields as they are iterated with no further checks. The frame must
+    // outlive the view and everything taken from it
+    class GameStateView {
+    public:
+        explicit GameStateView(const std::string_view frame);
+
+        const Header & header() const { return hdr; }
+        int32_t highScore() const { return view::readAt<int32_t>(body); }
+        std::string_view highScoreUsername() const {
+            return view::name(body + sizeof(GameState::highScore), sizeof(GameState::highScoreUsername));
+        }
+        FoodRange food() const { return {foodStart + COUNT_PACKED_SIZE, view::readAt<uint32_t>(foodStart)}; }
+        FoodRange speedBoosts() const {
+            return {speedBoostsStart + COUNT_PACKED_SIZE, view::readAt<uint32_t>(speedBoostsStart)};
+        }
+        PlayerRange players() const {
+            return {playersStart + COUNT_PACKED_SIZE, playersEnd, view::readAt<uint32_t>(playersStart)};
+        }
+
+    private:
+        Header hdr;
+        const char * body; // just after the header
+        const char * foodStart;
+        const char * speedBoostsStart;
+        const char * playersStart;
+        const char * playersEnd;
+    };
+
+    inline GameStateView::GameStateView(const std::string_view frame) : hdr {peekHeader(frame)} {
+        if (hdr.messageType != MessageType::GAME_STATE) {
+            throw std::runtime_error("GameStateView: not a GAME_STATE");
+        }
+        const char * const end {frame.data() + frame.size()};
+        const char * raw {frame.data() + HEADER_PACKED_SIZE};
+        // skips a counted list of stride sized entries, or throws if the frame is too short for it
+        auto skipList = [&raw, end](const std::size_t stride) {
+            if (static_cast<std::size_t>(end - raw) < COUNT_PACKED_SIZE) {
+                throw std::runtime_error("GameStateView: truncated frame");
+            }
+            const std::size_t bytes {view::readAt<uint32_t>(raw) * stride};
+            raw += COUNT_PACKED_SIZE;
+            if (static_cast<std::size_t>(end - raw) < bytes) {
+                throw std::runtime_error("GameStateView: truncated frame");
+            }
+            raw += bytes;
+        };
+
+        body = raw;
+        if (static_cast<std::size_t>(end - raw) < sizeof(GameState::highScore) + sizeof(GameState::highScoreUsername)) {
+            throw std::runtime_error("GameStateView: truncated frame");
+        }
+        raw += sizeof(GameState::highScore) + sizeof(GameState::highScoreUsername);
+        foodStart = raw;
+        skipList(FOOD_PACKED_SIZE);
+        speedBoostsStart = raw;
+        skipList(FOOD_PACKED_SIZE);
+        playersStart = raw;
+        if (static_cast<std::size_t>(end - raw) < COUNT_PACKED_SIZE) {
+            throw std::runtime_error("GameStateView: truncated frame");
+        }
+        const uint32_t players {view::readAt<uint32_t>(raw)};
+        raw += COUNT_PACKED_SIZE;
+        for (uint32_t i = 0; i < players; i++) {
+            if (static_cast<std::size_t>(end - raw) < PLAYER_PACKED_SIZE) {
+                throw std::runtime_error("GameStateView: truncated frame");
+            }
+            raw += PLAYER_PACKED_SIZE;
+            skipList(CELL_PACKED_SIZE);
+        }
+        playersEnd = raw;
+    }
+
+} // namespace protocol
@@ -1,10 +1,37 @@
 #pragma once
 
-#include <functional>
-#include <utility>
+#include <cstdint>
 
-struct PairHash {
-    std::size_t operator()(const std::pair<int, int> & p) const {
-        return std::hash<int>()(p.first) ^ (std::hash<int>()(p.second) << 1);
+// 64 bit mixing for the engine state hash. Defined here rather than taken from std::hash, which
+// differs between standard libraries, so a hash written into a message log can be checked by
+// any build on any machine
+namespace hash {
+
+    // the splitmix64 finaliser: every input bit affects every output bit
+    constexpr uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111eb;
+        x ^= x >> 31;
+        return x;
+    }
+
+    // order matters, combine(a, b) != combine(b, a)
+    constexpr uint64_t combine(const uint64_t seed, const uint64_t value) {
+        return mix(seed + 0x9e3779b97f4a7c15 + mix(value));
+    }
+
+    template <typename... Values>
+    constexpr uint64_t of(const uint64_t first, const Values... rest) {
+        uint64_t h {mix(first)};
+        ((h = combine(h, static_cast<uint64_t>(rest))), ...);
+        return h;
+    }
+
+    // a cell's term in a sum over cells, which a move updates with one add and one subtract
+    constexpr uint64_t cell(const int x, const int y) {
+        return mix((static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y));
     }
-};
+
+} // namespace hash
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A small LZ77 codec for message log blocks. The stream is a run of sequences, each a token byte
+// (literal count in the high nibble, match length - MIN_MATCH in the low one, 15 meaning more
+// follows in 255-continued bytes), the literals, then the match distance as a varint. The last
+// sequence has literals only. Distances reach back across the whole block, so a game state can
+// copy from the previous one however big the arena is. Greedy matching through one hash table
+// slot per 4 byte prefix, fast rather than tight, like LZ4
+namespace lz {
+
+    inline constexpr std::size_t MIN_MATCH {4};
+    inline constexpr int HASH_BITS {16};
+
+    namespace detail {
+
+        inline uint32_t read32(const char * p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t hash(const char * p) {
+            return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        inline void writeLength(std::string & out, std::size_t length) {
+            while (length >= 255) {
+                out.push_back(static_cast<char>(255));
+                length -= 255;
+            }
+            out.push_back(static_cast<char>(length));
+        }
+
+        inline void writeSequence(std::string & out, const char * literals, const std::size_t literalCount,
+                                  const std::size_t matchLength, const std::size_t distance) {
+            const std::size_t matchCode {matchLength ? matchLength - MIN_MATCH : 0};
+            out.push_back(static_cast<char>(((literalCount < 15 ? literalCount : 15) << 4) |
+                                            (matchCode < 15 ? matchCode : 15)));
+            if (literalCount >= 15) {
+                writeLength(out, literalCount - 15);
+            }
+            out.append(literals, literalCount);
+            if (matchLength == 0) {
+                return;
+            }
+            for (std::size_t d {distance}; ; d >>= 7) {
+                if (d < 0x80) {
+                    out.push_back(static_cast<char>(d));
+                    break;
+                }
+                out.push_back(static_cast<char>((d & 0x7f) | 0x80));
+            }
+            if (matchCode >= 15) {
+                writeLength(out, matchCode - 15);
+            }
+        }
+
+        inline std::size_t readLength(const char *& in, const char * end, std::size_t length) {
+            if (length != 15) {
+                return length;
+            }
+            uint8_t byte;
+            do {
+                if (in >= end) {
+                    throw std::runtime_error("lz: truncated length");
+                }
+                byte = static_cast<uint8_t>(*in++);
+                length += byte;
+            } while (byte == 255);
+            return length;
+        }
+
+    } // namespace detail
+
+    // Holds the match table, so a long lived compressor allocates it once
+    class Compressor {
+    public:
+        Compressor() : table(std::size_t {1} << HASH_BITS) {}
+
+        // replaces out with the compressed form of in
+        void compress(const std::string_view in, std::string & out) {
+            out.clear();
+            std::fill(table.begin(), table.end(), UINT32_MAX);
+            const char * base {in.data()};
+            const std::size_t size {in.size()};
+            std::size_t anchor {0};
+            std::size_t pos {0};
+            while (size >= MIN_MATCH && pos + MIN_MATCH <= size) {
+                uint32_t & slot {table[detail::hash(base + pos)]};
+                const uint32_t candidate {slot};
+                slot = static_cast<uint32_t>(pos);
+                if (candidate == UINT32_MAX || detail::read32(base + candidate) != detail::read32(base + pos)) {
+                    pos++;
+                    continue;
+                }
+                std::size_t length {MIN_MATCH};
+                while (pos + length < size && base[candidate + length] == base[pos + length]) {
+                    length++;
+                }
+                detail::writeSequence(out, base + anchor, pos - anchor, length, pos - candidate);
+                // index every other position inside the match too, so later records can match into it
+                const std::size_t matchEnd {pos + length};
+                for (std::size_t i {pos + 1}; i + MIN_MATCH <= size && i < matchEnd; i += 2) {
+                    table[detail::hash(base + i)] = static_cast<uint32_t>(i);
+                }
+                pos = matchEnd;
+                anchor = pos;
+            }
+            detail::writeSequence(out, base + anchor, size - anchor, 0, 0);
+        }
+
+    private:
+        std::vector<uint32_t> table;
+    };
+
+    // replaces out with the rawSize bytes that in decompresses to, throwing if in is malformed
+    inline void decompress(const std::string_view in, const std::size_t rawSize, std::string & out) {
+        out.resize(rawSize);
+        char * dst {out.data()};
+        char * const dstEnd {dst + rawSize};
+        const char * src {in.data()};
+        const char * const srcEnd {src + in.size()};
+        while (src < srcEnd) {
+            const auto token {static_cast<uint8_t>(*src++)};
+            const std::size_t literals {detail::readLength(src, srcEnd, token >> 4)};
+            if (literals > static_cast<std::size_t>(srcEnd - src) ||
+                literals > static_cast<std::size_t>(dstEnd - dst)) {
+                throw std::runtime_error("lz: literals overrun");
+            }
+            std::memcpy(dst, src, literals);
+            src += literals;
+            dst += literals;
+            if (src == srcEnd) {
+                break; // the last sequence, literals only
+            }
+            std::size_t distance {0};
+            for (int shift {0}; ; shift += 7) {
+                if (src >= srcEnd || shift > 35) {
+                    throw std::runtime_error("lz: bad match distance");
+                }
+                const auto byte {static_cast<uint8_t>(*src++)};
+                distance |= static_cast<std::size_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+            const std::size_t length {detail::readLength(src, srcEnd, token & 0x0f) + MIN_MATCH};
+            if (distance == 0 || distance > static_cast<std::size_t>(dst - out.data()) ||
+                length > static_cast<std::size_t>(dstEnd - dst)) {
+                throw std::runtime_error("lz: match out of range");
+            }
+            const char * from {dst - distance};
+            if (distance >= length) {
+                std::memcpy(dst, from, length);
+            } else {
+                // the match overlaps the bytes it is producing, a run
+                for (std::size_t i {0}; i < length; i++) {
+                    dst[i] = from[i];
+                }
+            }
+            dst += length;
+        }
+        if (dst != dstEnd) {
+            throw std::runtime_error("lz: decompressed size mismatch");
+        }
+    }
+
+} // namespace lz
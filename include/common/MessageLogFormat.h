@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// On disk layout of a compressed message log (version 2). The legacy layout is just the records,
+// each a uint32 length then the serialised message. Version 2 puts those same record bytes into
+// blocks that are compressed independently:
+//
+//     FileHeader  BlockHeader payload  BlockHeader payload  ...  Footer entries  Trailer
+//
+// The footer lists every block with the sequence and transactTime of its first record, so a
+// reader can go straight to the block holding any record. A log cut short (the server was killed)
+// has no footer and is read by walking the block headers instead. Offsets a reader reports are
+// logical, ie positions in the uncompressed record stream, the same as in a legacy log
+namespace logformat {
+
+    inline constexpr char FILE_MAGIC[8] {'S', 'N', 'A', 'K', 'E', 'L', 'O', 'G'};
+    inline constexpr char TRAILER_MAGIC[8] {'S', 'N', 'A', 'K', 'E', 'I', 'D', 'X'};
+    inline constexpr uint32_t BLOCK_MAGIC {0x314b4c42}; // "BLK1"
+    inline constexpr uint32_t VERSION {2};
+
+    enum class Codec : uint32_t {
+        RAW = 0, // stored as is, when compressing doesn't pay
+        LZ = 1,  // common/Lz.h
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(FileHeader) == 16);
+
+    struct BlockHeader {
+        uint32_t magic;
+        Codec codec;
+        uint32_t storedSize; // bytes of payload that follow
+        uint32_t rawSize;    // bytes of records it holds
+        uint32_t records;
+        uint32_t reserved;
+        int64_t firstSequence;
+        int64_t firstTransactTime;
+    };
+    static_assert(sizeof(BlockHeader) == 40);
+
+    struct FooterEntry {
+        uint64_t fileOffset; // of the BlockHeader
+        uint64_t logicalOffset;
+        int64_t firstSequence;
+        int64_t firstTransactTime;
+    };
+    static_assert(sizeof(FooterEntry) == 32);
+
+    struct Trailer {
+        uint64_t footerOffset;
+        uint64_t blocks;
+        char magic[8];
+    };
+    static_assert(sizeof(Trailer) == 24);
+
+    // the structs are little endian and padding free, so they go to and from disk with memcpy
+    template <typename T>
+    inline T read(const char * data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+
+    inline bool isVersion2(const std::string_view file) {
+        return file.size() >= sizeof(FileHeader) && std::memcmp(file.data(), FILE_MAGIC, sizeof(FILE_MAGIC)) == 0;
+    }
+
+} // namespace logformat
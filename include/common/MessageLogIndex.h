@@ -0,0 +1,109 @@
+#pragma once
+
+#include "common/MessageLogReader.h"
+#include "common/Protocol.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Where the ENGINE_CHECKPOINT records are in a message log. The server appends an entry to
+// <log>.idx as it writes each checkpoint, so a replay can jump to the last checkpoint before any
+// sequence or time with one binary search and one seek. A log without its .idx is scanned
+// instead, reading just the record headers
+class MessageLogIndex {
+public:
+    struct Entry {
+        int64_t sequence;
+        int64_t transactTime;
+        uint64_t offset; // of the record's length prefix, logical in a compressed log
+    };
+    static_assert(sizeof(Entry) == 24);
+
+    static std::string indexFileName(const std::string & logFileName) { return logFileName + ".idx"; }
+
+    static MessageLogIndex load(const std::string & logFileName);
+    static MessageLogIndex scan(const std::string & logFileName);
+
+    // the last checkpoint at or before the target, if there is one
+    std::optional<Entry> atOrBeforeSequence(const int64_t sequence) const;
+    std::optional<Entry> atOrBeforeTime(const int64_t transactTime) const;
+
+    const std::vector<Entry> & entries() const { return checkpoints; }
+
+private:
+    template <typename Key>
+    std::optional<Entry> atOrBefore(const int64_t target, Key key) const;
+
+    std::vector<Entry> checkpoints; // in log order, so ascending in sequence and time
+};
+
+inline MessageLogIndex MessageLogIndex::load(const std::string & logFileName) {
+    std::ifstream in {indexFileName(logFileName), std::ios::in | std::ios::binary};
+    if (!in) {
+        return scan(logFileName);
+    }
+    MessageLogIndex index {};
+    Entry entry;
+    while (in.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+        index.checkpoints.push_back(entry);
+    }
+    return index;
+}
+
+inline MessageLogIndex MessageLogIndex::scan(const std::string & logFileName) {
+    MessageLogReader reader {logFileName};
+    MessageLogIndex index {};
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        if (record->hdr.messageType == protocol::MessageType::ENGINE_CHECKPOINT) {
+            index.checkpoints.push_back({record->hdr.sequence, record->hdr.transactTime, record->offset});
+        }
+    }
+    return index;
+}
+
+template <typename Key>
+inline std::optional<MessageLogIndex::Entry> MessageLogIndex::atOrBefore(const int64_t target, Key key) const {
+    auto it {std::upper_bound(checkpoints.begin(), checkpoints.end(), target,
+                              [&](const int64_t t, const Entry & e) { return t < key(e); })};
+    if (it == checkpoints.begin()) {
+        return std::nullopt;
+    }
+    return *std::prev(it);
+}
+
+inline std::optional<MessageLogIndex::Entry> MessageLogIndex::atOrBeforeSequence(const int64_t sequence) const {
+    return atOrBefore(sequence, [](const Entry & e) { return e.sequence; });
+}
+
+inline std::optional<MessageLogIndex::Entry> MessageLogIndex::atOrBeforeTime(const int64_t transactTime) const {
+    return atOrBefore(transactTime, [](const Entry & e) { return e.transactTime; });
+}
+
+// appends entries to <log>.idx as the server writes checkpoints
+class MessageLogIndexWriter {
+public:
+    MessageLogIndexWriter(const std::string & logFileName, const bool logging)
+        : out {} {
+        if (logging) {
+            out.open(MessageLogIndex::indexFileName(logFileName), std::ios::out | std::ios::binary);
+            if (!out) {
+                throw std::runtime_error("Failed to open index file " + MessageLogIndex::indexFileName(logFileName));
+            }
+        }
+    }
+
+    void append(const MessageLogIndex::Entry & entry) {
+        if (out.is_open()) {
+            out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+            out.flush();
+        }
+    }
+
+private:
+    std::ofstream out;
+};
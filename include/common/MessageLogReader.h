@@ -1,70 +1,375 @@
 #pragma once
 
+#include "common/Lz.h"
+#include "common/MessageLogFormat.h"
 #include "common/Protocol.h"
 
-#include <cassert>
-#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <initializer_list>
 #include <optional>
+#include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
+// Reads a message log through a read-only mapping of the whole file, in either the legacy or the
+// block compressed layout (common/MessageLogFormat.h). Records come back as views, the header
+// peeked and the rest left as bytes, so only the records the caller asks for are deserialised.
+// A legacy log is one uncompressed block over the mapping, and walking it allocates nothing. A
+// compressed block is decoded into a pooled buffer when the reader reaches it, and views into it
+// stay valid until the first next(), nextBatch() or seek() called after the reader has left it.
+// Offsets are logical, positions in the uncompressed record stream, whatever the layout
 class MessageLogReader {
 public:
-    explicit MessageLogReader(const std::string & fileName)
-        : in {fileName, std::ios::in | std::ios::binary}, currentTransactTime {0} {
-        if (!in) {
-            throw std::runtime_error("Failed to open log file " + fileName);
+    struct Record {
+        protocol::Header hdr;
+        std::string_view bytes; // the whole serialised message, header included
+        uint64_t offset;        // of the record's length prefix in the log
+    };
+
+    // a set of MessageTypes, for choosing which records a batch returns
+    using TypeMask = uint32_t;
+    static constexpr TypeMask ALL_TYPES {~TypeMask {0}};
+    static constexpr TypeMask typeMask(std::initializer_list<protocol::MessageType> types) {
+        TypeMask mask {0};
+        for (const protocol::MessageType type : types) {
+            mask |= TypeMask {1} << static_cast<uint32_t>(type);
         }
+        return mask;
+    }
+    static constexpr bool inMask(const TypeMask mask, const protocol::MessageType type) {
+        const auto bit {static_cast<uint32_t>(type)};
+        return bit < 32 && (mask & (TypeMask {1} << bit)) != 0;
     }
 
-    std::optional<protocol::MessageVariant> first() {
-        uint32_t len;
-        std::string msg;
-        if (in.read(reinterpret_cast<char *>(&len), sizeof(len))) {
-            msg.resize(len);
-            if (!in.read(msg.data(), len)) {
-                throw std::runtime_error("truncated record in message log");
-            }
-            return protocol::deserialise(msg);
+    explicit MessageLogReader(const std::string & fileName);
+    ~MessageLogReader();
+    MessageLogReader(MessageLogReader && other) noexcept;
+    MessageLogReader & operator=(MessageLogReader &&) = delete;
+    MessageLogReader(const MessageLogReader &) = delete;
+    MessageLogReader & operator=(const MessageLogReader &) = delete;
+
+    // the next record, whatever its type
+    std::optional<Record> next();
+    std::optional<protocol::MessageVariant> first();
+
+    // The next run of records sharing a transactTime, keeping those whose type is in the mask.
+    // out is cleared and refilled so its capacity is reused. Returns the batch's transactTime,
+    // nullopt once the log is exhausted. A batch is empty when nothing in it matched
+    std::optional<int64_t> nextBatch(std::vector<Record> & out, const TypeMask mask = ALL_TYPES);
+    // the same, every record decoded
+    std::vector<protocol::MessageVariant> nextBatch();
+
+    // carry on reading from the record at offset, eg a checkpoint found through a MessageLogIndex
+    void seek(const uint64_t offset);
+    // carry on reading from the start of the block holding sequence, found through the footer, so
+    // the next record is at or before it. Returns the block's logical offset
+    uint64_t seekSequence(const int64_t sequence);
+    // the logical size, the bytes of records in the log
+    uint64_t size() const { return length; }
+    // the file size, smaller than size() for a compressed log
+    uint64_t storedSize() const { return mappedLength; }
+    std::size_t blockCount() const { return blocks.size(); }
+
+private:
+    struct Block {
+        uint64_t payloadOffset; // in the file
+        uint64_t storedSize;
+        uint64_t rawSize;
+        logformat::Codec codec;
+        uint64_t logicalOffset;
+        int64_t firstSequence;
+    };
+
+    void loadFooter();
+    void scanBlocks();
+    void load(const std::size_t index);
+    // drops the decoded buffers of blocks the reader has left, which no view can still need
+    void release();
+    std::optional<Record> advance();
+    std::optional<Record> peek();
+    void consume(const Record & record) { position += sizeof(uint32_t) + record.bytes.size(); }
+
+    const char * mapped;
+    uint64_t mappedLength;
+    std::vector<Block> blocks;
+    uint64_t length;
+
+    std::size_t current;    // the block being read
+    std::string_view view;  // its records
+    uint64_t position;      // in view
+    std::string decoded;    // the current block, when compressed
+    std::vector<std::string> retired;
+    std::vector<std::string> pool;
+};
+
+inline MessageLogReader::MessageLogReader(const std::string & fileName)
+    : mapped {nullptr},
+      mappedLength {0},
+      blocks {},
+      length {0},
+      current {0},
+      view {},
+      position {0},
+      decoded {},
+      retired {},
+      pool {} {
+    const int fd {::open(fileName.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open log file " + fileName);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat log file " + fileName);
+    }
+    mappedLength = static_cast<uint64_t>(st.st_size);
+    if (mappedLength > 0) {
+        void * map {::mmap(nullptr, mappedLength, PROT_READ, MAP_PRIVATE, fd, 0)};
+        if (map == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map log file " + fileName);
         }
-        return std::nullopt;
+        // read front to back: the kernel reads ahead aggressively and drops pages behind us
+        ::madvise(map, mappedLength, MADV_SEQUENTIAL);
+        mapped = static_cast<const char *>(map);
     }
+    ::close(fd);
 
-    // return messages all of the same transactTime
-    std::vector<protocol::MessageVariant> nextBatch() {
-        std::vector<protocol::MessageVariant> output {};
-        if (outputBuffer.has_value()) {
-            output.push_back(std::move(outputBuffer.value()));
-            outputBuffer.reset();
-            currentTransactTime = protocol::header(output.front()).transactTime;
+    const std::string_view file {mapped, mappedLength};
+    if (!logformat::isVersion2(file)) {
+        if (mappedLength > 0) {
+            blocks.push_back({0, mappedLength, mappedLength, logformat::Codec::RAW, 0, 0});
+        }
+        length = mappedLength;
+    } else {
+        const auto header {logformat::read<logformat::FileHeader>(mapped)};
+        if (header.version != logformat::VERSION) {
+            throw std::runtime_error("Unsupported message log version " + std::to_string(header.version) + " in " +
+                                     fileName);
         }
+        loadFooter();
+        if (blocks.empty()) {
+            scanBlocks();
+        }
+        if (!blocks.empty()) {
+            length = blocks.back().logicalOffset + blocks.back().rawSize;
+        }
+    }
+    if (!blocks.empty()) {
+        load(0);
+    }
+}
 
-        uint32_t len;
-        std::string msg;
-        while (in.read(reinterpret_cast<char *>(&len), sizeof(len))) {
-            msg.resize(len);
-            if (!in.read(msg.data(), len)) {
-                throw std::runtime_error("truncated record in message log");
-            }
-            protocol::MessageVariant pm {protocol::deserialise(msg)};
-            if (currentTransactTime == 0) {
-                output.push_back(pm);
-                currentTransactTime = protocol::header(pm).transactTime;
-            } else if (protocol::header(pm).transactTime == currentTransactTime) {
-                output.push_back(pm);
-            } else if (protocol::header(pm).transactTime > currentTransactTime) {
-                outputBuffer.emplace(pm);
-                currentTransactTime = protocol::header(pm).transactTime;
-                break;
-            } else {
-                throw std::logic_error("logic error in MessageLogReader::nextBatch loop");
+inline MessageLogReader::~MessageLogReader() {
+    if (mapped != nullptr) {
+        ::munmap(const_cast<char *>(mapped), mappedLength);
+    }
+}
+
+inline MessageLogReader::MessageLogReader(MessageLogReader && other) noexcept
+    : mapped {std::exchange(other.mapped, nullptr)},
+      mappedLength {std::exchange(other.mappedLength, 0)},
+      blocks {std::move(other.blocks)},
+      length {std::exchange(other.length, 0)},
+      current {other.current},
+      view {std::exchange(other.view, {})},
+      position {other.position},
+      decoded {std::move(other.decoded)},
+      retired {std::move(other.retired)},
+      pool {std::move(other.pool)} {
+    // a short decoded block can live in the string itself, and moves with it
+    if (!blocks.empty() && blocks[current].codec != logformat::Codec::RAW) {
+        view = decoded;
+    }
+}
+
+inline void MessageLogReader::loadFooter() {
+    if (mappedLength < sizeof(logformat::FileHeader) + sizeof(logformat::Trailer)) {
+        return;
+    }
+    const auto trailer {logformat::read<logformat::Trailer>(mapped + mappedLength - sizeof(logformat::Trailer))};
+    if (std::memcmp(trailer.magic, logformat::TRAILER_MAGIC, sizeof(trailer.magic)) != 0 ||
+        trailer.footerOffset + trailer.blocks * sizeof(logformat::FooterEntry) + sizeof(trailer) != mappedLength) {
+        return;
+    }
+    blocks.reserve(trailer.blocks);
+    for (uint64_t i {0}; i < trailer.blocks; i++) {
+        const auto entry {logformat::read<logformat::FooterEntry>(mapped + trailer.footerOffset +
+                                                                   i * sizeof(logformat::FooterEntry))};
+        if (entry.fileOffset + sizeof(logformat::BlockHeader) > trailer.footerOffset) {
+            throw std::runtime_error("corrupt footer in message log");
+        }
+        const auto header {logformat::read<logformat::BlockHeader>(mapped + entry.fileOffset)};
+        blocks.push_back({entry.fileOffset + sizeof(header), header.storedSize, header.rawSize, header.codec,
+                          entry.logicalOffset, entry.firstSequence});
+    }
+}
+
+inline void MessageLogReader::scanBlocks() {
+    // no footer, the writer never finished: walk the block headers, dropping a block cut short
+    uint64_t offset {sizeof(logformat::FileHeader)};
+    uint64_t logical {0};
+    while (offset < mappedLength) {
+        if (mappedLength - offset < sizeof(logformat::BlockHeader)) {
+            spdlog::warn("Message log has no footer and ends in a partial block header at {}", offset);
+            break;
+        }
+        const auto header {logformat::read<logformat::BlockHeader>(mapped + offset)};
+        if (header.magic != logformat::BLOCK_MAGIC) {
+            spdlog::warn("Message log has no footer and no block header at {}", offset);
+            break;
+        }
+        if (mappedLength - offset - sizeof(header) < header.storedSize) {
+            spdlog::warn("Message log has no footer and ends in a partial block at {}", offset);
+            break;
+        }
+        blocks.push_back({offset + sizeof(header), header.storedSize, header.rawSize, header.codec, logical,
+                          header.firstSequence});
+        offset += sizeof(header) + header.storedSize;
+        logical += header.rawSize;
+    }
+}
+
+inline void MessageLogReader::load(const std::size_t index) {
+    if (!decoded.empty()) {
+        retired.push_back(std::move(decoded));
+    }
+    decoded.clear();
+    current = index;
+    position = 0;
+    const Block & block {blocks[index]};
+    const std::string_view payload {mapped + block.payloadOffset, block.storedSize};
+    switch (block.codec) {
+        case logformat::Codec::RAW:
+            view = payload;
+            return;
+        case logformat::Codec::LZ:
+            if (!pool.empty()) {
+                decoded = std::move(pool.back());
+                pool.pop_back();
             }
+            lz::decompress(payload, block.rawSize, decoded);
+            view = decoded;
+            return;
+    }
+    throw std::runtime_error("unknown codec in message log block at " + std::to_string(block.payloadOffset));
+}
+
+inline void MessageLogReader::release() {
+    for (std::string & buffer : retired) {
+        pool.push_back(std::move(buffer));
+    }
+    retired.clear();
+}
+
+inline std::optional<MessageLogReader::Record> MessageLogReader::peek() {
+    while (position == view.size()) {
+        if (current + 1 >= blocks.size()) {
+            return std::nullopt;
         }
-        return output;
+        load(current + 1);
     }
+    uint32_t len;
+    if (view.size() - position < sizeof(len)) {
+        throw std::runtime_error("truncated record in message log");
+    }
+    std::memcpy(&len, view.data() + position, sizeof(len));
+    if (len < protocol::HEADER_PACKED_SIZE || view.size() - position - sizeof(len) < len) {
+        throw std::runtime_error("truncated record in message log");
+    }
+    const std::string_view bytes {view.data() + position + sizeof(len), len};
+    return Record {protocol::peekHeader(bytes), bytes, blocks[current].logicalOffset + position};
+}
 
-private:
-    std::ifstream in;
-    int64_t currentTransactTime;
-    std::optional<protocol::MessageVariant> outputBuffer {};
-};
+inline std::optional<MessageLogReader::Record> MessageLogReader::advance() {
+    std::optional<Record> record {peek()};
+    if (record) {
+        consume(*record);
+    }
+    return record;
+}
+
+inline std::optional<MessageLogReader::Record> MessageLogReader::next() {
+    release();
+    return advance();
+}
+
+inline std::optional<protocol::MessageVariant> MessageLogReader::first() {
+    if (const std::optional<Record> record = next()) {
+        return protocol::deserialise(record->bytes);
+    }
+    return std::nullopt;
+}
+
+inline std::optional<int64_t> MessageLogReader::nextBatch(std::vector<Record> & out, const TypeMask mask) {
+    out.clear();
+    std::optional<Record> record {next()};
+    if (!record) {
+        return std::nullopt;
+    }
+    const int64_t transactTime {record->hdr.transactTime};
+    while (true) {
+        if (inMask(mask, record->hdr.messageType)) {
+            out.push_back(*record);
+        }
+        record = peek();
+        if (!record || record->hdr.transactTime > transactTime) {
+            break;
+        }
+        if (record->hdr.transactTime < transactTime) {
+            throw std::logic_error("message log goes back in time at offset " + std::to_string(record->offset));
+        }
+        consume(*record); // peeked already, no need to read it again
+    }
+    return transactTime;
+}
+
+inline std::vector<protocol::MessageVariant> MessageLogReader::nextBatch() {
+    std::vector<Record> records {};
+    std::vector<protocol::MessageVariant> output {};
+    if (nextBatch(records)) {
+        output.reserve(records.size());
+        for (const Record & record : records) {
+            output.push_back(protocol::deserialise(record.bytes));
+        }
+    }
+    return output;
+}
+
+inline void MessageLogReader::seek(const uint64_t offset) {
+    if (offset > length) {
+        throw std::runtime_error("Failed to seek message log to offset " + std::to_string(offset));
+    }
+    if (blocks.empty()) {
+        return;
+    }
+    release();
+    const auto it {std::upper_bound(blocks.begin(), blocks.end(), offset,
+                                    [](const uint64_t o, const Block & b) { return o < b.logicalOffset; })};
+    const auto index {static_cast<std::size_t>(std::prev(it) - blocks.begin())};
+    if (index != current) {
+        load(index);
+    }
+    position = offset - blocks[index].logicalOffset;
+}
+
+inline uint64_t MessageLogReader::seekSequence(const int64_t sequence) {
+    if (blocks.empty()) {
+        return 0;
+    }
+    // a legacy log is one block, so this goes back to the start of it
+    const auto it {std::upper_bound(blocks.begin(), blocks.end(), sequence,
+                                    [](const int64_t s, const Block & b) { return s < b.firstSequence; })};
+    const Block & block {it == blocks.begin() ? blocks.front() : *std::prev(it)};
+    seek(block.logicalOffset);
+    return block.logicalOffset;
+}
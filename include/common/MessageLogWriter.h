@@ -1,26 +1,372 @@
 #pragma once
 
+#include "common/Constants.h"
+#include "common/Lz.h"
+#include "common/MessageLogFormat.h"
 #include "common/Protocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <optional>
+#include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
+enum class MessageLogFsync {
+    NEVER,       // leave it to the page cache
+    EVERY_BLOCK, // fdatasync after each block is written
+    INTERVAL,    // fdatasync after a write once the interval has passed since the last one
+};
+
+// Appends length prefixed records to <applicationName>.bin without touching the disk on the caller's
+// thread. Records are copied into the active block, and a full block (or one older than the flush
+// interval) is handed to a background thread that compresses it, writes it with its header in the
+// common/MessageLogFormat.h layout and returns the buffer for reuse. The footer index goes on when
+// the writer is destroyed. The two threads only meet at a block hand-off. If the disk falls more
+// than maxQueuedBytes behind, log() waits for it rather than dropping records, and the wait is
+// counted in stats(). With compressed off the file is in the legacy layout, records and nothing else.
+// A failed write is final: the file is cut back to the last whole block, every later block and the
+// footer are dropped, and stats() and the destructor say so.
+// Nothing hands over a part filled block while log() isn't called, so an idle caller wakes itself
+// for flushDeadline() and calls flushIfDue()
 class MessageLogWriter {
 public:
-    explicit MessageLogWriter(const std::string & applicationName)
-        : out {applicationName + ".bin", std::ios::out | std::ios::binary} {
-        if (!out) {
-            throw std::runtime_error("Failed to open log file " + applicationName + ".bin");
+    struct Stats {
+        uint64_t blocks;            // handed to the writer thread
+        uint64_t stalls;            // hand-offs that had to wait for the disk to catch up
+        int64_t stalledNs;          // ditto, in total
+        std::size_t maxQueuedBytes; // the furthest the disk fell behind
+        bool writeFailed;           // the log ends at the last block written before a write failed
+        uint64_t droppedBlocks;     // handed over but never written because of it
+    };
+
+    // what the writer thread has put on disk, only complete once the writer is destroyed
+    struct DiskStats {
+        uint64_t rawBytes;
+        uint64_t storedBytes; // block payloads after compression
+    };
+
+    struct Options {
+        MessageLogFsync fsync {MessageLogFsync::NEVER};
+        std::chrono::milliseconds fsyncInterval {MESSAGE_LOG_FSYNC_INTERVAL_MS};
+        std::chrono::milliseconds flushInterval {MESSAGE_LOG_FLUSH_INTERVAL_MS};
+        std::size_t blockBytes {MESSAGE_LOG_BLOCK_BYTES};
+        std::size_t maxQueuedBytes {MESSAGE_LOG_MAX_QUEUED_BYTES};
+        bool compressed {true};
+    };
+
+    // a disabled writer opens no file and drops everything, for benchmarking the engine on its own
+    explicit MessageLogWriter(const std::string & applicationName, const bool logging = true)
+        : MessageLogWriter(applicationName, logging, Options {}) {}
+    MessageLogWriter(const std::string & applicationName, const bool logging, const Options &);
+    ~MessageLogWriter();
+    MessageLogWriter(const MessageLogWriter &) = delete;
+    MessageLogWriter & operator=(const MessageLogWriter &) = delete;
+
+    void log(const std::string & msg);
+    // hand over whatever is buffered, without waiting for it to be written
+    void flush();
+    // when the part filled block is due to be handed over, if there is one
+    std::optional<std::chrono::time_point<std::chrono::steady_clock>> flushDeadline() const;
+    // hand over the part filled block if it has been waiting for the flush interval
+    void flushIfDue();
+
+    // where the next record will start in the file
+    uint64_t offset() const { return written; }
+    Stats stats() const;
+    DiskStats diskStats();
+
+private:
+    struct Block {
+        std::vector<char> data;
+        uint32_t records;
+        int64_t firstSequence;
+        int64_t firstTransactTime;
+    };
+
+    void handOver();
+    void writerLoop();
+    bool writeBlock(const Block &);
+    bool writeFooter();
+    bool writeFully(const char *, std::size_t);
+
+    int fd;
+    bool enabled;
+    const Options options;
+    uint64_t written {0};
+    Stats counters {};
+
+    // owned by the logging thread
+    Block active;
+    std::chrono::time_point<std::chrono::steady_clock> activeSince;
+
+    // owned by the writer thread
+    lz::Compressor compressor;
+    std::string compressed;
+    std::vector<logformat::FooterEntry> footer;
+    uint64_t fileOffset {0}; // end of the last whole block on disk
+    uint64_t logicalOffset {0};
+
+    // shared with the writer thread
+    mutable std::mutex mutex;
+    std::condition_variable blockQueued;
+    std::condition_variable blockWritten;
+    std::deque<Block> queued;
+    std::vector<std::vector<char>> spare;
+    std::size_t queuedBytes {0};
+    bool stopping {false};
+    bool failed {false};
+    uint64_t dropped {0};
+    DiskStats disk {};
+
+    std::thread writer;
+};
+
+inline MessageLogWriter::MessageLogWriter(const std::string & applicationName, const bool logging,
+                                          const Options & opts)
+    : fd {-1},
+      enabled {logging},
+      options {opts},
+      active {},
+      activeSince {std::chrono::steady_clock::now()},
+      compressor {},
+      compressed {},
+      footer {} {
+    if (!enabled) {
+        return;
+    }
+    fd = ::open((applicationName + ".bin").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open log file " + applicationName + ".bin");
+    }
+    if (options.compressed) {
+        logformat::FileHeader header {};
+        std::memcpy(header.magic, logformat::FILE_MAGIC, sizeof(header.magic));
+        header.version = logformat::VERSION;
+        if (writeFully(reinterpret_cast<const char *>(&header), sizeof(header))) {
+            fileOffset = sizeof(header);
         }
     }
+    active.data.reserve(options.blockBytes);
+    writer = std::thread {[this] { writerLoop(); }};
+}
 
-    void log(const std::string & msg) {
-        uint32_t len {static_cast<uint32_t>(msg.size())};
-        out.write(reinterpret_cast<const char *>(&len), sizeof(len));
-        out.write(msg.data(), len);
+inline MessageLogWriter::~MessageLogWriter() {
+    if (!enabled) {
+        return;
+    }
+    handOver();
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        stopping = true;
     }
+    blockQueued.notify_one();
+    writer.join();
+    if (failed) {
+        spdlog::error("Message log ends at byte {} after a failed write, {} blocks dropped", fileOffset, dropped);
+    }
+    if (options.fsync != MessageLogFsync::NEVER) {
+        ::fdatasync(fd);
+    }
+    ::close(fd);
+}
 
-private:
-    std::ofstream out;
-};
\ No newline at end of file
+inline void MessageLogWriter::log(const std::string & msg) {
+    if (!enabled) {
+        return;
+    }
+    if (active.records++ == 0) {
+        const protocol::Header hdr {protocol::peekHeader(msg)};
+        active.firstSequence = hdr.sequence;
+        active.firstTransactTime = hdr.transactTime;
+    }
+    const uint32_t len {static_cast<uint32_t>(msg.size())};
+    const auto * prefix {reinterpret_cast<const char *>(&len)};
+    active.data.insert(active.data.end(), prefix, prefix + sizeof(len));
+    active.data.insert(active.data.end(), msg.begin(), msg.end());
+    written += sizeof(len) + len;
+    if (active.data.size() >= options.blockBytes ||
+        std::chrono::steady_clock::now() - activeSince >= options.flushInterval) {
+        handOver();
+    }
+}
+
+inline void MessageLogWriter::flush() {
+    if (enabled) {
+        handOver();
+    }
+}
+
+inline std::optional<std::chrono::time_point<std::chrono::steady_clock>> MessageLogWriter::flushDeadline() const {
+    if (!enabled || active.data.empty()) {
+        return std::nullopt;
+    }
+    return activeSince + options.flushInterval;
+}
+
+inline void MessageLogWriter::flushIfDue() {
+    if (enabled && std::chrono::steady_clock::now() - activeSince >= options.flushInterval) {
+        handOver();
+    }
+}
+
+inline void MessageLogWriter::handOver() {
+    activeSince = std::chrono::steady_clock::now();
+    if (active.data.empty()) {
+        return;
+    }
+    const std::size_t size {active.data.size()};
+    std::unique_lock<std::mutex> lock {mutex};
+    if (queuedBytes + size > options.maxQueuedBytes && !queued.empty()) {
+        const std::chrono::time_point<std::chrono::steady_clock> start {std::chrono::steady_clock::now()};
+        blockWritten.wait(lock,
+                          [this, size] { return queuedBytes + size <= options.maxQueuedBytes || queued.empty(); });
+        counters.stalls++;
+        counters.stalledNs +=
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    queuedBytes += size;
+    counters.maxQueuedBytes = std::max(counters.maxQueuedBytes, queuedBytes);
+    counters.blocks++;
+    queued.push_back(std::move(active));
+    active = {};
+    if (spare.empty()) {
+        active.data.reserve(options.blockBytes);
+    } else {
+        active.data = std::move(spare.back());
+        spare.pop_back();
+    }
+    lock.unlock();
+    blockQueued.notify_one();
+}
+
+inline MessageLogWriter::Stats MessageLogWriter::stats() const {
+    Stats result {counters};
+    std::lock_guard<std::mutex> lock {mutex};
+    result.writeFailed = failed;
+    result.droppedBlocks = dropped;
+    return result;
+}
+
+inline MessageLogWriter::DiskStats MessageLogWriter::diskStats() {
+    std::lock_guard<std::mutex> lock {mutex};
+    return disk;
+}
+
+inline void MessageLogWriter::writerLoop() {
+    std::chrono::time_point<std::chrono::steady_clock> lastSync {std::chrono::steady_clock::now()};
+    std::unique_lock<std::mutex> lock {mutex};
+    while (true) {
+        blockQueued.wait(lock, [this] { return stopping || !queued.empty(); });
+        if (queued.empty()) {
+            break; // stopping, and every block has been written
+        }
+        Block block {std::move(queued.front())};
+        queued.pop_front();
+        const bool writing {!failed};
+        lock.unlock();
+
+        if (writing && writeBlock(block)) {
+            const std::chrono::time_point<std::chrono::steady_clock> now {std::chrono::steady_clock::now()};
+            if (options.fsync == MessageLogFsync::EVERY_BLOCK ||
+                (options.fsync == MessageLogFsync::INTERVAL && now - lastSync >= options.fsyncInterval)) {
+                ::fdatasync(fd);
+                lastSync = now;
+            }
+        }
+
+        lock.lock();
+        if (failed) {
+            dropped++;
+        }
+        queuedBytes -= block.data.size();
+        block.data.clear();
+        spare.push_back(std::move(block.data));
+        blockWritten.notify_one();
+    }
+    // a footer would index blocks that aren't there, so a failed log is left for the reader to scan
+    const bool footed {options.compressed && !failed};
+    lock.unlock();
+    if (footed) {
+        writeFooter();
+    }
+}
+
+inline bool MessageLogWriter::writeBlock(const Block & block) {
+    const std::string_view raw {block.data.data(), block.data.size()};
+    if (!options.compressed) {
+        if (!writeFully(raw.data(), raw.size())) {
+            return false;
+        }
+        fileOffset += raw.size();
+        std::lock_guard<std::mutex> lock {mutex};
+        disk.rawBytes += raw.size();
+        disk.storedBytes += raw.size();
+        return true;
+    }
+    compressor.compress(raw, compressed);
+    const bool pays {compressed.size() < raw.size()};
+    const std::string_view payload {pays ? std::string_view {compressed} : raw};
+
+    logformat::BlockHeader header {};
+    header.magic = logformat::BLOCK_MAGIC;
+    header.codec = pays ? logformat::Codec::LZ : logformat::Codec::RAW;
+    header.storedSize = static_cast<uint32_t>(payload.size());
+    header.rawSize = static_cast<uint32_t>(raw.size());
+    header.records = block.records;
+    header.firstSequence = block.firstSequence;
+    header.firstTransactTime = block.firstTransactTime;
+    if (!writeFully(reinterpret_cast<const char *>(&header), sizeof(header)) ||
+        !writeFully(payload.data(), payload.size())) {
+        return false;
+    }
+    footer.push_back({fileOffset, logicalOffset, block.firstSequence, block.firstTransactTime});
+    fileOffset += sizeof(header) + payload.size();
+    logicalOffset += raw.size();
+    std::lock_guard<std::mutex> lock {mutex};
+    disk.rawBytes += raw.size();
+    disk.storedBytes += payload.size();
+    return true;
+}
+
+inline bool MessageLogWriter::writeFooter() {
+    logformat::Trailer trailer {fileOffset, footer.size(), {}};
+    std::memcpy(trailer.magic, logformat::TRAILER_MAGIC, sizeof(trailer.magic));
+    return writeFully(reinterpret_cast<const char *>(footer.data()), footer.size() * sizeof(logformat::FooterEntry)) &&
+           writeFully(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+}
+
+// on failure the file is cut back to fileOffset and nothing more is written to it
+inline bool MessageLogWriter::writeFully(const char * data, const std::size_t size) {
+    std::size_t done {0};
+    while (done < size) {
+        const ssize_t n {::write(fd, data + done, size - done)};
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            const int error {errno};
+            spdlog::error("Message log write failed, keeping the first {} bytes: {}", fileOffset,
+                          std::strerror(error));
+            if (::ftruncate(fd, static_cast<off_t>(fileOffset)) != 0) {
+                spdlog::error("Message log truncate failed, a reader will stop at the short block: {}",
+                              std::strerror(errno));
+            }
+            std::lock_guard<std::mutex> lock {mutex};
+            failed = true;
+            return false;
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "common/Schema.h"
+
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -7,6 +9,7 @@
 #include <spdlog/fmt/fmt.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -22,17 +25,50 @@ namespace protocol {
         CLIENT_DISCONNECT = 2, // end of contact between client and server
         SERVER_WELCOME = 3,    // server acknowledgement of client join
         CLIENT_INPUT = 4,      // client input of actions to server
-        GAME_STATE = 5         // server broadcast of game state out to clients
+        GAME_STATE = 5,        // server broadcast of game state out to clients
+        GAME_STATE_DELTA = 6,  // server broadcast of game state changes since a previous game state
+        CLIENT_ROOM_REQUEST = 7, // client to server before joining, asks for a particular room
+        LEADERBOARD = 8,         // server broadcast of the top scores, when clients only see part of the arena
+        ENGINE_CHECKPOINT = 9,   // message log only, the full engine state so a replay can start part way through
+        STATE_HASH = 10,         // message log only, stands in for a GAME_STATE when just the inputs are logged
+        GAME_STATE_COMPACT = 11  // server to client, a GAME_STATE in the compact encoding (CompactGameState.h)
+    };
+
+    // A keyframe replaces whatever state the client had, in whichever encoding it was sent
+    inline bool isKeyframe(const MessageType type) {
+        return type == MessageType::GAME_STATE || type == MessageType::GAME_STATE_COMPACT;
+    }
+
+    // How keyframes are encoded for a client. FULL is the GAME_STATE every client and the message
+    // log understand, the others have to be offered in the CLIENT_JOIN and taken up in the SERVER_WELCOME
+    enum class StateEncoding : uint8_t {
+        FULL = 0,
+        COMPACT = 1
     };
 
+    constexpr uint8_t encodingBit(const StateEncoding encoding) {
+        return static_cast<uint8_t>(1u << static_cast<uint8_t>(encoding));
+    }
+
     struct ServerConfig;
     struct ClientInput;
     struct ClientDisconnect;
     struct ServerWelcome;
     struct ClientJoin;
     struct GameState;
-    using MessageVariant =
-        std::variant<ServerConfig, ClientInput, ClientDisconnect, ServerWelcome, ClientJoin, GameState>;
+    struct GameStateDelta;
+    struct ClientRoomRequest;
+    struct Leaderboard;
+    struct EngineCheckpoint;
+    struct StateHash;
+    using MessageVariant = std::variant<ServerConfig, ClientInput, ClientDisconnect, ServerWelcome, ClientJoin,
+                                        GameState, GameStateDelta, ClientRoomRequest, Leaderboard, EngineCheckpoint,
+                                        StateHash>;
+
+    // The wire layout of T, a schema::Fields of its fields in the order they are packed. The packed
+    // sizes below, serialiseInto and deserialise all come from these
+    template <typename T>
+    struct Schema;
 
     struct Header {
         MessageType messageType;
@@ -40,13 +76,14 @@ namespace protocol {
         int64_t sequence {-1};
         int64_t transactTime {-1};
     };
-    static_assert(offsetof(Header, messageType) == 0);
-    static_assert(offsetof(Header, clientId) == 4);
-    static_assert(offsetof(Header, sequence) == 8);
-    static_assert(offsetof(Header, transactTime) == 16);
-    static_assert(sizeof(Header) == 24);
-    constexpr size_t HEADER_PACKED_SIZE {sizeof(Header::messageType) + sizeof(Header::clientId) +
-                                         sizeof(Header::sequence) + sizeof(Header::transactTime)};
+    template <>
+    struct Schema<Header>
+        : schema::Fields<PROTOCOL_FIELD(Header, messageType), PROTOCOL_FIELD(Header, clientId),
+                         PROTOCOL_FIELD(Header, sequence), PROTOCOL_FIELD(Header, transactTime)> {};
+    // laid out as it is packed, so each message can pack its hdr as one field and a header can be
+    // peeked with one copy
+    static_assert(Schema<Header>::isDenseFor<Header>);
+    constexpr size_t HEADER_PACKED_SIZE {Schema<Header>::fixedSize};
 
     struct ServerConfig {
         Header hdr;
@@ -61,52 +98,80 @@ namespace protocol {
         int64_t boostedMovementFrequencyMs;
         int64_t boostDurationMs;
     };
-    static_assert(alignof(Header) == 8);
-    static_assert(offsetof(ServerConfig, width) == 24);
-    static_assert(offsetof(ServerConfig, height) == 28);
-    static_assert(offsetof(ServerConfig, seed) == 32);
-    static_assert(offsetof(ServerConfig, minFoodInArena) == 36);
-    static_assert(offsetof(ServerConfig, foodSpawnFromBodySegmentProbability) == 40);
-    static_assert(offsetof(ServerConfig, speedBoostProbability) == 44);
-    static_assert(offsetof(ServerConfig, speedBoostRatio) == 48);
-    static_assert(offsetof(ServerConfig, movementFrequencyMs) == 56);
-    static_assert(offsetof(ServerConfig, boostedMovementFrequencyMs) == 64);
-    static_assert(offsetof(ServerConfig, boostDurationMs) == 72);
-    static_assert(sizeof(ServerConfig) == 80);
-    constexpr size_t SERVER_CONFIG_PACKED_SIZE {
-        HEADER_PACKED_SIZE + sizeof(ServerConfig::width) + sizeof(ServerConfig::height) + sizeof(ServerConfig::seed) +
-        sizeof(ServerConfig::minFoodInArena) + sizeof(ServerConfig::foodSpawnFromBodySegmentProbability) +
-        sizeof(ServerConfig::speedBoostProbability) + sizeof(ServerConfig::speedBoostRatio) +
-        sizeof(ServerConfig::movementFrequencyMs) + sizeof(ServerConfig::boostedMovementFrequencyMs) +
-        sizeof(ServerConfig::boostDurationMs)};
+    template <>
+    struct Schema<ServerConfig>
+        : schema::Fields<PROTOCOL_FIELD(ServerConfig, hdr), PROTOCOL_FIELD(ServerConfig, width),
+                         PROTOCOL_FIELD(ServerConfig, height), PROTOCOL_FIELD(ServerConfig, seed),
+                         PROTOCOL_FIELD(ServerConfig, minFoodInArena),
+                         PROTOCOL_FIELD(ServerConfig, foodSpawnFromBodySegmentProbability),
+                         PROTOCOL_FIELD(ServerConfig, speedBoostProbability),
+                         PROTOCOL_FIELD(ServerConfig, speedBoostRatio),
+                         PROTOCOL_FIELD(ServerConfig, movementFrequencyMs),
+                         PROTOCOL_FIELD(ServerConfig, boostedMovementFrequencyMs),
+                         PROTOCOL_FIELD(ServerConfig, boostDurationMs)> {};
+    constexpr size_t SERVER_CONFIG_PACKED_SIZE {Schema<ServerConfig>::fixedSize};
 
     struct ClientInput {
         Header hdr;
         char input;
     };
-    static_assert(offsetof(ClientInput, input) == 24);
-    static_assert(sizeof(ClientInput) == 32);
-    constexpr size_t CLIENT_INPUT_PACKED_SIZE {HEADER_PACKED_SIZE + sizeof(ClientInput::input)};
+    template <>
+    struct Schema<ClientInput>
+        : schema::Fields<PROTOCOL_FIELD(ClientInput, hdr), PROTOCOL_FIELD(ClientInput, input)> {};
+    constexpr size_t CLIENT_INPUT_PACKED_SIZE {Schema<ClientInput>::fixedSize};
 
     struct ClientDisconnect {
         Header hdr;
     };
-    static_assert(sizeof(ClientDisconnect) == 24);
-    constexpr size_t CLIENT_DISCONNECT_PACKED_SIZE {HEADER_PACKED_SIZE};
+    template <>
+    struct Schema<ClientDisconnect> : schema::Fields<PROTOCOL_FIELD(ClientDisconnect, hdr)> {};
+    constexpr size_t CLIENT_DISCONNECT_PACKED_SIZE {Schema<ClientDisconnect>::fixedSize};
 
+    // stateEncoding is only written when it isn't FULL, so older clients get the welcome they expect
     struct ServerWelcome {
         Header hdr;
+        StateEncoding stateEncoding;
     };
-    static_assert(sizeof(ServerWelcome) == 24);
-    constexpr size_t SERVER_WELCOME_PACKED_SIZE {HEADER_PACKED_SIZE};
-
+    template <>
+    struct Schema<ServerWelcome>
+        : schema::Fields<PROTOCOL_FIELD(ServerWelcome, hdr),
+                         schema::Trailing<PROTOCOL_FIELD(ServerWelcome, stateEncoding)>> {};
+    static_assert(StateEncoding::FULL == StateEncoding {}); // the value a Trailing field leaves out
+    constexpr size_t SERVER_WELCOME_PACKED_SIZE {Schema<ServerWelcome>::fixedSize};
+    constexpr size_t SERVER_WELCOME_WITH_ENCODING_PACKED_SIZE {Schema<ServerWelcome>::maxFixedSize};
+
+    // stateEncodings has the encodingBit of each encoding the client can read besides FULL. It is
+    // only written when there are any, so joins from older clients and in older recordings still parse
     struct ClientJoin {
         Header hdr;
         char username[16];
+        uint8_t stateEncodings;
+    };
+    template <>
+    struct Schema<ClientJoin>
+        : schema::Fields<PROTOCOL_FIELD(ClientJoin, hdr), PROTOCOL_FIELD(ClientJoin, username),
+                         schema::Trailing<PROTOCOL_FIELD(ClientJoin, stateEncodings)>> {};
+    constexpr size_t CLIENT_JOIN_PACKED_SIZE {Schema<ClientJoin>::fixedSize};
+    constexpr size_t CLIENT_JOIN_WITH_ENCODINGS_PACKED_SIZE {Schema<ClientJoin>::maxFixedSize};
+
+    struct ClientRoomRequest {
+        Header hdr;
+        int32_t roomId;
     };
-    static_assert(offsetof(ClientJoin, username) == 24);
-    static_assert(sizeof(ClientJoin) == 40);
-    constexpr size_t CLIENT_JOIN_PACKED_SIZE {HEADER_PACKED_SIZE + sizeof(ClientJoin::username)};
+    template <>
+    struct Schema<ClientRoomRequest>
+        : schema::Fields<PROTOCOL_FIELD(ClientRoomRequest, hdr), PROTOCOL_FIELD(ClientRoomRequest, roomId)> {};
+    constexpr size_t CLIENT_ROOM_REQUEST_PACKED_SIZE {Schema<ClientRoomRequest>::fixedSize};
+
+    // The header of the GAME_STATE it replaces, so a replay still ticks at the recorded times, and
+    // a hash of the engine state that tick ended in (SnakeServer::engineHash)
+    struct StateHash {
+        Header hdr;
+        uint64_t hash;
+    };
+    template <>
+    struct Schema<StateHash> : schema::Fields<PROTOCOL_FIELD(StateHash, hdr), PROTOCOL_FIELD(StateHash, hash)> {};
+    constexpr size_t STATE_HASH_PACKED_SIZE {Schema<StateHash>::fixedSize};
 
     struct GameState {
         struct Food {
@@ -135,20 +200,146 @@ namespace protocol {
         std::vector<Food> speedBoosts;
         std::vector<Player> players;
     };
-    static_assert(alignof(Header) == 8);
-    static_assert(offsetof(GameState, highScore) == 24);
-    static_assert(offsetof(GameState, highScoreUsername) == 28);
-    static_assert(offsetof(GameState, food) == 48);
-    static_assert(alignof(GameState::Food) == 4);
-    static_assert(sizeof(GameState::SpeedBoost) == 16);
-    static_assert(alignof(GameState::Player) == 8);
-    static_assert(sizeof(GameState::Player::Segment) == 8);
-    static_assert(offsetof(GameState::Player, clientId) == 0);
-    static_assert(offsetof(GameState::Player, color) == 4);
-    static_assert(offsetof(GameState::Player, direction) == 8);
-    static_assert(offsetof(GameState::Player, score) == 12);
-    static_assert(offsetof(GameState::Player, username) == 16);
-    static_assert(offsetof(GameState::Player, segments) == 32);
+    template <>
+    struct Schema<GameState::Player::Segment>
+        : schema::Fields<PROTOCOL_FIELD(GameState::Player::Segment, first),
+                         PROTOCOL_FIELD(GameState::Player::Segment, second)> {};
+    template <>
+    struct Schema<GameState::Food>
+        : schema::Fields<PROTOCOL_FIELD(GameState::Food, color), PROTOCOL_FIELD(GameState::Food, icon),
+                         PROTOCOL_FIELD(GameState::Food, x), PROTOCOL_FIELD(GameState::Food, y)> {};
+    template <>
+    struct Schema<GameState::Player>
+        : schema::Fields<PROTOCOL_FIELD(GameState::Player, clientId), PROTOCOL_FIELD(GameState::Player, color),
+                         PROTOCOL_FIELD(GameState::Player, direction), PROTOCOL_FIELD(GameState::Player, score),
+                         PROTOCOL_FIELD(GameState::Player, username),
+                         schema::List<&GameState::Player::segments, Schema<GameState::Player::Segment>>> {};
+    template <>
+    struct Schema<GameState>
+        : schema::Fields<PROTOCOL_FIELD(GameState, hdr), PROTOCOL_FIELD(GameState, highScore),
+                         PROTOCOL_FIELD(GameState, highScoreUsername),
+                         schema::List<&GameState::food, Schema<GameState::Food>>,
+                         schema::List<&GameState::speedBoosts, Schema<GameState::SpeedBoost>>,
+                         schema::List<&GameState::players, Schema<GameState::Player>>> {};
+
+    // Changes between the game state with sequence baseSequence and this one. Removals are
+    // applied before additions, so an item replaced in the same cell is a removal plus an add.
+    // A joined player replaces any existing player with the same clientId
+    struct GameStateDelta {
+        using Cell = GameState::Player::Segment;
+
+        struct PlayerUpdate {
+            int32_t clientId;
+            char direction;
+            int32_t score;
+            uint32_t tailTrim;             // segments dropped from the tail
+            std::vector<Cell> headAdvance; // segments pushed onto the head, head first
+        };
+
+        Header hdr;
+        int64_t baseSequence;
+        int32_t highScore;
+        char highScoreUsername[16];
+        std::vector<Cell> foodRemoved;
+        std::vector<GameState::Food> foodAdded;
+        std::vector<Cell> speedBoostsRemoved;
+        std::vector<GameState::SpeedBoost> speedBoostsAdded;
+        std::vector<int32_t> playersRemoved;
+        std::vector<GameState::Player> playersJoined;
+        std::vector<PlayerUpdate> playersUpdated;
+    };
+    template <>
+    struct Schema<GameStateDelta::PlayerUpdate>
+        : schema::Fields<PROTOCOL_FIELD(GameStateDelta::PlayerUpdate, clientId),
+                         PROTOCOL_FIELD(GameStateDelta::PlayerUpdate, direction),
+                         PROTOCOL_FIELD(GameStateDelta::PlayerUpdate, score),
+                         PROTOCOL_FIELD(GameStateDelta::PlayerUpdate, tailTrim),
+                         schema::List<&GameStateDelta::PlayerUpdate::headAdvance, Schema<GameStateDelta::Cell>>> {};
+    template <>
+    struct Schema<GameStateDelta>
+        : schema::Fields<PROTOCOL_FIELD(GameStateDelta, hdr), PROTOCOL_FIELD(GameStateDelta, baseSequence),
+                         PROTOCOL_FIELD(GameStateDelta, highScore), PROTOCOL_FIELD(GameStateDelta, highScoreUsername),
+                         schema::List<&GameStateDelta::foodRemoved, Schema<GameStateDelta::Cell>>,
+                         schema::List<&GameStateDelta::foodAdded, Schema<GameState::Food>>,
+                         schema::List<&GameStateDelta::speedBoostsRemoved, Schema<GameStateDelta::Cell>>,
+                         schema::List<&GameStateDelta::speedBoostsAdded, Schema<GameState::SpeedBoost>>,
+                         schema::List<&GameStateDelta::playersRemoved, schema::Scalar<int32_t>>,
+                         schema::List<&GameStateDelta::playersJoined, Schema<GameState::Player>>,
+                         schema::List<&GameStateDelta::playersUpdated, Schema<GameStateDelta::PlayerUpdate>>> {};
+
+    // Highest scoring players across the whole arena, best first
+    struct Leaderboard {
+        struct Entry {
+            int32_t clientId;
+            int32_t color;
+            int32_t score;
+            char username[16];
+        };
+
+        Header hdr;
+        std::vector<Entry> entries;
+    };
+    template <>
+    struct Schema<Leaderboard::Entry>
+        : schema::Fields<PROTOCOL_FIELD(Leaderboard::Entry, clientId), PROTOCOL_FIELD(Leaderboard::Entry, color),
+                         PROTOCOL_FIELD(Leaderboard::Entry, score), PROTOCOL_FIELD(Leaderboard::Entry, username)> {};
+    template <>
+    struct Schema<Leaderboard>
+        : schema::Fields<PROTOCOL_FIELD(Leaderboard, hdr),
+                         schema::List<&Leaderboard::entries, Schema<Leaderboard::Entry>>> {};
+
+    // Everything the engine carries from one tick to the next. Players are listed in the order the
+    // engine iterates them, and playerBuckets is the bucket count of its player map, so that order
+    // can be rebuilt exactly. rng is the generator state as written by operator<<
+    struct EngineCheckpoint {
+        struct Player {
+            int32_t clientId;
+            int32_t color;
+            char direction;
+            char nextDirection;
+            int32_t score;
+            char username[16];
+            int64_t movementFrequencyMs;
+            int64_t nextMoveTime;
+            uint8_t boosted;
+            int64_t boostExpireTime;
+            GameState::Player::Segment vacated; // where the tail was before the last move, for growing
+            std::vector<GameState::Player::Segment> segments;
+        };
+
+        Header hdr;
+        int32_t highScore;
+        char highScoreUsername[16];
+        uint64_t playerBuckets;
+        Bytes rng;
+        std::vector<GameState::Food> food;
+        std::vector<GameState::SpeedBoost> speedBoosts;
+        std::vector<Player> players;
+    };
+    template <>
+    struct Schema<EngineCheckpoint::Player>
+        : schema::Fields<PROTOCOL_FIELD(EngineCheckpoint::Player, clientId),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, color),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, direction),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, nextDirection),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, score),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, username),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, movementFrequencyMs),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, nextMoveTime),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, boosted),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, boostExpireTime),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, vacated.first),
+                         PROTOCOL_FIELD(EngineCheckpoint::Player, vacated.second),
+                         schema::List<&EngineCheckpoint::Player::segments, Schema<GameState::Player::Segment>>> {};
+    template <>
+    struct Schema<EngineCheckpoint>
+        : schema::Fields<PROTOCOL_FIELD(EngineCheckpoint, hdr), PROTOCOL_FIELD(EngineCheckpoint, highScore),
+                         PROTOCOL_FIELD(EngineCheckpoint, highScoreUsername),
+                         PROTOCOL_FIELD(EngineCheckpoint, playerBuckets),
+                         schema::List<&EngineCheckpoint::rng, schema::Scalar<char>>,
+                         schema::List<&EngineCheckpoint::food, Schema<GameState::Food>>,
+                         schema::List<&EngineCheckpoint::speedBoosts, Schema<GameState::SpeedBoost>>,
+                         schema::List<&EngineCheckpoint::players, Schema<EngineCheckpoint::Player>>> {};
 
     inline Header & header(MessageVariant & msg) {
         return std::visit([](auto & m) -> Header & {return m.hdr;}, msg);
@@ -177,235 +368,144 @@ namespace protocol {
         dest += sizeof(source);
     }
 
-    // use append for dynamically sized messages (destination buffer grows dynamically)
-    template <typename T>
-    inline void appendRawBytes(const T & source, Bytes & dest) {
-        static_assert(std::is_trivially_copyable_v<T>);
-        size_t old {dest.size()};
-        dest.resize(old + sizeof(source));
-        std::memcpy(dest.data() + old, &source, sizeof(source));
+    // packed sizes of the parts of the variable length messages
+    constexpr size_t COUNT_PACKED_SIZE {schema::COUNT_SIZE};
+    constexpr size_t CELL_PACKED_SIZE {Schema<GameState::Player::Segment>::fixedSize};
+    constexpr size_t FOOD_PACKED_SIZE {Schema<GameState::Food>::fixedSize};
+    constexpr size_t PLAYER_PACKED_SIZE {Schema<GameState::Player>::fixedSize}; // before its cells
+    constexpr size_t PLAYER_UPDATE_PACKED_SIZE {Schema<GameStateDelta::PlayerUpdate>::fixedSize};
+    constexpr size_t LEADERBOARD_ENTRY_PACKED_SIZE {Schema<Leaderboard::Entry>::fixedSize};
+    constexpr size_t CHECKPOINT_PLAYER_PACKED_SIZE {Schema<EngineCheckpoint::Player>::fixedSize}; // before its cells
+
+    // The most a GAME_STATE of a width x height arena can pack to, with a food, a speed boost and a
+    // one cell snake in every cell. Its compact encoding and the deltas between states are smaller
+    inline size_t maxGameStateSize(const int32_t width, const int32_t height) {
+        const size_t cells {static_cast<size_t>(width) * static_cast<size_t>(height)};
+        return Schema<GameState>::fixedSize + 3 * COUNT_PACKED_SIZE +
+               cells * (2 * FOOD_PACKED_SIZE + PLAYER_PACKED_SIZE + COUNT_PACKED_SIZE + CELL_PACKED_SIZE);
+    }
+
+    inline void writeCount(const size_t count, char *& raw) {
+        writeRawBytes(static_cast<uint32_t>(count), raw);
+    }
+
+    inline void writeHeader(const Header & msg, char *& raw) {
+        raw = Schema<Header>::write(msg, raw);
     }
 
     inline Bytes serialiseHeader(const Header & msg) {
         Bytes buf;
         buf.resize(HEADER_PACKED_SIZE);
         char * raw = buf.data();
-        writeRawBytes(msg.messageType, raw);
-        writeRawBytes(msg.clientId, raw);
-        writeRawBytes(msg.sequence, raw);
-        writeRawBytes(msg.transactTime, raw);
+        writeHeader(msg, raw);
         return buf;
     }
 
-    inline Header deserialiseHeader(const Bytes & buf) {
-        const char * raw = buf.data();
-        const char * end = buf.data() + buf.size();
+    inline Header deserialiseHeader(const std::string_view buf) {
         Header msg;
-        readRawBytes(raw, msg.messageType, end);
-        readRawBytes(raw, msg.clientId, end);
-        readRawBytes(raw, msg.sequence, end);
-        readRawBytes(raw, msg.transactTime, end);
+        Schema<Header>::read(msg, buf.data(), buf.data() + buf.size());
         return msg;
     }
 
+    // The header read straight from a frame, for routing or filtering frames that may never be
+    // deserialised. Header is laid out as it is packed, so this is one copy rather than four
+    inline Header peekHeader(const std::string_view frame) {
+        if (frame.size() < HEADER_PACKED_SIZE) {
+            throw std::runtime_error("peekHeader: truncated frame");
+        }
+        Header hdr;
+        std::memcpy(&hdr, frame.data(), HEADER_PACKED_SIZE);
+        return hdr;
+    }
+
+    // Just the type, for picking how to read the frame. Cheaper than the whole header when the
+    // frame is read straight after, as the compiler needn't keep a copy of the header around
+    inline MessageType peekMessageType(const std::string_view frame) {
+        if (frame.size() < HEADER_PACKED_SIZE) {
+            throw std::runtime_error("peekMessageType: truncated frame");
+        }
+        MessageType type;
+        std::memcpy(&type, frame.data() + offsetof(Header, messageType), sizeof(type));
+        return type;
+    }
+
+    // the exact size serialise will produce, so a buffer can be sized once up front
     template <typename T>
-    inline Bytes serialise(const T & msg) {
-        Bytes buf {serialiseHeader(msg.hdr)};
-        if constexpr (std::is_same_v<T, ClientJoin>) {
-            buf.resize(CLIENT_JOIN_PACKED_SIZE);
-            char * raw = buf.data() + HEADER_PACKED_SIZE;
-            writeRawBytes(msg.username, raw);
-            return buf;
-        } else if constexpr (std::is_same_v<T, ClientDisconnect>) {
-            return buf;
-        } else if constexpr (std::is_same_v<T, ServerWelcome>) {
-            return buf;
-        } else if constexpr (std::is_same_v<T, ClientInput>) {
-            buf.resize(CLIENT_INPUT_PACKED_SIZE);
-            char * raw = buf.data() + HEADER_PACKED_SIZE;
-            writeRawBytes(msg.input, raw);
-            return buf;
-        } else if constexpr (std::is_same_v<T, ServerConfig>) {
-            buf.resize(SERVER_CONFIG_PACKED_SIZE);
-            char * raw = buf.data() + HEADER_PACKED_SIZE;
-            writeRawBytes(msg.width, raw);
-            writeRawBytes(msg.height, raw);
-            writeRawBytes(msg.seed, raw);
-            writeRawBytes(msg.minFoodInArena, raw);
-            writeRawBytes(msg.foodSpawnFromBodySegmentProbability, raw);
-            writeRawBytes(msg.speedBoostProbability, raw);
-            writeRawBytes(msg.speedBoostRatio, raw);
-            writeRawBytes(msg.movementFrequencyMs, raw);
-            writeRawBytes(msg.boostedMovementFrequencyMs, raw);
-            writeRawBytes(msg.boostDurationMs, raw);
-            return buf;
-        } else if constexpr (std::is_same_v<T, GameState>) {
-            appendRawBytes(msg.highScore, buf);
-            appendRawBytes(msg.highScoreUsername, buf);
-
-            uint32_t foodCount {static_cast<uint32_t>(msg.food.size())};
-            appendRawBytes(foodCount, buf);
-            for (auto & f : msg.food) {
-                appendRawBytes(f.color, buf);
-                appendRawBytes(f.icon, buf);
-                appendRawBytes(f.x, buf);
-                appendRawBytes(f.y, buf);
-            }
+    inline size_t encodedSize(const T & msg) {
+        return Schema<T>::packedSize(msg);
+    }
 
-            uint32_t speedBoostCount {static_cast<uint32_t>(msg.speedBoosts.size())};
-            appendRawBytes(speedBoostCount, buf);
-            for (auto & sb : msg.speedBoosts) {
-                appendRawBytes(sb.color, buf);
-                appendRawBytes(sb.icon, buf);
-                appendRawBytes(sb.x, buf);
-                appendRawBytes(sb.y, buf);
-            }
+    // Replaces the contents of buf with the serialised message. buf is sized once, so a buffer
+    // kept from one call to the next only allocates when a message outgrows every earlier one
+    template <typename T>
+    inline void serialiseInto(const T & msg, Bytes & buf) {
+        buf.resize(encodedSize(msg));
+        char * raw = buf.data();
+        raw = Schema<T>::write(msg, raw);
+        assert(raw == buf.data() + buf.size() && "serialiseInto: encodedSize disagrees with the writer");
+    }
 
-            uint32_t playerCount {static_cast<uint32_t>(msg.players.size())};
-            uint32_t segmentCount;
-            appendRawBytes(playerCount, buf);
-            for (auto & p : msg.players) {
-                appendRawBytes(p.clientId, buf);
-                appendRawBytes(p.color, buf);
-                appendRawBytes(p.direction, buf);
-                appendRawBytes(p.score, buf);
-                appendRawBytes(p.username, buf);
-                segmentCount = static_cast<uint32_t>(p.segments.size());
-                appendRawBytes(segmentCount, buf);
-                for (auto & s : p.segments) {
-                    appendRawBytes(s.first, buf);
-                    appendRawBytes(s.second, buf);
-                }
-            }
+    inline void serialiseInto(const MessageVariant & msg, Bytes & buf) {
+        std::visit([&buf](const auto & m) { serialiseInto(m, buf); }, msg);
+    }
 
-            return buf;
-        } else {
-            throw std::runtime_error("Invalid MessageType");
-        }
+    template <typename T>
+    inline Bytes serialise(const T & msg) {
+        Bytes buf;
+        serialiseInto(msg, buf);
+        return buf;
     }
 
     inline Bytes serialise(const MessageVariant & msg) {
         return std::visit([](const auto & m) -> Bytes {return serialise(m);}, msg);
     }
 
-    inline MessageVariant deserialise(const Bytes & buf) {
-        Header hdr;
-        hdr = deserialiseHeader(buf);
-        const char * raw = buf.data() + HEADER_PACKED_SIZE;
-        const char * end = buf.data() + buf.size();
-
-        switch (hdr.messageType) {
-        case MessageType::CLIENT_JOIN: {
-            if (buf.size() != CLIENT_JOIN_PACKED_SIZE) {
-                throw std::runtime_error(fmt::format("ClientJoin unexpected buffer size {}, expected {}", buf.size(), CLIENT_JOIN_PACKED_SIZE));
-            }
-            ClientJoin msg;
-            msg.hdr = hdr;
-            readRawBytes(raw, msg.username, end);
-            return msg;
-        }
-        case MessageType::CLIENT_DISCONNECT: {
-            if (buf.size() != CLIENT_DISCONNECT_PACKED_SIZE) {
-                throw std::runtime_error(fmt::format("Client Disconnect unexpected buffer size {}, expected {}", buf.size(), CLIENT_DISCONNECT_PACKED_SIZE));
-            }
-            ClientDisconnect msg;
-            msg.hdr = hdr;
-            return msg;
-        }
-        case MessageType::SERVER_WELCOME: {
-            if (buf.size() != SERVER_WELCOME_PACKED_SIZE) {
-                throw std::runtime_error(fmt::format("ServerWelcome unexpected buffer size {}, expected {}", buf.size(), SERVER_WELCOME_PACKED_SIZE));
-            }
-            ServerWelcome msg;
-            msg.hdr = hdr;
-            return msg;
-        }
-        case MessageType::CLIENT_INPUT: {
-            if (buf.size() != CLIENT_INPUT_PACKED_SIZE) {
-                throw std::runtime_error(fmt::format("ClientInput unexpected buffer size {}, expected {}", buf.size(), CLIENT_INPUT_PACKED_SIZE));
-            }
-            ClientInput msg;
-            msg.hdr = hdr;
-            readRawBytes(raw, msg.input, end);
-            return msg;
-        }
-        case MessageType::SERVER_CONFIG: {
-            if (buf.size() != SERVER_CONFIG_PACKED_SIZE) {
-                throw std::runtime_error(fmt::format("ServerConfig unexpected buffer size {}, expected {}", buf.size(), SERVER_CONFIG_PACKED_SIZE));
+    // A message with no lists has to be one of the sizes its schema allows. Read straight into the
+    // variant, rather than into a T that is then copied in
+    template <typename T>
+    inline MessageVariant deserialiseAs(const std::string_view buf, const char * name) {
+        if constexpr (!Schema<T>::hasLists) {
+            if (buf.size() < Schema<T>::fixedSize || buf.size() > Schema<T>::maxFixedSize) {
+                throw std::runtime_error(
+                    fmt::format("{} unexpected buffer size {}, expected {}", name, buf.size(), Schema<T>::fixedSize));
             }
-            ServerConfig msg;
-            msg.hdr = hdr;
-            readRawBytes(raw, msg.width, end);
-            readRawBytes(raw, msg.height, end);
-            readRawBytes(raw, msg.seed, end);
-            readRawBytes(raw, msg.minFoodInArena, end);
-            readRawBytes(raw, msg.foodSpawnFromBodySegmentProbability, end);
-            readRawBytes(raw, msg.speedBoostProbability, end);
-            readRawBytes(raw, msg.speedBoostRatio, end);
-            readRawBytes(raw, msg.movementFrequencyMs, end);
-            readRawBytes(raw, msg.boostedMovementFrequencyMs, end);
-            readRawBytes(raw, msg.boostDurationMs, end);
-            return msg;
         }
-        case MessageType::GAME_STATE: {
-            GameState msg;
-            msg.hdr = hdr;
-            readRawBytes(raw, msg.highScore, end);
-            readRawBytes(raw, msg.highScoreUsername, end);
-
-            uint32_t foodCount;
-            readRawBytes(raw, foodCount, end);
-            msg.food.reserve(foodCount);
-            for (uint32_t i = 0; i < foodCount; i++) {
-                GameState::Food f;
-                readRawBytes(raw, f.color, end);
-                readRawBytes(raw, f.icon, end);
-                readRawBytes(raw, f.x, end);
-                readRawBytes(raw, f.y, end);
-                msg.food.push_back(f);
-            }
-
-            uint32_t speedBoostCount;
-            readRawBytes(raw, speedBoostCount, end);
-            msg.speedBoosts.reserve(speedBoostCount);
-            for (uint32_t i = 0; i < speedBoostCount; i++) {
-                GameState::SpeedBoost sb;
-                readRawBytes(raw, sb.color, end);
-                readRawBytes(raw, sb.icon, end);
-                readRawBytes(raw, sb.x, end);
-                readRawBytes(raw, sb.y, end);
-                msg.speedBoosts.push_back(sb);
-            }
+        MessageVariant msg {std::in_place_type<T>};
+        Schema<T>::read(*std::get_if<T>(&msg), buf.data(), buf.data() + buf.size());
+        return msg;
+    }
 
-            uint32_t playerCount;
-            uint32_t segmentCount;
-            readRawBytes(raw, playerCount, end);
-            msg.players.reserve(playerCount);
-            for (uint32_t i = 0; i < playerCount; i++) {
-                GameState::Player p;
-                readRawBytes(raw, p.clientId, end);
-                readRawBytes(raw, p.color, end);
-                readRawBytes(raw, p.direction, end);
-                readRawBytes(raw, p.score, end);
-                readRawBytes(raw, p.username, end);
-                readRawBytes(raw, segmentCount, end);
-                p.segments.reserve(segmentCount);
-                for (uint32_t j = 0; j < segmentCount; j++) {
-                    GameState::Player::Segment s;
-                    readRawBytes(raw, s.first, end);
-                    readRawBytes(raw, s.second, end);
-                    p.segments.push_back(s);
-                }
-                msg.players.push_back(std::move(p));
-            }
-            return msg;
-        }
+    // buf may be a view straight into a mapped message log
+    inline MessageVariant deserialise(const std::string_view buf) {
+        switch (peekMessageType(buf)) {
+        case MessageType::CLIENT_JOIN:
+            return deserialiseAs<ClientJoin>(buf, "ClientJoin");
+        case MessageType::CLIENT_DISCONNECT:
+            return deserialiseAs<ClientDisconnect>(buf, "Client Disconnect");
+        case MessageType::SERVER_WELCOME:
+            return deserialiseAs<ServerWelcome>(buf, "ServerWelcome");
+        case MessageType::CLIENT_INPUT:
+            return deserialiseAs<ClientInput>(buf, "ClientInput");
+        case MessageType::CLIENT_ROOM_REQUEST:
+            return deserialiseAs<ClientRoomRequest>(buf, "ClientRoomRequest");
+        case MessageType::STATE_HASH:
+            return deserialiseAs<StateHash>(buf, "StateHash");
+        case MessageType::SERVER_CONFIG:
+            return deserialiseAs<ServerConfig>(buf, "ServerConfig");
+        case MessageType::GAME_STATE:
+            return deserialiseAs<GameState>(buf, "GameState");
+        case MessageType::GAME_STATE_DELTA:
+            return deserialiseAs<GameStateDelta>(buf, "GameStateDelta");
+        case MessageType::LEADERBOARD:
+            return deserialiseAs<Leaderboard>(buf, "Leaderboard");
+        case MessageType::ENGINE_CHECKPOINT:
+            return deserialiseAs<EngineCheckpoint>(buf, "EngineCheckpoint");
         default:
             throw std::runtime_error("Invalid MessageType");
         }
     }
 
-    inline MessageVariant deserialise(const Bytes & buf, const int clientId) {
+    inline MessageVariant deserialise(const std::string_view buf, const int clientId) {
         MessageVariant msg {deserialise(buf)};
         header(msg).clientId = clientId;
         return msg;
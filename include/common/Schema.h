@@ -0,0 +1,300 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Wire layouts declared once, as the list of a struct's fields in the order they are packed, with
+// the packed sizes, writer and reader all generated from it. Fields are packed back to back with
+// no padding. Trivially copyable fields that are also back to back in the struct make up a run,
+// which is copied with one memcpy and, when reading, one bounds check
+
+// a trivially copyable member of STRUCT, packed as its bytes
+#define PROTOCOL_FIELD(STRUCT, MEMBER)                                                                                 \
+    ::protocol::schema::Raw<offsetof(STRUCT, MEMBER), sizeof(STRUCT::MEMBER),                                         \
+                            std::is_trivially_copyable_v<decltype(STRUCT::MEMBER)>>
+
+namespace protocol::schema {
+
+    enum class Kind { RAW, LIST, TRAILING };
+
+    constexpr std::size_t COUNT_SIZE {sizeof(uint32_t)};
+
+    [[noreturn]] inline void truncated() {
+        throw std::runtime_error("deserialise: truncated frame");
+    }
+
+    template <typename T>
+    inline char * bytesOf(T & value) {
+        return reinterpret_cast<char *>(&value);
+    }
+
+    template <typename T>
+    inline const char * bytesOf(const T & value) {
+        return reinterpret_cast<const char *>(&value);
+    }
+
+    template <std::size_t OFFSET, std::size_t SIZE, bool TRIVIALLY_COPYABLE = true>
+    struct Raw {
+        static_assert(TRIVIALLY_COPYABLE, "only a trivially copyable field can be packed as its bytes");
+        static constexpr Kind kind {Kind::RAW};
+        static constexpr std::size_t offset {OFFSET};
+        static constexpr std::size_t size {SIZE};
+    };
+
+    // A last field only written when it isn't all zero bytes, and read as zero from a frame that
+    // ends before it, so a message can gain it and still have its older encoding
+    template <typename FIELD>
+    struct Trailing {
+        static_assert(FIELD::kind == Kind::RAW);
+        static constexpr Kind kind {Kind::TRAILING};
+        static constexpr std::size_t offset {FIELD::offset};
+        static constexpr std::size_t size {FIELD::size};
+
+        template <typename T>
+        static bool isSet(const T & value) {
+            const char * field {bytesOf(value) + offset};
+            for (std::size_t i = 0; i < size; i++) {
+                if (field[i] != 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template <typename T>
+        static std::size_t packedSize(const T & value) {
+            return isSet(value) ? size : 0;
+        }
+
+        template <typename T>
+        static char * write(const T & value, char * raw) {
+            if (!isSet(value)) {
+                return raw;
+            }
+            std::memcpy(raw, bytesOf(value) + offset, size);
+            return raw + size;
+        }
+
+        template <typename T>
+        static const char * read(T & value, const char * raw, const char * end) {
+            if (raw == end) {
+                std::memset(bytesOf(value) + offset, 0, size);
+                return raw;
+            }
+            if (static_cast<std::size_t>(end - raw) < size) {
+                truncated();
+            }
+            std::memcpy(bytesOf(value) + offset, raw, size);
+            return raw + size;
+        }
+    };
+
+    // For each field, the bytes in the run it starts, or 0 where it carries on the run before it
+    // or isn't a raw field
+    template <typename... FIELDS>
+    constexpr std::array<std::size_t, sizeof...(FIELDS)> runsOf() {
+        constexpr std::size_t count {sizeof...(FIELDS)};
+        constexpr std::array<Kind, count> kinds {FIELDS::kind...};
+        constexpr std::array<std::size_t, count> offsets {FIELDS::offset...};
+        constexpr std::array<std::size_t, count> sizes {FIELDS::size...};
+        auto continues = [&](const std::size_t i) {
+            return i > 0 && kinds[i] == Kind::RAW && kinds[i - 1] == Kind::RAW &&
+                   offsets[i - 1] + sizes[i - 1] == offsets[i];
+        };
+        std::array<std::size_t, count> runs {};
+        for (std::size_t i = 0; i < count; i++) {
+            if (kinds[i] != Kind::RAW || continues(i)) {
+                continue;
+            }
+            runs[i] = sizes[i];
+            for (std::size_t next = i + 1; next < count && continues(next); next++) {
+                runs[i] += sizes[next];
+            }
+        }
+        return runs;
+    }
+
+    template <typename... FIELDS>
+    struct Fields {
+        using Types = std::tuple<FIELDS...>;
+        static constexpr std::size_t count {sizeof...(FIELDS)};
+        static constexpr std::array<std::size_t, count> runs {runsOf<FIELDS...>()};
+        // every encoding has these, so not counting lists or a trailing field
+        static constexpr std::size_t fixedSize {((FIELDS::kind == Kind::RAW ? FIELDS::size : 0) + ... + 0)};
+        static constexpr std::size_t maxFixedSize {
+            fixedSize + ((FIELDS::kind == Kind::TRAILING ? FIELDS::size : 0) + ... + 0)};
+        static constexpr bool isFixedSize {((FIELDS::kind == Kind::RAW) && ...)};
+        static constexpr bool hasLists {((FIELDS::kind == Kind::LIST) || ...)};
+
+        // packs to exactly its own bytes, so a list of them is copied whole. A trivial copy is
+        // all that takes, eg std::pair has one though its assignment makes it not trivially copyable
+        template <typename T>
+        static constexpr bool isDenseFor = isFixedSize && count > 0 && std::tuple_element_t<0, Types>::offset == 0 &&
+                                           runs[0] == sizeof(T) && fixedSize == sizeof(T) &&
+                                           std::is_trivially_copy_constructible_v<T> &&
+                                           std::is_trivially_destructible_v<T>;
+
+        template <typename T>
+        static std::size_t packedSize(const T & value) {
+            if constexpr (isFixedSize) {
+                return fixedSize;
+            } else {
+                return variableSizes(value, std::make_index_sequence<count> {}) + fixedSize;
+            }
+        }
+
+        // Writers and readers take the cursor by value and return it advanced, as a char * held by
+        // reference could alias the bytes copied through it and be reloaded after every copy
+        template <typename T>
+        static char * write(const T & value, char * raw) {
+            return writeFields(value, raw, std::make_index_sequence<count> {});
+        }
+
+        template <typename T>
+        static const char * read(T & value, const char * raw, const char * end) {
+            return readFields(value, raw, end, std::make_index_sequence<count> {});
+        }
+
+    private:
+        template <typename T, std::size_t... I>
+        static std::size_t variableSizes(const T & value, std::index_sequence<I...>) {
+            return (variableSize<I>(value) + ... + 0);
+        }
+
+        template <typename T, std::size_t... I>
+        static char * writeFields(const T & value, char * raw, std::index_sequence<I...>) {
+            ((raw = writeField<I>(value, raw)), ...);
+            return raw;
+        }
+
+        template <typename T, std::size_t... I>
+        static const char * readFields(T & value, const char * raw, const char * end, std::index_sequence<I...>) {
+            ((raw = readField<I>(value, raw, end)), ...);
+            return raw;
+        }
+
+        template <std::size_t I, typename T>
+        static std::size_t variableSize(const T & value) {
+            using Field = std::tuple_element_t<I, Types>;
+            if constexpr (Field::kind == Kind::RAW) {
+                return 0;
+            } else {
+                return Field::packedSize(value);
+            }
+        }
+
+        template <std::size_t I, typename T>
+        static char * writeField(const T & value, char * raw) {
+            using Field = std::tuple_element_t<I, Types>;
+            if constexpr (Field::kind != Kind::RAW) {
+                return Field::write(value, raw);
+            } else if constexpr (runs[I] > 0) {
+                std::memcpy(raw, bytesOf(value) + Field::offset, runs[I]);
+                return raw + runs[I];
+            } else {
+                return raw;
+            }
+        }
+
+        template <std::size_t I, typename T>
+        static const char * readField(T & value, const char * raw, const char * end) {
+            using Field = std::tuple_element_t<I, Types>;
+            if constexpr (Field::kind != Kind::RAW) {
+                return Field::read(value, raw, end);
+            } else if constexpr (runs[I] > 0) {
+                if (static_cast<std::size_t>(end - raw) < runs[I]) {
+                    truncated();
+                }
+                std::memcpy(bytesOf(value) + Field::offset, raw, runs[I]);
+                return raw + runs[I];
+            } else {
+                return raw;
+            }
+        }
+    };
+
+    // the schema of a list of plain values, eg ids or the characters of a string
+    template <typename T>
+    struct Scalar : Fields<Raw<0, sizeof(T), std::is_trivially_copyable_v<T>>> {};
+
+    // A std::vector or Bytes member, packed as its count and then each element by the ELEMENT
+    // schema. The count is checked against the bytes left before anything is allocated for it
+    template <auto MEMBER, typename ELEMENT>
+    struct List {
+        static_assert(ELEMENT::fixedSize > 0);
+        static constexpr Kind kind {Kind::LIST};
+        static constexpr std::size_t offset {0};
+        static constexpr std::size_t size {0};
+
+        template <typename T>
+        static std::size_t packedSize(const T & value) {
+            const auto & items {value.*MEMBER};
+            if constexpr (ELEMENT::isFixedSize) {
+                return COUNT_SIZE + items.size() * ELEMENT::fixedSize;
+            } else {
+                std::size_t size {COUNT_SIZE};
+                for (const auto & item : items) {
+                    size += ELEMENT::packedSize(item);
+                }
+                return size;
+            }
+        }
+
+        template <typename T>
+        static char * write(const T & value, char * raw) {
+            const auto & items {value.*MEMBER};
+            using Item = typename std::remove_cvref_t<decltype(items)>::value_type;
+            const uint32_t count {static_cast<uint32_t>(items.size())};
+            std::memcpy(raw, &count, COUNT_SIZE);
+            raw += COUNT_SIZE;
+            if constexpr (ELEMENT::template isDenseFor<Item>) {
+                // constant sized copies, as most lists are a few entries and a sized memcpy call costs more
+                for (const auto & item : items) {
+                    std::memcpy(raw, static_cast<const void *>(&item), sizeof(Item));
+                    raw += sizeof(Item);
+                }
+            } else {
+                for (const auto & item : items) {
+                    raw = ELEMENT::write(item, raw);
+                }
+            }
+            return raw;
+        }
+
+        template <typename T>
+        static const char * read(T & value, const char * raw, const char * end) {
+            auto & items {value.*MEMBER};
+            using Item = typename std::remove_cvref_t<decltype(items)>::value_type;
+            uint32_t count;
+            if (static_cast<std::size_t>(end - raw) < COUNT_SIZE) {
+                truncated();
+            }
+            std::memcpy(&count, raw, COUNT_SIZE);
+            raw += COUNT_SIZE;
+            if (static_cast<std::size_t>(end - raw) / ELEMENT::fixedSize < count) {
+                truncated();
+            }
+            if constexpr (ELEMENT::template isDenseFor<Item>) {
+                items.resize(count);
+                std::memcpy(static_cast<void *>(items.data()), raw, count * sizeof(Item));
+                raw += count * sizeof(Item);
+            } else {
+                items.clear();
+                items.reserve(count);
+                for (uint32_t i = 0; i < count; i++) {
+                    Item item {};
+                    raw = ELEMENT::read(item, raw, end);
+                    items.push_back(std::move(item));
+                }
+            }
+            return raw;
+        }
+    };
+
+} // namespace protocol::schema
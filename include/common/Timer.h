@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
 #include <common/Constants.h>
 #include <spdlog/spdlog.h>
@@ -9,6 +10,7 @@ class Timer {
 public:
     Timer();
     void tick();
+    void recordWakeup(const std::chrono::time_point<std::chrono::steady_clock>);
     void setTick(const int64_t);
     std::chrono::time_point<std::chrono::steady_clock> currentTick() const;
     int64_t currentTickAsNanos() const;
@@ -17,23 +19,47 @@ private:
     std::chrono::time_point<std::chrono::steady_clock> currentGameTick;
     std::chrono::time_point<std::chrono::steady_clock> previousStatTick;
     int engineLoopCounter;
+
+    // how long after a scheduled deadline the loop actually woke, over the current stats period
+    int64_t wakeups;
+    std::chrono::nanoseconds totalWakeupLateness;
+    std::chrono::nanoseconds maxWakeupLateness;
 };
 
 inline Timer::Timer()
     : currentGameTick {std::chrono::steady_clock::now()},
       previousStatTick {std::chrono::steady_clock::now()},
-      engineLoopCounter {0} {}
+      engineLoopCounter {0},
+      wakeups {0},
+      totalWakeupLateness {0},
+      maxWakeupLateness {0} {}
 
 inline void Timer::tick() {
     engineLoopCounter++;
     currentGameTick = std::chrono::steady_clock::now();
     if (currentGameTick - previousStatTick > std::chrono::seconds(STATS_FREQUENCY_SECONDS)) {
         spdlog::info("IPS=" + std::to_string(engineLoopCounter / STATS_FREQUENCY_SECONDS));
+        if (wakeups > 0) {
+            spdlog::info("WAKEUP wakeups={} mean_late_us={:.1f} max_late_us={:.1f}", wakeups,
+                         static_cast<double>(totalWakeupLateness.count()) / 1000.0 / static_cast<double>(wakeups),
+                         static_cast<double>(maxWakeupLateness.count()) / 1000.0);
+        }
         engineLoopCounter = 0;
+        wakeups = 0;
+        totalWakeupLateness = std::chrono::nanoseconds {0};
+        maxWakeupLateness = std::chrono::nanoseconds {0};
         previousStatTick = currentGameTick;
     }
 }
 
+// call after tick() when the loop woke for a deadline that has now passed
+inline void Timer::recordWakeup(const std::chrono::time_point<std::chrono::steady_clock> deadline) {
+    const std::chrono::nanoseconds lateness {std::max(std::chrono::nanoseconds {0}, currentGameTick - deadline)};
+    wakeups++;
+    totalWakeupLateness += lateness;
+    maxWakeupLateness = std::max(maxWakeupLateness, lateness);
+}
+
 inline void Timer::setTick(const int64_t nanos) {
     currentGameTick = std::chrono::steady_clock::time_point {std::chrono::nanoseconds {nanos}};
 }
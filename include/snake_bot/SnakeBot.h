@@ -4,19 +4,21 @@
 #include "snake_bot/Pathfinder.h"
 #include "snake_client/GameState.h"
 #include "snake_client/NetworkClient.h"
+#include <optional>
 #include <random>
 
 class SnakeBot {
 public:
-    SnakeBot(const int, const int);
+    SnakeBot();
     void run();
 
 private:
     void createBot();
     void joinGame();
     void receiveUpdates();
+    void handleServerConfig(const protocol::ServerConfig & msg);
     void handleServerWelcome(const protocol::ServerWelcome & msg);
-    void handleGameStateMessage(const protocol::GameState & msg);
+    void handleGameStateUpdate();
     void buildArenaMap();
     void sendInput();
     char calculateRandomMove();
@@ -29,5 +31,5 @@ private:
     std::mt19937 gen;
     NetworkClient network;
     client::GameState gameState;
-    Pathfinder pathfinder;
+    std::optional<Pathfinder> pathfinder; // sized by the server's SERVER_CONFIG
 };
\ No newline at end of file
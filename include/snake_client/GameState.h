@@ -1,9 +1,18 @@
 #pragma once
 
+#include "common/CompactGameState.h"
+#include "common/GameStateView.h"
 #include "common/Protocol.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace client {
@@ -14,7 +23,7 @@ namespace client {
         std::string name;
         int score;
         int color;
-        std::vector<std::pair<int, int>> segments;
+        std::deque<std::pair<int, int>> segments;
     };
 
     struct FoodData {
@@ -36,17 +45,37 @@ namespace client {
         std::vector<FoodData> food;
         std::vector<SpeedBoostsData> speedBoosts;
         std::pair<std::string, int> serverHighScore;
+        int64_t sequence {-1}; // sequence of the server game state this reflects, deltas must build on it
     };
 
+    struct LeaderboardEntry {
+        int clientId;
+        std::string name;
+        int score;
+        int color;
+    };
+
+    inline std::vector<LeaderboardEntry> fromProtocol(const protocol::Leaderboard & msg) {
+        std::vector<LeaderboardEntry> entries {};
+        for (auto & e : msg.entries) {
+            entries.push_back({e.clientId, {e.username, strnlen(e.username, sizeof(e.username))}, e.score, e.color});
+        }
+        return entries;
+    }
+
+    inline PlayerData fromProtocol(const protocol::GameState::Player & p) {
+        std::deque<std::pair<int, int>> segments {};
+        for (auto & s : p.segments) {
+            segments.push_back({s.first, s.second});
+        }
+        return {p.clientId, p.direction, p.username, p.score, p.color, std::move(segments)};
+    }
+
     inline GameState fromProtocol(const protocol::GameState & msg) {
         // players
         std::unordered_map<int, PlayerData> players {};
         for (auto & p : msg.players) {
-            std::vector<std::pair<int, int>> segments {};
-            for (auto & s : p.segments) {
-                segments.push_back({s.first, s.second});
-            }
-            players[p.clientId] = {p.clientId, p.direction, p.username, p.score, p.color, segments};
+            players[p.clientId] = fromProtocol(p);
         }
 
         // food
@@ -63,7 +92,174 @@ namespace client {
 
         std::pair<std::string, int> serverHighScore {msg.highScoreUsername, msg.highScore};
 
-        return {players, food, speedBoosts, serverHighScore};
+        return {players, food, speedBoosts, serverHighScore, msg.hdr.sequence};
+    }
+
+    // straight from the frame, with no protocol::GameState in between
+    inline GameState fromProtocol(const protocol::GameStateView & msg) {
+        GameState state {};
+        state.players.reserve(msg.players().size());
+        for (const protocol::PlayerView p : msg.players()) {
+            std::deque<std::pair<int, int>> segments(p.segments().begin(), p.segments().end());
+            state.players[p.clientId()] = {p.clientId(), p.direction(), std::string {p.username()}, p.score(),
+                                           p.color(), std::move(segments)};
+        }
+
+        state.food.reserve(msg.food().size());
+        for (const protocol::GameState::Food f : msg.food()) {
+            state.food.push_back({f.x, f.y, f.icon, f.color});
+        }
+        state.speedBoosts.reserve(msg.speedBoosts().size());
+        for (const protocol::GameState::SpeedBoost s : msg.speedBoosts()) {
+            state.speedBoosts.push_back({s.x, s.y, s.icon, s.color});
+        }
+
+        state.serverHighScore = {std::string {msg.highScoreUsername()}, msg.highScore()};
+        state.sequence = msg.header().sequence;
+        return state;
+    }
+
+    // Straight from a GAME_STATE_COMPACT frame, with no protocol::GameState in between
+    inline GameState fromCompact(const std::string_view frame) {
+        struct Reader {
+            GameState & state;
+
+            void highScore(const int32_t score, const char (&username)[16]) {
+                state.serverHighScore = {{username, strnlen(username, sizeof(username))}, score};
+            }
+            void foodCount(const uint32_t count) { state.food.reserve(count); }
+            void food(const int32_t x, const int32_t y, const uint8_t color) {
+                state.food.push_back({x, y, SnakeConstants::FOOD_ICON, color});
+            }
+            void speedBoostCount(const uint32_t count) { state.speedBoosts.reserve(count); }
+            void speedBoost(const int32_t x, const int32_t y) {
+                state.speedBoosts.push_back(
+                    {x, y, SnakeConstants::SPEED_BOOST_ICON, static_cast<int>(SPEED_BOOST_COLOR)});
+            }
+            void playerCount(const uint32_t count) { state.players.reserve(count); }
+            std::deque<std::pair<int, int>> & player(const int32_t clientId, const uint8_t color, const char direction,
+                                                     const int32_t score, const char (&username)[16]) {
+                PlayerData & p {state.players[clientId]};
+                p = {clientId, direction, {username, strnlen(username, sizeof(username))}, score, color, {}};
+                return p.segments;
+            }
+        };
+
+        GameState state {};
+        Reader reader {state};
+        state.sequence = protocol::readCompact(frame, reader).sequence;
+        return state;
+    }
+
+    template <typename T>
+    inline void applyItemDelta(std::vector<T> & items, const std::vector<protocol::GameStateDelta::Cell> & removed,
+                               const std::vector<protocol::GameState::Food> & added) {
+        for (auto & cell : removed) {
+            std::erase_if(items, [&cell](const T & item) { return item.x == cell.first && item.y == cell.second; });
+        }
+        for (auto & a : added) {
+            items.push_back({a.x, a.y, a.icon, a.color});
+        }
+    }
+
+    // the segments a player will have once the delta's removals and joins are applied, or
+    // nothing if the delta leaves no such player
+    inline std::optional<std::size_t>
+    segmentsAfterJoins(const GameState & state, const protocol::GameStateDelta & delta, const int32_t clientId) {
+        for (auto & p : delta.playersJoined) {
+            if (p.clientId == clientId) {
+                return p.segments.size();
+            }
+        }
+        if (std::ranges::find(delta.playersRemoved, clientId) != delta.playersRemoved.end()) {
+            return std::nullopt;
+        }
+        const auto it {state.players.find(clientId)};
+        return it == state.players.end() ? std::nullopt : std::optional<std::size_t> {it->second.segments.size()};
+    }
+
+    // Apply a delta on top of the game state it was built against. Returns false and leaves
+    // the state untouched if the delta does not follow on from it, or updates a player it
+    // doesn't have or trims more than a whole snake - wait for the next keyframe
+    inline bool applyDelta(GameState & state, const protocol::GameStateDelta & delta) {
+        if (state.sequence == -1 || state.sequence != delta.baseSequence) {
+            return false;
+        }
+        for (auto & u : delta.playersUpdated) {
+            const std::optional<std::size_t> segments {segmentsAfterJoins(state, delta, u.clientId)};
+            if (!segments || u.tailTrim > *segments) {
+                return false;
+            }
+        }
+
+        for (auto & id : delta.playersRemoved) {
+            state.players.erase(id);
+        }
+        for (auto & p : delta.playersJoined) {
+            state.players[p.clientId] = fromProtocol(p);
+        }
+        for (auto & u : delta.playersUpdated) {
+            PlayerData & p {state.players.at(u.clientId)};
+            p.direction = u.direction;
+            p.score = u.score;
+            for (uint32_t i = 0; i < u.tailTrim && !p.segments.empty(); i++) {
+                p.segments.pop_back();
+            }
+            for (auto it = u.headAdvance.rbegin(); it != u.headAdvance.rend(); it++) {
+                p.segments.push_front({it->first, it->second});
+            }
+        }
+
+        applyItemDelta(state.food, delta.foodRemoved, delta.foodAdded);
+        applyItemDelta(state.speedBoosts, delta.speedBoostsRemoved, delta.speedBoostsAdded);
+        state.serverHighScore = {delta.highScoreUsername, delta.highScore};
+        state.sequence = delta.hdr.sequence;
+        return true;
+    }
+
+    // Brings the state up to date with a batch of frames from the server and hands every other
+    // message, decoded, to onMessage in the order it arrived. Returns whether the state changed.
+    // A keyframe replaces everything before it, so we skip straight to the latest one and only
+    // apply the deltas that follow it. This avoids getting behind on the client side when all we
+    // care about is the latest game state anyway. Frames are only decoded once we know they are
+    // wanted, and a full keyframe is read in place
+    template <typename OnMessage>
+    inline bool applyFrames(GameState & state, const std::vector<std::string_view> & frames, OnMessage && onMessage) {
+        std::size_t firstState {0};
+        for (std::size_t i = 0; i < frames.size(); i++) {
+            if (protocol::isKeyframe(protocol::peekHeader(frames[i]).messageType)) {
+                firstState = i;
+            }
+        }
+
+        bool updated {false};
+        for (std::size_t i = 0; i < frames.size(); i++) {
+            const std::string_view frame {frames[i]};
+            switch (protocol::peekHeader(frame).messageType) {
+            case protocol::MessageType::GAME_STATE:
+                if (i >= firstState) {
+                    state = fromProtocol(protocol::GameStateView {frame});
+                    updated = true;
+                }
+                break;
+            case protocol::MessageType::GAME_STATE_COMPACT:
+                if (i >= firstState) {
+                    state = fromCompact(frame);
+                    updated = true;
+                }
+                break;
+            case protocol::MessageType::GAME_STATE_DELTA:
+                if (i >= firstState &&
+                    applyDelta(state, std::get<protocol::GameStateDelta>(protocol::deserialise(frame)))) {
+                    updated = true;
+                }
+                break;
+            default:
+                onMessage(protocol::deserialise(frame));
+                break;
+            }
+        }
+        return updated;
     }
 
 }; // namespace client
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "common/Constants.h"
+#include "common/FrameBuffer.h"
 #include "common/Protocol.h"
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 inline const char * getServerIp() {
     const char * ip = getenv("SNAKE_SERVER_IP");
@@ -14,22 +18,28 @@ inline int getServerPort() {
     return port ? std::atoi(port) : SERVER_PORT;
 }
 
+// SNAKE_ROOM asks a multi-room server for a particular room, otherwise it picks the least busy one
+inline std::optional<int32_t> getServerRoom() {
+    const char * room = getenv("SNAKE_ROOM");
+    return room ? std::optional<int32_t> {std::atoi(room)} : std::nullopt;
+}
+
 class NetworkClient {
 public:
-    NetworkClient(const std::string & host, int port);
+    NetworkClient(const std::string & host, int port, std::optional<int32_t> room = std::nullopt);
     ~NetworkClient();
 
     int getServerFd() const { return serverFd; };
     void sendToServer(const Bytes &);
-    std::vector<Bytes> receiveFromServer();
+    // everything the server has sent so far, as views good until the next call
+    std::vector<std::string_view> receiveFromServer();
     void waitForReadable(const int);
 
 private:
     void connectToServer(const std::string & host, int port);
     void setNonBlocking(int fd);
-    std::vector<Bytes> parseReceivedPacket(char * buffer, size_t size);
 
     int serverFd;
-    char recvBuffer[CLIENT_RECV_BUFFER_SIZE];
-    std::string messageBuffer;
+    std::size_t maxMessageSize; // grows to fit the arena once its config arrives
+    FrameBuffer messageBuffer;
 };
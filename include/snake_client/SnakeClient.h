@@ -6,7 +6,7 @@
 
 class SnakeClient {
 public:
-    SnakeClient(int width_, int height_);
+    SnakeClient();
     ~SnakeClient();
     void run();
 
@@ -17,17 +17,23 @@ private:
     void handleInput();
     void sendPlayerInput();
     void receiveUpdates();
+    void handleServerConfig(const protocol::ServerConfig &);
     void handleServerWelcome(const protocol::ServerWelcome &);
-    void handleGameStateMessage(const protocol::GameState &);
+    void handleGameStateUpdate();
     void render();
+    void updateViewport();
     void renderArena();
     void renderPlayers();
     void renderObjects();
     void renderScore();
+    void renderCellToScreen(const int, const int, const char &, const int color = 1);
     void renderCharToScreen(const int, const int, const char &, const int color = 1);
 
-    int width;
+    int width; // of the arena, 0 until the server's SERVER_CONFIG arrives
     int height;
+    int viewWidth;
+    int viewHeight;
+    std::pair<int, int> viewOrigin; // arena cell shown in the top left corner
     bool running;
     bool playing;
 
@@ -36,4 +42,5 @@ private:
     int clientId;
     char playerInput;
     client::GameState gameState;
+    std::vector<client::LeaderboardEntry> leaderboard; // only sent when we can't see the whole arena
 };
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common/Protocol.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Hand-over point between the RoomAcceptor thread and one room's NetworkServer. The acceptor posts
+// sockets it has routed here, along with whatever it already read from them, and the eventfd wakes
+// the room's epoll loop to take them
+class ClientInbox {
+public:
+    ClientInbox()
+        : fd {eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)} {
+        if (fd == -1) {
+            throw std::runtime_error("Failed to create eventfd for client inbox");
+        }
+    }
+    ~ClientInbox() { close(fd); }
+    ClientInbox(const ClientInbox &) = delete;
+    ClientInbox & operator=(const ClientInbox &) = delete;
+
+    // acceptor thread
+    void post(const int clientFd, Bytes received) {
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            pending.emplace_back(clientFd, std::move(received));
+        }
+        connections++;
+        const uint64_t one {1};
+        [[maybe_unused]] ssize_t written {write(fd, &one, sizeof(one))};
+    }
+
+    // room thread
+    std::vector<std::pair<int, Bytes>> take() {
+        uint64_t count;
+        [[maybe_unused]] ssize_t readCount {read(fd, &count, sizeof(count))};
+        std::lock_guard<std::mutex> lock {mutex};
+        return std::exchange(pending, {});
+    }
+
+    int eventFd() const { return fd; };
+
+    // connected clients routed to this room, the acceptor balances on it
+    std::atomic<int> connections {0};
+
+private:
+    const int fd;
+    std::mutex mutex;
+    std::vector<std::pair<int, Bytes>> pending;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+// A random engine that counts its draws. Given the seed, the count says where the engine is in
+// its sequence, so the state hash can cover the RNG without hashing its 2.5 KB of state. It
+// streams exactly as the wrapped engine does, the count left out
+template <typename Engine>
+class CountingEngine {
+public:
+    using result_type = typename Engine::result_type;
+
+    explicit CountingEngine(const result_type seed) : engine {seed}, count {0} {}
+
+    static constexpr result_type min() { return Engine::min(); }
+    static constexpr result_type max() { return Engine::max(); }
+
+    result_type operator()() {
+        count++;
+        return engine();
+    }
+
+    uint64_t draws() const { return count; }
+    void resetDraws() { count = 0; }
+
+    friend std::ostream & operator<<(std::ostream & out, const CountingEngine & e) { return out << e.engine; }
+    friend std::istream & operator>>(std::istream & in, CountingEngine & e) { return in >> e.engine; }
+
+private:
+    Engine engine;
+    uint64_t count;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <vector>
+
+// Min-heap of per-player deadlines (next move, boost expiry). Entries are never removed early:
+// when a player dies or its deadline changes the old entry stays queued, and the caller discards
+// it on pop by checking it against the player's current deadline. Ties pop in clientId order
+class DeadlineQueue {
+public:
+    using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
+
+    struct Entry {
+        TimePoint time;
+        int clientId;
+    };
+
+    void push(const TimePoint time, const int clientId);
+    std::optional<Entry> popDue(const TimePoint now);
+    std::optional<TimePoint> earliest() const;
+    void clear() { heap.clear(); };
+    std::size_t size() const { return heap.size(); };
+
+private:
+    static bool later(const Entry & a, const Entry & b) {
+        return a.time != b.time ? a.time > b.time : a.clientId > b.clientId;
+    }
+
+    std::vector<Entry> heap;
+};
+
+inline void DeadlineQueue::push(const TimePoint time, const int clientId) {
+    heap.push_back({time, clientId});
+    std::push_heap(heap.begin(), heap.end(), later);
+}
+
+inline std::optional<DeadlineQueue::Entry> DeadlineQueue::popDue(const TimePoint now) {
+    if (heap.empty() || heap.front().time > now) {
+        return std::nullopt;
+    }
+    std::pop_heap(heap.begin(), heap.end(), later);
+    Entry entry {heap.back()};
+    heap.pop_back();
+    return entry;
+}
+
+inline std::optional<DeadlineQueue::TimePoint> DeadlineQueue::earliest() const {
+    if (heap.empty()) {
+        return std::nullopt;
+    }
+    return heap.front().time;
+}
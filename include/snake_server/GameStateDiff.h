@@ -0,0 +1,100 @@
+#pragma once
+
+#include "common/Protocol.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+inline int64_t cellKey(const int32_t x, const int32_t y) {
+    return (static_cast<int64_t>(x) << 32) | static_cast<uint32_t>(y);
+}
+
+inline void diffItems(const std::vector<protocol::GameState::Food> & base,
+                      const std::vector<protocol::GameState::Food> & next,
+                      std::vector<protocol::GameStateDelta::Cell> & removed,
+                      std::vector<protocol::GameState::Food> & added) {
+    std::unordered_map<int64_t, const protocol::GameState::Food *> baseByCell {};
+    baseByCell.reserve(base.size());
+    for (auto & f : base) {
+        baseByCell[cellKey(f.x, f.y)] = &f;
+    }
+    for (auto & f : next) {
+        auto it {baseByCell.find(cellKey(f.x, f.y))};
+        if (it != baseByCell.end() && it->second->color == f.color && it->second->icon == f.icon) {
+            baseByCell.erase(it); // unchanged
+        } else {
+            added.push_back(f);
+        }
+    }
+    // whatever is left in base is gone, or was replaced by a different item in the same cell
+    for (auto & f : base) {
+        if (baseByCell.contains(cellKey(f.x, f.y))) {
+            removed.push_back({f.x, f.y});
+        }
+    }
+}
+
+// Between two broadcasts a snake moves at most once and grows at most once, so its new body
+// is the old one with up to a couple of cells pushed on the head and some trimmed off the tail.
+// Returns false if that is not the case and the player has to be sent in full
+inline bool diffSegments(const protocol::GameState::Player & base, const protocol::GameState::Player & next,
+                         protocol::GameStateDelta::PlayerUpdate & update) {
+    constexpr std::size_t MAX_HEAD_ADVANCE {2};
+    const auto & b {base.segments};
+    const auto & n {next.segments};
+    for (std::size_t advance = 0; advance <= std::min(MAX_HEAD_ADVANCE, n.size()); advance++) {
+        const std::size_t kept {n.size() - advance};
+        if (kept <= b.size() && std::equal(n.begin() + static_cast<std::ptrdiff_t>(advance), n.end(), b.begin())) {
+            update.headAdvance.assign(n.begin(), n.begin() + static_cast<std::ptrdiff_t>(advance));
+            update.tailTrim = static_cast<uint32_t>(b.size() - kept);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Build the delta that turns base into next on a client holding base
+inline protocol::GameStateDelta diffGameStates(const protocol::GameState & base, const protocol::GameState & next) {
+    protocol::GameStateDelta delta {};
+    delta.hdr = next.hdr;
+    delta.hdr.messageType = protocol::MessageType::GAME_STATE_DELTA;
+    delta.baseSequence = base.hdr.sequence;
+    delta.highScore = next.highScore;
+    std::memcpy(delta.highScoreUsername, next.highScoreUsername, sizeof(delta.highScoreUsername));
+
+    diffItems(base.food, next.food, delta.foodRemoved, delta.foodAdded);
+    diffItems(base.speedBoosts, next.speedBoosts, delta.speedBoostsRemoved, delta.speedBoostsAdded);
+
+    std::unordered_map<int32_t, const protocol::GameState::Player *> baseById {};
+    baseById.reserve(base.players.size());
+    for (auto & p : base.players) {
+        baseById[p.clientId] = &p;
+    }
+    for (auto & p : next.players) {
+        auto it {baseById.find(p.clientId)};
+        if (it == baseById.end()) {
+            delta.playersJoined.push_back(p);
+            continue;
+        }
+        const protocol::GameState::Player & old {*it->second};
+        baseById.erase(it);
+
+        protocol::GameStateDelta::PlayerUpdate update {p.clientId, p.direction, p.score, 0, {}};
+        if (old.color != p.color || std::strncmp(old.username, p.username, sizeof(p.username)) != 0 ||
+            !diffSegments(old, p, update)) {
+            delta.playersJoined.push_back(p);
+        } else if (!update.headAdvance.empty() || update.tailTrim != 0 || old.direction != p.direction ||
+                   old.score != p.score) {
+            delta.playersUpdated.push_back(std::move(update));
+        }
+    }
+    for (auto & p : base.players) {
+        if (baseById.contains(p.clientId)) {
+            delta.playersRemoved.push_back(p.clientId);
+        }
+    }
+    return delta;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "common/Protocol.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Buckets the food, speed boosts and snake segments of a global GameState into square tiles, so the
+// area of interest around each client can be cut out of it by visiting only the nearby tiles rather
+// than every entity in the arena. Rebuilt once per broadcast, then queried once per client
+class InterestGrid {
+public:
+    // covers cells 0 to width and 0 to height inclusive, arena cells are numbered from 1
+    InterestGrid(const int width, const int height, const int size)
+        : bucketSize {size},
+          bucketsWide {width / size + 1},
+          bucketsHigh {height / size + 1},
+          food(static_cast<std::size_t>(bucketsWide * bucketsHigh)),
+          speedBoosts(static_cast<std::size_t>(bucketsWide * bucketsHigh)),
+          segments(static_cast<std::size_t>(bucketsWide * bucketsHigh)) {}
+
+    void build(const protocol::GameState & state);
+
+    // Everything within radius cells of centre in either axis, the square a terminal shows. A snake
+    // with any segment in there is sent whole, so its head and length still make sense
+    protocol::GameState view(const protocol::GameState & state, const std::pair<int, int> centre,
+                             const int radius);
+
+private:
+    struct Entry {
+        int32_t x;
+        int32_t y;
+        uint32_t index; // into the food, speedBoosts or players vector of the state built from
+    };
+    using Buckets = std::vector<std::vector<Entry>>;
+
+    std::size_t bucketOf(const int32_t x, const int32_t y) const {
+        return static_cast<std::size_t>((y / bucketSize) * bucketsWide + x / bucketSize);
+    }
+
+    template <typename F>
+    void visit(const Buckets & buckets, const int x0, const int y0, const int x1, const int y1, F && f) const;
+
+    int bucketSize;
+    int bucketsWide;
+    int bucketsHigh;
+    Buckets food;
+    Buckets speedBoosts;
+    Buckets segments;
+    std::vector<uint32_t> playerSeen; // query stamp per player, so a snake is added once
+    uint32_t queryStamp {0};
+};
+
+inline void InterestGrid::build(const protocol::GameState & state) {
+    for (auto * buckets : {&food, &speedBoosts, &segments}) {
+        for (auto & bucket : *buckets) {
+            bucket.clear();
+        }
+    }
+    for (uint32_t i = 0; i < state.food.size(); i++) {
+        const auto & f {state.food[i]};
+        food[bucketOf(f.x, f.y)].push_back({f.x, f.y, i});
+    }
+    for (uint32_t i = 0; i < state.speedBoosts.size(); i++) {
+        const auto & sb {state.speedBoosts[i]};
+        speedBoosts[bucketOf(sb.x, sb.y)].push_back({sb.x, sb.y, i});
+    }
+    for (uint32_t i = 0; i < state.players.size(); i++) {
+        for (auto & [x, y] : state.players[i].segments) {
+            segments[bucketOf(x, y)].push_back({x, y, i});
+        }
+    }
+    playerSeen.assign(state.players.size(), 0);
+    queryStamp = 0;
+}
+
+template <typename F>
+inline void InterestGrid::visit(const Buckets & buckets, const int x0, const int y0, const int x1, const int y1,
+                                F && f) const {
+    for (int by = y0 / bucketSize; by <= y1 / bucketSize; by++) {
+        for (int bx = x0 / bucketSize; bx <= x1 / bucketSize; bx++) {
+            for (auto & e : buckets[static_cast<std::size_t>(by * bucketsWide + bx)]) {
+                if (x0 <= e.x && e.x <= x1 && y0 <= e.y && e.y <= y1) {
+                    f(e.index);
+                }
+            }
+        }
+    }
+}
+
+inline protocol::GameState InterestGrid::view(const protocol::GameState & state, const std::pair<int, int> centre,
+                                              const int radius) {
+    protocol::GameState out {};
+    out.hdr = state.hdr;
+    out.highScore = state.highScore;
+    std::memcpy(out.highScoreUsername, state.highScoreUsername, sizeof(out.highScoreUsername));
+
+    const int x0 {std::max(0, centre.first - radius)};
+    const int y0 {std::max(0, centre.second - radius)};
+    const int x1 {std::min(bucketsWide * bucketSize - 1, centre.first + radius)};
+    const int y1 {std::min(bucketsHigh * bucketSize - 1, centre.second + radius)};
+
+    visit(food, x0, y0, x1, y1, [&](const uint32_t i) { out.food.push_back(state.food[i]); });
+    visit(speedBoosts, x0, y0, x1, y1, [&](const uint32_t i) { out.speedBoosts.push_back(state.speedBoosts[i]); });
+
+    queryStamp++;
+    std::vector<uint32_t> visible {};
+    visit(segments, x0, y0, x1, y1, [&](const uint32_t i) {
+        if (playerSeen[i] != queryStamp) {
+            playerSeen[i] = queryStamp;
+            visible.push_back(i);
+        }
+    });
+    // keep the global order, so consecutive views of the same players line up
+    std::sort(visible.begin(), visible.end());
+    for (auto i : visible) {
+        out.players.push_back(state.players[i]);
+    }
+    return out;
+}
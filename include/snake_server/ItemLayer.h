@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common/Hash.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Arena items (food, speed boosts) packed densely for iteration, with a cell-indexed
+// grid of slots for lookups. contains/place/erase are a single array load plus O(1) work.
+// erase moves the last item into the hole, so iteration order is deterministic for a
+// given sequence of operations, but is not insertion order. digest() is a hash of the items,
+// whatever their order, kept up to date by place and erase
+template <typename T>
+class ItemLayer {
+public:
+    ItemLayer(int width, int height);
+    bool contains(const std::pair<int, int> &) const;
+    void place(const T &);
+    void erase(const std::pair<int, int> &);
+    std::size_t size() const { return items.size(); };
+    bool empty() const { return items.empty(); };
+    const std::vector<T> & all() const { return items; };
+    uint64_t digest() const { return sum; };
+
+private:
+    std::size_t cellIndex(int x, int y) const;
+    static uint64_t itemHash(const T & item) {
+        return hash::of(hash::cell(item.x, item.y), static_cast<uint8_t>(item.icon), static_cast<int>(item.color));
+    }
+
+    int width;
+    int height;
+    std::vector<uint32_t> slots; // index into items + 1, 0 for an empty cell
+    std::vector<T> items;
+    uint64_t sum;
+};
+
+template <typename T>
+inline ItemLayer<T>::ItemLayer(int width_, int height_)
+    : width {width_}, height {height_}, slots(static_cast<std::size_t>(width_ * height_), 0), items {}, sum {0} {}
+
+template <typename T>
+inline std::size_t ItemLayer<T>::cellIndex(int x, int y) const {
+    assert(x >= 1 && x <= width && y >= 1 && y <= height && "ItemLayer: cell outside the arena");
+    return static_cast<std::size_t>((y - 1) * width + x - 1);
+}
+
+template <typename T>
+inline bool ItemLayer<T>::contains(const std::pair<int, int> & cell) const {
+    return slots[cellIndex(cell.first, cell.second)] != 0;
+}
+
+// placing onto an occupied cell replaces the item there
+template <typename T>
+inline void ItemLayer<T>::place(const T & item) {
+    uint32_t & slot {slots[cellIndex(item.x, item.y)]};
+    sum += itemHash(item);
+    if (slot != 0) {
+        sum -= itemHash(items[slot - 1]);
+        items[slot - 1] = item;
+    } else {
+        items.push_back(item);
+        slot = static_cast<uint32_t>(items.size());
+    }
+}
+
+template <typename T>
+inline void ItemLayer<T>::erase(const std::pair<int, int> & cell) {
+    uint32_t & slot {slots[cellIndex(cell.first, cell.second)]};
+    if (slot == 0) {
+        return;
+    }
+    const std::size_t index {slot - 1};
+    slot = 0;
+    sum -= itemHash(items[index]);
+    if (index != items.size() - 1) {
+        items[index] = items.back();
+        slots[cellIndex(items[index].x, items[index].y)] = static_cast<uint32_t>(index + 1);
+    }
+    items.pop_back();
+}
@@ -1,37 +1,92 @@
 #pragma once
 
 #include "common/Constants.h"
+#include "common/FrameBuffer.h"
 #include "common/Protocol.h"
+#include "snake_server/ClientInbox.h"
+#include "snake_server/OutboundQueue.h"
+#include <chrono>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 class NetworkServer {
 public:
-    NetworkServer(int);
-    std::vector<std::pair<int, Bytes>> pollMessages();
+    struct OutboundStats {
+        std::size_t queuedBytes;        // across all connections
+        std::size_t queuedFrames;       // across all connections
+        std::size_t deepestQueueBytes;  // the most backed up connection
+        std::size_t droppedFrames;      // stale game states discarded since startup
+        std::size_t droppedBytes;       // ditto
+        std::size_t overflowDisconnects; // clients dropped for falling too far behind
+    };
+
+    // with an inbox there is no listening socket, clients are handed over by a RoomAcceptor instead
+    NetworkServer(int, const std::size_t outboundQueueMaxBytes, const OutboundOverflowPolicy,
+                  std::shared_ptr<ClientInbox> = nullptr);
+    ~NetworkServer();
+    NetworkServer(const NetworkServer &) = delete;
+    NetworkServer & operator=(const NetworkServer &) = delete;
+    // Blocks until a client sends something or wakeAt passes, indefinitely if there is nothing to wake
+    // for. The frames are views into each client's receive buffer, good until the next pollMessages
+    // or drainDisconnects
+    std::vector<std::pair<int, std::string_view>>
+    pollMessages(const std::optional<std::chrono::steady_clock::time_point> wakeAt);
+    // safe from any thread, makes a blocked pollMessages return
+    void wake();
     std::vector<int> drainDisconnects();
-    void sendToClient(const int clientId, const Bytes &);
-    void broadcast(const Bytes &);
+    std::vector<int> drainResyncs();
+    // the frame is shared with the outbound queues rather than copied, so mustn't change until they let go
+    void sendToClient(const int clientId, std::shared_ptr<const Bytes>);
+    void broadcast(const std::shared_ptr<const Bytes> &);
+    // sent to every client as soon as it connects, ahead of any broadcast
+    void setGreeting(std::shared_ptr<const Bytes>);
+    OutboundStats outboundStats() const;
+    std::vector<int> clientIds() const;
 
 private:
     void startServer(int);
     void setNonBlocking(int fd);
     void registerFdWithEpoll(int fd);
+    void startWakeupTimer();
+    void startWakeupEvent();
+    void armWakeupTimer(const std::optional<std::chrono::steady_clock::time_point> wakeAt);
+    void startRoom();
     void acceptNewClient();
+    void adoptClients(std::vector<std::pair<int, std::string_view>> & messages);
+    int addClient(const int fd);
     void disconnectClient(const int);
-    std::vector<Bytes> receiveFromClient(int fd);
-    std::vector<Bytes> parseReceivedPacket(int fd, char * buffer, size_t size);
-    void networkSend(const int, const Bytes &);
+    void receiveFromClient(int fd, std::vector<std::pair<int, std::string_view>> & messages);
+    void takeFrames(int fd, std::vector<std::pair<int, std::string_view>> & messages);
+    void networkSend(const int, const std::shared_ptr<const Bytes> &);
+    void flushOutbound(const int fd);
+    void setWriteInterest(const int fd, const bool enabled);
+    void logOutboundStats();
 
     int serverFd;
     int epollFd;
+    int timerFd; // timerfd in the epoll set, armed for the engine's next deadline
+    int wakeFd;  // eventfd in the epoll set, for wake()
+    std::optional<std::chrono::steady_clock::time_point> armedWakeup;
     int nextClientId;
+    const std::size_t outboundQueueMaxBytes;
+    const OutboundOverflowPolicy outboundOverflowPolicy;
 
-    char recvBuffer[SERVER_RECV_BUFFER_SIZE];
     std::unordered_map<int, int> fdToClientIdMap;
     std::unordered_map<int, int> clientIdToFdMap;
-    std::unordered_map<int, Bytes> fdToBufferMap;
+    std::unordered_map<int, FrameBuffer> fdToBufferMap;
+    std::unordered_map<int, OutboundQueue> fdToOutboundMap;
+    std::unordered_set<int> fdsAwaitingWritable;
     std::unordered_set<int> fdsToDisconnect;
+    std::unordered_set<int> fdsToResync;
+    std::size_t droppedFrames;
+    std::size_t droppedBytes;
+    std::size_t overflowDisconnects;
+    std::chrono::time_point<std::chrono::steady_clock> previousStatsLog;
+    std::shared_ptr<ClientInbox> inbox;
+    std::shared_ptr<const Bytes> greeting;
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common/Protocol.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// What to do when a connection's outbound queue would grow past its byte limit
+enum class OutboundOverflowPolicy {
+    DISCONNECT,       // the client is too slow, drop the connection
+    DROP_STALE_STATE, // throw away queued game states that haven't started sending, the newest one supersedes them
+};
+
+// Frames waiting to be written to one client socket. Payloads are shared between every queue
+// they were broadcast to, and the length prefix is gathered alongside them at send time
+class OutboundQueue {
+public:
+    enum class FlushResult {
+        DRAINED, // everything queued has been written
+        PENDING, // the socket buffer is full, wait for EPOLLOUT
+        ERROR,   // the connection is broken
+    };
+
+    void push(std::shared_ptr<const Bytes> payload);
+    FlushResult flush(const int fd);
+    std::size_t dropStaleState();
+    std::size_t bytes() const { return queuedBytes; };
+    std::size_t frames() const { return queue.size(); };
+    bool empty() const { return queue.empty(); };
+
+private:
+    static constexpr std::size_t MAX_FRAMES_PER_SEND {32};
+
+    struct Frame {
+        std::shared_ptr<const Bytes> payload;
+        uint32_t len;
+        std::size_t sent; // of the prefix and payload together
+
+        std::size_t size() const { return sizeof(len) + payload->size(); };
+    };
+
+    static bool isGameState(const Frame & frame);
+
+    std::deque<Frame> queue {};
+    std::size_t queuedBytes {0};
+};
+
+inline void OutboundQueue::push(std::shared_ptr<const Bytes> payload) {
+    const uint32_t len {static_cast<uint32_t>(payload->size())};
+    queue.push_back({std::move(payload), len, 0});
+    queuedBytes += queue.back().size();
+}
+
+inline OutboundQueue::FlushResult OutboundQueue::flush(const int fd) {
+    while (!queue.empty()) {
+        iovec iov[2 * MAX_FRAMES_PER_SEND];
+        std::size_t iovCount {0};
+        for (std::size_t i = 0; i < queue.size() && i < MAX_FRAMES_PER_SEND; i++) {
+            Frame & frame {queue[i]};
+            if (frame.sent < sizeof(frame.len)) {
+                iov[iovCount++] = {reinterpret_cast<char *>(&frame.len) + frame.sent, sizeof(frame.len) - frame.sent};
+            }
+            const std::size_t payloadSent {frame.sent > sizeof(frame.len) ? frame.sent - sizeof(frame.len) : 0};
+            iov[iovCount++] = {const_cast<char *>(frame.payload->data()) + payloadSent,
+                               frame.payload->size() - payloadSent};
+        }
+
+        msghdr msg {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCount;
+        ssize_t sent {sendmsg(fd, &msg, 0)};
+        if (sent == -1) {
+            if (errno == EAGAIN) { // same value as EWOULDBLOCK on Linux
+                return FlushResult::PENDING;
+            }
+            return FlushResult::ERROR;
+        }
+
+        // retire whatever was fully written, and note how far into the next frame we got
+        std::size_t remaining {static_cast<std::size_t>(sent)};
+        queuedBytes -= remaining;
+        while (remaining > 0) {
+            Frame & frame {queue.front()};
+            const std::size_t left {frame.size() - frame.sent};
+            if (remaining < left) {
+                frame.sent += remaining;
+                break;
+            }
+            remaining -= left;
+            queue.pop_front();
+        }
+    }
+    return FlushResult::DRAINED;
+}
+
+inline std::size_t OutboundQueue::dropStaleState() {
+    std::size_t dropped {0};
+    std::deque<Frame> kept {};
+    for (auto & frame : queue) {
+        // a frame that is partly on the wire has to be finished or the stream is corrupt
+        if (frame.sent == 0 && isGameState(frame)) {
+            queuedBytes -= frame.size();
+            dropped++;
+        } else {
+            kept.push_back(std::move(frame));
+        }
+    }
+    queue = std::move(kept);
+    return dropped;
+}
+
+inline bool OutboundQueue::isGameState(const Frame & frame) {
+    protocol::MessageType type;
+    if (frame.payload->size() < sizeof(type)) {
+        return false;
+    }
+    std::memcpy(&type, frame.payload->data(), sizeof(type));
+    return protocol::isKeyframe(type) || type == protocol::MessageType::GAME_STATE_DELTA;
+}
@@ -1,61 +1,99 @@
 #pragma once
 
 #include "common/Constants.h"
+#include "common/Hash.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
 #include <chrono>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
-class PlayerNode {
+// Snake body stored head-first in a circular buffer of cells. A move writes the new head
+// into the slot before the current head and drops the tail, so it is O(1) in the snake length.
+// digest() is a hash of the cells, which a move or grow updates in O(1) too
+class SnakeBody {
 public:
-    PlayerNode(int x, int y);
+    SnakeBody(int x, int y);
+    SnakeBody(const std::vector<std::pair<int, int>> & segments, const std::pair<int, int> & vacated);
     void move(int xMove, int yMove);
     void moveTo(int xMove, int yMove);
     void grow();
-    void getSegments(std::vector<std::pair<int, int>> &);
-    int x() const { return xPos; };
-    int y() const { return yPos; };
+    void getSegments(std::vector<std::pair<int, int>> &) const;
+    const std::pair<int, int> & segment(std::size_t i) const { return cells[slot(i)]; };
+    const std::pair<int, int> & vacated() const { return vacatedCell; };
+    std::size_t length() const { return size; };
+    int x() const { return segment(0).first; };
+    int y() const { return segment(0).second; };
+    uint64_t digest() const { return cellSum; };
 
 private:
-    int xPos;
-    int yPos;
-    int prevX;
-    int prevY;
-    std::unique_ptr<PlayerNode> next {nullptr};
+    std::size_t slot(std::size_t i) const { return (headIndex + i) & (cells.size() - 1); };
+
+    std::vector<std::pair<int, int>> cells; // capacity is always a power of two
+    std::size_t headIndex;
+    std::size_t size;
+    std::pair<int, int> vacatedCell; // cell the tail left on the last move, where grow() appends
+    uint64_t cellSum;
 };
 
-inline PlayerNode::PlayerNode(int x, int y) : xPos {x}, yPos {y}, prevX {x}, prevY {y} {}
+inline SnakeBody::SnakeBody(int x, int y)
+    : cells(8), headIndex {0}, size {1}, vacatedCell {x, y}, cellSum {hash::cell(x, y)} {
+    cells[0] = {x, y};
+}
+
+// rebuilt from its segments head first, as saved in an engine checkpoint
+inline SnakeBody::SnakeBody(const std::vector<std::pair<int, int>> & segments, const std::pair<int, int> & vacated)
+    : cells(std::bit_ceil(std::max<std::size_t>(8, segments.size()))),
+      headIndex {0},
+      size {segments.size()},
+      vacatedCell {vacated},
+      cellSum {0} {
+    assert(!segments.empty() && "SnakeBody: a snake has at least a head");
+    std::copy(segments.begin(), segments.end(), cells.begin());
+    for (const auto & [x, y] : segments) {
+        cellSum += hash::cell(x, y);
+    }
+}
 
-inline void PlayerNode::move(int xMove, int yMove) {
-    moveTo(xPos + xMove, yPos + yMove);
+inline void SnakeBody::move(int xMove, int yMove) {
+    moveTo(x() + xMove, y() + yMove);
 }
 
-inline void PlayerNode::moveTo(int xMove, int yMove) {
-    prevX = xPos;
-    prevY = yPos;
-    xPos = xMove;
-    yPos = yMove;
-    if (next != nullptr) {
-        next->moveTo(prevX, prevY);
-    };
+inline void SnakeBody::moveTo(int xMove, int yMove) {
+    vacatedCell = segment(size - 1);
+    headIndex = (headIndex - 1) & (cells.size() - 1);
+    cells[headIndex] = {xMove, yMove};
+    cellSum += hash::cell(xMove, yMove) - hash::cell(vacatedCell.first, vacatedCell.second);
 }
 
-inline void PlayerNode::grow() {
-    if (next == nullptr) {
-        next = std::make_unique<PlayerNode>(prevX, prevY);
-    } else {
-        next->grow();
+inline void SnakeBody::grow() {
+    if (size == cells.size()) {
+        // unroll into a buffer of double the capacity, head back at index 0
+        std::vector<std::pair<int, int>> grown(cells.size() * 2);
+        for (std::size_t i = 0; i < size; i++) {
+            grown[i] = segment(i);
+        }
+        cells.swap(grown);
+        headIndex = 0;
     }
+    cells[slot(size)] = vacatedCell;
+    size++;
+    cellSum += hash::cell(vacatedCell.first, vacatedCell.second);
 }
 
-inline void PlayerNode::getSegments(std::vector<std::pair<int, int>> & segments) {
-    segments.emplace_back(xPos, yPos);
-    if (next != nullptr) {
-        next->getSegments(segments);
+inline void SnakeBody::getSegments(std::vector<std::pair<int, int>> & segments) const {
+    segments.reserve(segments.size() + size);
+    for (std::size_t i = 0; i < size; i++) {
+        segments.push_back(segment(i));
     }
 }
 
 struct Player {
-    PlayerNode head;
+    SnakeBody body;
     char direction;
     char nextDirection;
     std::string name;
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common/Constants.h"
+#include "common/Protocol.h"
+#include "snake_server/ClientInbox.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// The room a new client goes to: the one it asked for if there is such a room, otherwise the one
+// with the fewest clients, lowest index first
+inline std::size_t chooseRoom(const std::optional<int32_t> requested, const std::vector<int> & loads) {
+    if (requested && *requested >= 0 && static_cast<std::size_t>(*requested) < loads.size()) {
+        return static_cast<std::size_t>(*requested);
+    }
+    std::size_t best {0};
+    for (std::size_t i = 1; i < loads.size(); i++) {
+        if (loads[i] < loads[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Owns the listening socket when the server runs several rooms. New connections are read here until
+// their first game message (normally CLIENT_JOIN) arrives, then the socket and everything read from it
+// so far is handed to the chosen room's NetworkServer. An optional CLIENT_ROOM_REQUEST ahead of the
+// join picks the room, and is consumed here
+class RoomAcceptor {
+public:
+    RoomAcceptor(int port, std::vector<std::shared_ptr<ClientInbox>> rooms);
+    void run();
+    // from any thread, run() returns once it wakes
+    void stop();
+
+private:
+    struct PendingClient {
+        Bytes buffer;
+        std::optional<int32_t> requestedRoom;
+    };
+
+    void startServer(int port);
+    void acceptNewClient();
+    void receiveFromClient(int fd);
+    void routeClient(int fd);
+    void dropClient(int fd);
+
+    int serverFd;
+    int epollFd;
+    int wakeFd; // eventfd in the epoll set, for stop()
+    std::atomic<bool> stopRequested;
+    std::vector<std::shared_ptr<ClientInbox>> rooms;
+    std::unordered_map<int, PendingClient> pendingClients;
+    char recvBuffer[SERVER_RECV_BUFFER_SIZE];
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common/Protocol.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Buffers for serialised outbound frames. A buffer is shared with every outbound queue it is pushed
+// to, and comes back into use once they have all sent it, so at steady state a broadcast serialises
+// into the capacity of an earlier one rather than allocating. Single threaded, like its room
+class SendBufferPool {
+public:
+    // a buffer nothing else holds, its old contents left for the caller to replace
+    std::shared_ptr<Bytes> acquire();
+    std::size_t size() const { return buffers.size(); };
+
+private:
+    // past this many in flight, eg behind slow clients, a new buffer is handed out and not kept
+    static constexpr std::size_t MAX_BUFFERS {64};
+
+    std::vector<std::shared_ptr<Bytes>> buffers {};
+    std::size_t next {0}; // queues send in order, so the buffer after the last one taken is the likeliest free
+};
+
+inline std::shared_ptr<Bytes> SendBufferPool::acquire() {
+    for (std::size_t i {0}; i < buffers.size(); i++) {
+        const std::size_t index {(next + i) % buffers.size()};
+        if (buffers[index].use_count() == 1) {
+            next = index + 1;
+            return buffers[index];
+        }
+    }
+    if (buffers.size() >= MAX_BUFFERS) {
+        return std::make_shared<Bytes>();
+    }
+    buffers.push_back(std::make_shared<Bytes>());
+    next = buffers.size();
+    return buffers.back();
+}
@@ -1,14 +1,30 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
 #include <cstdint>
+#include <cstdlib>
+#include <limits>
 #include <optional>
 #include <random>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 #include "common/Constants.h"
+#include "common/MessageLogWriter.h"
 #include "common/Protocol.h"
+#include "snake_server/OutboundQueue.h"
+
+// What goes in the message log. A replay only needs the client messages and the times the engine
+// ticked, so INPUTS logs a STATE_HASH where FULL logs each GAME_STATE, and leaves out the
+// SERVER_WELCOMEs. Replaying an INPUTS log with FULL writes the log the server would have
+enum class MessageLogTier {
+    INPUTS,
+    FULL,
+};
 
 struct ServerConfig {
     const std::string applicationName;
@@ -16,27 +32,138 @@ struct ServerConfig {
     const int width;
     const int height;
     const std::uint32_t seed;
+    const int minFoodInArena;
+    const int foodSpawnFromBodySegmentProbability;
+    const int speedBoostProbability;
+    const float speedBoostRatio;
     const std::chrono::milliseconds movementFrequencyMs;
     const std::chrono::milliseconds boostedMovementFrequencyMs;
     const std::chrono::milliseconds boostDurationMs;
+    const std::size_t outboundQueueMaxBytes;
+    const OutboundOverflowPolicy outboundOverflowPolicy;
+    const int interestRadius;
+    const bool messageLogEnabled; // SNAKE_MESSAGE_LOG=0 turns off the .bin recording
+    const std::chrono::milliseconds checkpointIntervalMs; // between engine checkpoints in the log, 0 for none
+    const MessageLogWriter::Options messageLog;
+    const MessageLogTier messageLogTier;
 };
 
+// Integer setting from the environment, eg SNAKE_ARENA_WIDTH=200, or the default if unset. Anything
+// that isn't a whole number from min to max is rejected rather than read as whatever strtoll made of it
+template <typename T>
+inline T envOr(const char * name, const T defaultValue, const T min = std::numeric_limits<T>::lowest(),
+               const T max = std::numeric_limits<T>::max()) {
+    const char * value = std::getenv(name);
+    if (value == nullptr || value[0] == '\0') {
+        return defaultValue;
+    }
+    char * end {nullptr};
+    errno = 0;
+    const long long parsed {std::strtoll(value, &end, 10)};
+    if (*end != '\0' || errno == ERANGE || !std::in_range<T>(parsed) || static_cast<T>(parsed) < min ||
+        static_cast<T>(parsed) > max) {
+        throw std::invalid_argument(std::string {name} + " must be a whole number from " + std::to_string(min) +
+                                    " to " + std::to_string(max) + ", not " + value);
+    }
+    return static_cast<T>(parsed);
+}
+
+// SNAKE_MESSAGE_LOG_TIER=inputs or full, full if unset
+inline MessageLogTier messageLogTierFromEnv() {
+    const char * value = std::getenv("SNAKE_MESSAGE_LOG_TIER");
+    if (value == nullptr || value[0] == '\0' || std::string {value} == "full") {
+        return MessageLogTier::FULL;
+    }
+    if (std::string {value} == "inputs") {
+        return MessageLogTier::INPUTS;
+    }
+    throw std::invalid_argument(std::string {"SNAKE_MESSAGE_LOG_TIER must be inputs or full, not "} + value);
+}
+
+// food to keep in a width x height arena, at the density of the standard 40x40 one
+inline int scaledMinFoodInArena(const int width, const int height) {
+    return std::max(MIN_FOOD_IN_ARENA, static_cast<int>(static_cast<int64_t>(MIN_FOOD_IN_ARENA) * width * height /
+                                                        (ARENA_WIDTH * ARENA_HEIGHT)));
+}
+
+// A replay takes every gameplay setting from the recorded SERVER_CONFIG so the simulation is
+// rerun exactly. Otherwise the constants apply, each overridable through a SNAKE_ env var.
+// Room i of a multi-room server seeds its arena with SNAKE_SEED + i, so rooms never share one
 inline ServerConfig initServerConfig(const std::string & applicationName,
-                                     const std::optional<protocol::MessageVariant> & msg) {
-    std::uint32_t seed {std::random_device {}()};
+                                     const std::optional<protocol::MessageVariant> & msg, const int room = 0) {
+    const int port {envOr("SNAKE_SERVER_PORT", SERVER_PORT, 1, 65535)};
+    const std::size_t outboundQueueMaxBytes {
+        envOr("SNAKE_OUTBOUND_QUEUE_MAX_BYTES", SERVER_OUTBOUND_QUEUE_MAX_BYTES, std::size_t {1})};
+    const int interestRadius {envOr("SNAKE_INTEREST_RADIUS", GAME_STATE_INTEREST_RADIUS, 0)};
+    const bool messageLogEnabled {envOr("SNAKE_MESSAGE_LOG", 1, 0, 1) != 0};
+    const std::chrono::milliseconds checkpointIntervalMs {
+        envOr("SNAKE_CHECKPOINT_INTERVAL_MS", CHECKPOINT_INTERVAL_MS, 0)};
+    // SNAKE_MESSAGE_LOG_FSYNC_MS=0 syncs every block written, N syncs at most every N ms, unset leaves it to the OS
+    const int fsyncMs {envOr("SNAKE_MESSAGE_LOG_FSYNC_MS", -1, -1)};
+    const MessageLogWriter::Options messageLog {
+        .fsync = fsyncMs < 0 ? MessageLogFsync::NEVER
+                 : fsyncMs == 0 ? MessageLogFsync::EVERY_BLOCK
+                                : MessageLogFsync::INTERVAL,
+        .fsyncInterval = std::chrono::milliseconds {std::max(fsyncMs, 0)},
+        // SNAKE_MESSAGE_LOG_COMPRESS=0 writes the legacy uncompressed layout
+        .compressed = envOr("SNAKE_MESSAGE_LOG_COMPRESS", 1, 0, 1) != 0,
+    };
+    const MessageLogTier messageLogTier {messageLogTierFromEnv()};
+
     if (msg.has_value()) {
         assert(protocol::header(*msg).messageType == protocol::MessageType::SERVER_CONFIG &&
                "initServerConfig message must be type SERVER_CONFIG");
-        seed = std::get<protocol::ServerConfig>(*msg).seed;
+        const protocol::ServerConfig & recorded {std::get<protocol::ServerConfig>(*msg)};
+        return ServerConfig {
+            .applicationName = applicationName,
+            .port = port,
+            .width = recorded.width,
+            .height = recorded.height,
+            .seed = recorded.seed,
+            .minFoodInArena = recorded.minFoodInArena,
+            .foodSpawnFromBodySegmentProbability = recorded.foodSpawnFromBodySegmentProbability,
+            .speedBoostProbability = recorded.speedBoostProbability,
+            .speedBoostRatio = recorded.speedBoostRatio,
+            .movementFrequencyMs = std::chrono::milliseconds(recorded.movementFrequencyMs),
+            .boostedMovementFrequencyMs = std::chrono::milliseconds(recorded.boostedMovementFrequencyMs),
+            .boostDurationMs = std::chrono::milliseconds(recorded.boostDurationMs),
+            .outboundQueueMaxBytes = outboundQueueMaxBytes,
+            .outboundOverflowPolicy = OutboundOverflowPolicy::DROP_STALE_STATE,
+            .interestRadius = interestRadius,
+            .messageLogEnabled = messageLogEnabled,
+            .checkpointIntervalMs = checkpointIntervalMs,
+            .messageLog = messageLog,
+            .messageLogTier = messageLogTier,
+        };
     }
+
+    const int width {envOr("SNAKE_ARENA_WIDTH", ARENA_WIDTH, ARENA_MIN_SIDE, ARENA_MAX_SIDE)};
+    const int height {envOr("SNAKE_ARENA_HEIGHT", ARENA_HEIGHT, ARENA_MIN_SIDE, ARENA_MAX_SIDE)};
+    // at least 2 so a boosted snake still waits a millisecond between moves
+    const int movementFrequencyMs {envOr("SNAKE_MOVEMENT_FREQUENCY_MS", MOVEMENT_FREQUENCY_MS, 2)};
     return ServerConfig {
         .applicationName = applicationName,
-        .port = SERVER_PORT,
-        .width = ARENA_WIDTH,
-        .height = ARENA_HEIGHT,
-        .seed = seed,
-        .movementFrequencyMs = std::chrono::milliseconds(MOVEMENT_FREQUENCY_MS),
-        .boostedMovementFrequencyMs = std::chrono::milliseconds(BOOSTED_MOVEMENT_FREQUENCY_MS),
-        .boostDurationMs = std::chrono::milliseconds(SPEED_BOOST_DURATION_MS),
+        .port = port,
+        .width = width,
+        .height = height,
+        .seed = envOr("SNAKE_SEED", std::uint32_t {std::random_device {}()}) + static_cast<std::uint32_t>(room),
+        // food goes on the (width - 1) x (height - 1) cells off the top and left edges, up to half of them
+        .minFoodInArena = envOr("SNAKE_MIN_FOOD_IN_ARENA", scaledMinFoodInArena(width, height), 0,
+                                (width - 1) * (height - 1) / 2),
+        .foodSpawnFromBodySegmentProbability = FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY,
+        .speedBoostProbability = SPEED_BOOST_PROBABILITY,
+        .speedBoostRatio = SPEED_BOOST_RATIO,
+        .movementFrequencyMs = std::chrono::milliseconds(movementFrequencyMs),
+        .boostedMovementFrequencyMs = std::chrono::milliseconds(
+            static_cast<int>(static_cast<float>(movementFrequencyMs) * (1 / SPEED_BOOST_RATIO))),
+        .boostDurationMs =
+            std::chrono::milliseconds(envOr("SNAKE_SPEED_BOOST_DURATION_MS", SPEED_BOOST_DURATION_MS, 0)),
+        .outboundQueueMaxBytes = outboundQueueMaxBytes,
+        .outboundOverflowPolicy = OutboundOverflowPolicy::DROP_STALE_STATE,
+        .interestRadius = interestRadius,
+        .messageLogEnabled = messageLogEnabled,
+        .checkpointIntervalMs = checkpointIntervalMs,
+        .messageLog = messageLog,
+        .messageLogTier = messageLogTier,
     };
-};
\ No newline at end of file
+};
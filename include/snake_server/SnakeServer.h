@@ -1,21 +1,67 @@
 #pragma once
 
-#include "common/Hash.h"
+#include "common/CompactGameState.h"
+#include "common/MessageLogIndex.h"
 #include "common/MessageLogReader.h"
 #include "common/MessageLogWriter.h"
 #include "common/Timer.h"
+#include "snake_server/CountingEngine.h"
+#include "snake_server/DeadlineQueue.h"
+#include "snake_server/GameStateDiff.h"
+#include "snake_server/InterestGrid.h"
+#include "snake_server/ItemLayer.h"
 #include "snake_server/NetworkServer.h"
 #include "snake_server/Player.h"
+#include "snake_server/SendBufferPool.h"
 #include "snake_server/ServerConfig.h"
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <random>
 #include <unordered_map>
 #include <unordered_set>
 
 class SnakeServer {
 public:
-    SnakeServer(const ServerConfig &, std::optional<MessageLogReader> &&);
+    // totals over a run, also logged as the BENCH line when it ends
+    struct EngineStats {
+        int64_t ticks;
+        int64_t engineNs;
+        int64_t broadcasts;
+        int64_t stateBytes; // serialised full game states, ie what a keyframe to every client costs
+    };
+
+    // nanoseconds spent in each phase of one tick, only measured while a tick observer is set
+    struct TickPhases {
+        int64_t poll;
+        int64_t dispatch;
+        int64_t updateSnakes;
+        int64_t checkCollisions;
+        int64_t buildGameState;
+        int64_t serialise;
+    };
+    using TickObserver = std::function<void(const TickPhases &)>;
+
+    // with an inbox this is one room of several, and its clients come from a RoomAcceptor
+    SnakeServer(const ServerConfig &, std::optional<MessageLogReader> &&, std::shared_ptr<ClientInbox> = nullptr);
     void run();
+    // from any thread, eg on a signal: run() returns after the current tick and the message log is flushed
+    void stop();
+    const EngineStats & engineStats() const { return stats; }
+    void setTickObserver(TickObserver observer) { tickObserver = std::move(observer); }
+    // off for a synthetic recording, whose states only carry the clock
+    void setVerifyReplayedStates(const bool verify) { verifyingStates = verify; }
+    // replay on from a checkpoint read out of the recording, rather than from its start
+    void resumeFrom(protocol::EngineCheckpoint checkpoint) { resumeCheckpoint = std::move(checkpoint); }
+    // the sequence of the first state a replay got different from the recording, if any
+    std::optional<int64_t> replayDivergence() const { return firstDivergence; }
+    // a hash of everything the engine carries from one tick to the next, logged as STATE_HASH
+    uint64_t engineHash() const;
+    // whether the body occupancy grid, kept up to date move by move, matches a count from the bodies
+    bool occupancyMatchesBodies() const;
 
 private:
     void recordServerConfig();
@@ -26,10 +72,20 @@ private:
     void handleClientInput(const protocol::ClientInput &);
     void createNewPlayer(const protocol::ClientJoin &);
     bool updateSnakes();
+    std::optional<DeadlineQueue::TimePoint> nextDeadline() const;
     void moveSnake(const int);
-    void updateOccupiedCells(const int);
+    bool isInArena(const std::pair<int, int> &) const;
+    size_t cellIndex(const std::pair<int, int> &) const;
+    uint16_t & occupiedCell(const std::pair<int, int> &);
+    void occupyCell(const std::pair<int, int> &);
+    void vacateCell(const std::pair<int, int> &);
+    void vacatePlayerCells(const Player &);
     void checkCollisions();
-    std::vector<int> getPlayerHeadsInCell(const std::pair<int, int> &) const;
+    void indexPlayerHeads();
+    void clearPlayerHeads();
+    uint16_t headsInCell(const std::pair<int, int> &) const;
+    int firstHeadInCell(const std::pair<int, int> &) const;
+    bool arrivedFirst(const int, const int) const;
     void destroyPlayers(std::vector<int> &);
     void feedPlayer(std::pair<int, int> &, const int);
     void boostPlayer(std::pair<int, int> &, const int);
@@ -38,8 +94,36 @@ private:
     void placeFood(const int, const int, const Color color = Color::WHITE);
     void placeSpeedBoost();
     void broadcastGameState();
+    void sendInterestViews(const protocol::GameState &, const std::vector<int> & resyncs);
+    void broadcastLeaderboard(const protocol::GameState &, const std::vector<int> & newViewers);
+    void broadcastKeyframe(const protocol::GameState &, const std::shared_ptr<const Bytes> & fullBytes);
+    std::shared_ptr<const Bytes> serialiseKeyframe(int clientId, const protocol::GameState &);
+    protocol::StateEncoding chooseStateEncoding(const protocol::ClientJoin &) const;
     protocol::GameState buildGameState();
-    void logEngineBenchmark(const std::chrono::time_point<std::chrono::steady_clock> &, const int64_t &);
+    void logEngineBenchmark(const std::chrono::time_point<std::chrono::steady_clock> &);
+    bool isCheckpointDue() const;
+    void writeCheckpoint();
+    void restoreCheckpoint(const protocol::EngineCheckpoint &);
+    void logCheckpoint(const protocol::EngineCheckpoint &);
+    void verifyReplayedState(const protocol::GameState &, const std::string &);
+    void recordDivergence(int64_t sequence);
+    void startPhase();
+    void endPhase(int64_t TickPhases::*);
+
+    // into a pooled buffer, for a message that is only sent
+    template <typename T>
+    std::shared_ptr<const Bytes> serialiseForSending(const T & msg) {
+        std::shared_ptr<Bytes> buffer {sendBuffers.acquire()};
+        protocol::serialiseInto(msg, *buffer);
+        return buffer;
+    }
+
+    // as a GAME_STATE_COMPACT, for the clients welcomed with that encoding
+    std::shared_ptr<const Bytes> serialiseCompactForSending(const protocol::GameState & state) {
+        std::shared_ptr<Bytes> buffer {sendBuffers.acquire()};
+        protocol::serialiseCompactInto(state, *buffer);
+        return buffer;
+    }
 
     template <typename T>
     T stamped(T msg) {
@@ -66,16 +150,74 @@ private:
     std::chrono::milliseconds movementFrequencyMs;
     std::chrono::milliseconds boostedMovementFrequencyMs;
     std::chrono::milliseconds boostDurationMs;
+    int minFoodInArena;
+    int foodSpawnFromBodySegmentProbability;
+    int speedBoostProbability;
+    float speedBoostRatio;
+    std::shared_ptr<const Bytes> serverConfigBytes; // the recorded SERVER_CONFIG, sent on to every client that connects
     Timer timer;
     std::uint32_t seed;
-    std::mt19937 gen;
+    CountingEngine<std::mt19937> gen; // draws counted since the last checkpoint
     MessageLogWriter msgLogWriter;
+    Bytes logBuffer; // reused for each record that is logged and not sent
+    MessageLogIndexWriter msgLogIndexWriter;
+    MessageLogTier messageLogTier;
     std::pair<std::string, int> serverHighScore;
 
+    static constexpr MessageLogReader::TypeMask REPLAYED_TYPES {MessageLogReader::typeMask(
+        {protocol::MessageType::CLIENT_JOIN, protocol::MessageType::CLIENT_INPUT,
+         protocol::MessageType::CLIENT_DISCONNECT, protocol::MessageType::ENGINE_CHECKPOINT,
+         protocol::MessageType::GAME_STATE, protocol::MessageType::STATE_HASH})};
+    // all a client may send a room, anything else it sends is dropped before it reaches the log
+    static constexpr MessageLogReader::TypeMask CLIENT_TYPES {MessageLogReader::typeMask(
+        {protocol::MessageType::CLIENT_JOIN, protocol::MessageType::CLIENT_INPUT,
+         protocol::MessageType::CLIENT_DISCONNECT})};
     std::optional<MessageLogReader> replayFile;
+    std::vector<MessageLogReader::Record> replayBatch; // reused for every batch read from the recording
+
+    // a replay checks each state it produces against the recording's GAME_STATE or STATE_HASH
+    std::optional<MessageLogReader::Record> recordedState; // this tick's, a view into replayBatch
+    bool verifyingStates;
+    bool recordingHasStates;
+    int64_t statesVerified;
+    int64_t statesDiverged;
+    std::optional<int64_t> lastMatchingSequence;
+    std::optional<int64_t> lastRecordedCheckpoint;
+    std::optional<int64_t> firstDivergence;
     NetworkServer network;
+    SendBufferPool sendBuffers; // what is sent is serialised into these
     std::unordered_map<int, Player> clientIdToPlayerMap;
+    DeadlineQueue moveDeadlines;
+    DeadlineQueue boostExpiries;
     std::vector<uint16_t> occupiedCellsBodies;
-    std::unordered_map<std::pair<int, int>, Food, PairHash> foodMap;
-    std::unordered_map<std::pair<int, int>, SpeedBoost, PairHash> speedBoostMap;
+    std::vector<std::pair<int, int>> grownTailCells;
+    std::vector<uint16_t> occupiedCellsHeads; // only populated for the duration of checkCollisions
+    std::vector<int> firstHeadInCells;
+    ItemLayer<Food> foodLayer;
+    ItemLayer<SpeedBoost> speedBoostLayer;
+
+    // what clients were last sent, which the next GAME_STATE_DELTA is built against
+    std::optional<protocol::GameState> lastBroadcastState;
+    bool keyframeRequested;
+    int broadcastsSinceKeyframe;
+    std::unordered_set<int> compactStateClients; // welcomed with StateEncoding::COMPACT, sent GAME_STATE_COMPACT
+
+    // area of interest mode, each client is sent its own view of the arena and the leaderboard
+    int interestRadius;
+    InterestGrid interestGrid;
+    std::unordered_map<int, protocol::GameState> lastViews;
+    std::unordered_map<int, std::pair<int, int>> viewCentres; // where a client last had its head
+    std::vector<protocol::Leaderboard::Entry> lastLeaderboard;
+
+    // a replay writes a checkpoint wherever the recording has one, a live server every interval
+    std::chrono::milliseconds checkpointInterval;
+    std::chrono::time_point<std::chrono::steady_clock> lastCheckpointTime;
+    bool recordingHadCheckpoint;
+    std::optional<protocol::EngineCheckpoint> resumeCheckpoint;
+
+    EngineStats stats;
+    TickObserver tickObserver;
+    TickPhases tickPhases;
+    std::chrono::time_point<std::chrono::steady_clock> phaseStart;
+    std::atomic<bool> stopRequested;
 };
\ No newline at end of file
@@ -1,14 +1,14 @@
 #include "snake_bot/SnakeBot.h"
 #include <cstddef>
 
-SnakeBot::SnakeBot(const int width, const int height)
+SnakeBot::SnakeBot()
     : awaitingJoin {false},
       gameStateHasChanged {true},
       clientId {-1},
       gen {std::random_device {}()},
-      network(getServerIp(), getServerPort()),
+      network(getServerIp(), getServerPort(), getServerRoom()),
       gameState {},
-      pathfinder {width, height} {}
+      pathfinder {} {}
 
 void SnakeBot::run() {
     while (true) {
@@ -39,47 +39,48 @@ void SnakeBot::joinGame() {
     }
     spdlog::info("Sending join game request as " + std::string(username, 3));
 
-    protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN, clientId}, {}};
+    protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN, clientId}, {},
+                               protocol::encodingBit(protocol::StateEncoding::COMPACT)};
     std::strncpy(join.username, username, sizeof(join.username) - 1);
     network.sendToServer({protocol::serialise(join)});
     spdlog::info("Sent join game request for " + std::string(username, 3));
 }
 
 void SnakeBot::receiveUpdates() {
-    std::vector<Bytes> messages {network.receiveFromServer()};
-    std::optional<protocol::GameState> latestGameState;
+    const bool gameStateUpdated {
+        client::applyFrames(gameState, network.receiveFromServer(), [this](const protocol::MessageVariant & msg) {
+            if (const auto * config = std::get_if<protocol::ServerConfig>(&msg)) {
+                handleServerConfig(*config);
+            } else if (const auto * welcome = std::get_if<protocol::ServerWelcome>(&msg)) {
+                handleServerWelcome(*welcome);
+            } else if (std::holds_alternative<protocol::Leaderboard>(msg)) {
+                // bots only play what they can see
+            } else {
+                throw std::runtime_error("Invalid protocol::MessageType");
+            }
+        })};
 
-    for (auto & msgBytes : messages) {
-        protocol::MessageVariant msg {protocol::deserialise(msgBytes)};
-        switch (protocol::header(msg).messageType) {
-        case protocol::MessageType::SERVER_WELCOME:
-            handleServerWelcome(std::get<protocol::ServerWelcome>(msg));
-            break;
-        case protocol::MessageType::GAME_STATE:
-            latestGameState = std::move(std::get<protocol::GameState>(msg));
-            gameStateHasChanged = true;
-            break;
-        default:
-            throw std::runtime_error("Invalid protocol::MessageType");
-        }
+    if (gameStateUpdated) {
+        gameStateHasChanged = true;
+        handleGameStateUpdate();
     }
+}
 
-    // We only process the latest GAME_STATE message, to avoid
-    // getting behind on the client side when all we care about
-    // is the latest GAME_STATE anyway
-    if (latestGameState) {
-        handleGameStateMessage(latestGameState.value());
+void SnakeBot::handleServerConfig(const protocol::ServerConfig & msg) {
+    if (!pathfinder) {
+        spdlog::info("Arena is {}x{}", msg.width, msg.height);
+        pathfinder.emplace(msg.width, msg.height);
     }
 }
 
 void SnakeBot::handleServerWelcome(const protocol::ServerWelcome & msg) {
-    spdlog::info("Received server welcome for clientId=" + std::to_string(msg.hdr.clientId));
+    spdlog::info("Received server welcome for clientId=" + std::to_string(msg.hdr.clientId) +
+                 (msg.stateEncoding == protocol::StateEncoding::COMPACT ? ", compact keyframes" : ""));
     clientId = msg.hdr.clientId;
     awaitingJoin = false;
 }
 
-void SnakeBot::handleGameStateMessage(const protocol::GameState & msg) {
-    gameState = client::fromProtocol(msg);
+void SnakeBot::handleGameStateUpdate() {
     if (clientId != -1 && !gameState.players.contains(clientId)) {
         // this means that we just died
         clientId = -1;
@@ -88,11 +89,13 @@ void SnakeBot::handleGameStateMessage(const protocol::GameState & msg) {
 }
 
 void SnakeBot::buildArenaMap() {
-    pathfinder.rebuildMap(gameState);
+    if (pathfinder) {
+        pathfinder->rebuildMap(gameState);
+    }
 }
 
 void SnakeBot::sendInput() {
-    if (gameState.players.contains(clientId)) {
+    if (pathfinder && gameState.players.contains(clientId)) {
         // char input {calculateRandomMove()};
         const char input {calculatePathingMove()};
         network.sendToServer(
@@ -107,5 +110,5 @@ char SnakeBot::calculateRandomMove() {
 }
 
 char SnakeBot::calculatePathingMove() const {
-    return pathfinder.calculateNextMove(clientId, gameState);
+    return pathfinder->calculateNextMove(clientId, gameState);
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "snake_client/NetworkClient.h"
 #include "common/Log.h"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <cerrno>
 #include <cstring>
@@ -9,9 +10,18 @@
 #include <stdexcept>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <variant>
 
-NetworkClient::NetworkClient(const std::string & host, int port) : serverFd {-1}, messageBuffer {} {
+NetworkClient::NetworkClient(const std::string & host, int port, std::optional<int32_t> room)
+    : serverFd {-1},
+      maxMessageSize {CLIENT_RECV_MAX_MESSAGE_SIZE},
+      messageBuffer {maxMessageSize, CLIENT_RECV_BUFFER_SIZE} {
     connectToServer(host, port);
+    // has to be the first thing on the connection, the server places us on our first message
+    if (room) {
+        sendToServer(protocol::serialise(
+            protocol::ClientRoomRequest {{protocol::MessageType::CLIENT_ROOM_REQUEST, -1}, *room}));
+    }
 }
 
 NetworkClient::~NetworkClient() {
@@ -74,44 +84,34 @@ void NetworkClient::sendToServer(const Bytes & bytes) {
     }
 }
 
-std::vector<Bytes> NetworkClient::receiveFromServer() {
-    ssize_t bytesRead = recv(serverFd, recvBuffer, sizeof(recvBuffer), 0);
-
-    if (bytesRead < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return {};
-        }
+std::vector<std::string_view> NetworkClient::receiveFromServer() {
+    switch (messageBuffer.fill(serverFd)) {
+    case FrameBuffer::FillResult::ERROR:
         throw std::runtime_error(fmt::format("Error on recv from server, errno {}", errno));
-    }
-
-    if (bytesRead == 0) {
+    case FrameBuffer::FillResult::CLOSED:
         throw std::runtime_error(fmt::format("Server disconnected, exiting"));
+    case FrameBuffer::FillResult::DRAINED:
+    case FrameBuffer::FillResult::FULL:
+        break;
     }
 
-    return parseReceivedPacket(recvBuffer, static_cast<size_t>(bytesRead));
-}
-
-std::vector<Bytes> NetworkClient::parseReceivedPacket(char * inputBuffer, size_t size) {
-    std::vector<Bytes> frames {};
-    messageBuffer += Bytes(inputBuffer, size);
-
-    uint32_t len;
-    while (messageBuffer.size() >= sizeof(len)) {
-        memcpy(&len, messageBuffer.data(), sizeof(len));
-
-        // no legit message should be bigger than this - it means we have desynced
-        if (len > CLIENT_RECV_MAX_MESSAGE_SIZE) {
-            throw std::runtime_error(
-                fmt::format("Received message of size {}, which is bigger than maximum allowed {}. Aborting", len,
-                            CLIENT_RECV_MAX_MESSAGE_SIZE));
+    std::vector<std::string_view> frames {};
+    while (std::optional<std::string_view> frame {messageBuffer.next()}) {
+        frames.push_back(*frame);
+        // the arena sets how big a keyframe can get, and its config comes before the first one,
+        // maybe in this same read
+        if (protocol::peekMessageType(*frame) == protocol::MessageType::SERVER_CONFIG) {
+            const auto config {std::get<protocol::ServerConfig>(protocol::deserialise(*frame))};
+            maxMessageSize =
+                std::max(CLIENT_RECV_MAX_MESSAGE_SIZE, protocol::maxGameStateSize(config.width, config.height));
+            messageBuffer.setMaxFrameSize(maxMessageSize);
         }
+    }
 
-        // full frame not here yet - wait
-        if (messageBuffer.size() < sizeof(len) + len) {
-            break;
-        }
-        frames.push_back(messageBuffer.substr(sizeof(len), len));
-        messageBuffer.erase(0, sizeof(len) + len);
+    // no legit message should be bigger than this - it means we have desynced
+    if (const std::optional<uint32_t> len {messageBuffer.oversizedFrame()}) {
+        throw std::runtime_error(fmt::format(
+            "Received message of size {}, which is bigger than maximum allowed {}. Aborting", *len, maxMessageSize));
     }
     return frames;
 }
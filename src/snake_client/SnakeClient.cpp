@@ -1,20 +1,25 @@
 #include "snake_client/SnakeClient.h"
 #include "common/Constants.h"
 #include "common/Protocol.h"
+#include <algorithm>
 #include <cstdlib>
 #include <locale.h>
 #include <ncurses.h>
 
-SnakeClient::SnakeClient(int width_, int height_)
-    : width {width_},
-      height {height_},
+SnakeClient::SnakeClient()
+    : width {0},
+      height {0},
+      viewWidth {0},
+      viewHeight {0},
+      viewOrigin {1, 1},
       running {true},
       playing {false},
       timer {},
-      network(getServerIp(), getServerPort()),
+      network(getServerIp(), getServerPort(), getServerRoom()),
       clientId(-1),
       playerInput('\0'),
-      gameState {} {}
+      gameState {},
+      leaderboard {} {}
 
 SnakeClient::~SnakeClient() {
     cleanupNcurses();
@@ -40,7 +45,8 @@ void SnakeClient::joinGame() {
     if (!username) {
         username = "unknown";
     }
-    protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN, clientId}, {}};
+    protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN, clientId}, {},
+                               protocol::encodingBit(protocol::StateEncoding::COMPACT)};
     std::strncpy(join.username, username, sizeof(join.username) - 1);
     network.sendToServer({protocol::serialise(join)});
 }
@@ -72,29 +78,30 @@ void SnakeClient::sendPlayerInput() {
 }
 
 void SnakeClient::receiveUpdates() {
-    std::vector<Bytes> messages {network.receiveFromServer()};
-    std::optional<protocol::GameState> latestGameState;
-
-    for (auto & msgBytes : messages) {
-        protocol::MessageVariant msg {protocol::deserialise(msgBytes)};
-        switch (protocol::header(msg).messageType) {
-        case protocol::MessageType::SERVER_WELCOME:
-            handleServerWelcome(std::get<protocol::ServerWelcome>(msg));
-            break;
-        case protocol::MessageType::GAME_STATE:
-            latestGameState = std::move(std::get<protocol::GameState>(msg));
-            break;
-        default:
-            throw std::runtime_error("Invalid protocol::MessageType");
-        }
+    const bool gameStateUpdated {
+        client::applyFrames(gameState, network.receiveFromServer(), [this](const protocol::MessageVariant & msg) {
+            if (const auto * config = std::get_if<protocol::ServerConfig>(&msg)) {
+                handleServerConfig(*config);
+            } else if (const auto * welcome = std::get_if<protocol::ServerWelcome>(&msg)) {
+                handleServerWelcome(*welcome);
+            } else if (const auto * board = std::get_if<protocol::Leaderboard>(&msg)) {
+                leaderboard = client::fromProtocol(*board);
+            } else {
+                throw std::runtime_error("Invalid protocol::MessageType");
+            }
+        })};
+
+    if (gameStateUpdated) {
+        handleGameStateUpdate();
     }
+}
 
-    // We only process the latest GAME_STATE message, to avoid
-    // getting behind on the client side when all we care about
-    // is the latest GAME_STATE anyway
-    if (latestGameState) {
-        handleGameStateMessage(latestGameState.value());
-    }
+// sent ahead of every SERVER_WELCOME, the arena can be any size the server was started with
+void SnakeClient::handleServerConfig(const protocol::ServerConfig & msg) {
+    width = msg.width;
+    height = msg.height;
+    viewWidth = std::min(width, CLIENT_VIEWPORT_WIDTH);
+    viewHeight = std::min(height, CLIENT_VIEWPORT_HEIGHT);
 }
 
 void SnakeClient::handleServerWelcome(const protocol::ServerWelcome & msg) {
@@ -102,8 +109,7 @@ void SnakeClient::handleServerWelcome(const protocol::ServerWelcome & msg) {
     playing = true;
 }
 
-void SnakeClient::handleGameStateMessage(const protocol::GameState & msg) {
-    gameState = client::fromProtocol(msg);
+void SnakeClient::handleGameStateUpdate() {
     if (!gameState.players.contains(clientId)) {
         playing = false;
         clientId = -1;
@@ -111,7 +117,11 @@ void SnakeClient::handleGameStateMessage(const protocol::GameState & msg) {
 }
 
 void SnakeClient::render() {
+    if (width == 0) {
+        return;
+    }
     erase();
+    updateViewport();
     renderArena();
     renderObjects();
     renderPlayers();
@@ -119,60 +129,73 @@ void SnakeClient::render() {
     refresh();
 }
 
+void SnakeClient::updateViewport() {
+    // keep our head in the middle of the window, without scrolling past the edge of the arena
+    if (auto it {gameState.players.find(clientId)}; it != gameState.players.end() && !it->second.segments.empty()) {
+        const auto & [x, y] {it->second.segments.front()};
+        viewOrigin = {std::clamp(x - viewWidth / 2, 1, width - viewWidth + 1),
+                      std::clamp(y - viewHeight / 2, 1, height - viewHeight + 1)};
+    }
+}
+
 void SnakeClient::renderArena() {
     // top and bottom boundary
-    for (int x = 1; x <= width; x++) {
+    for (int x = 1; x <= viewWidth; x++) {
         renderCharToScreen(x, 0, '-');
-        renderCharToScreen(x, height + 1, '-');
+        renderCharToScreen(x, viewHeight + 1, '-');
     }
 
     // left and right boundary
-    for (int y = 1; y <= height; y++) {
+    for (int y = 1; y <= viewHeight; y++) {
         renderCharToScreen(0, y, '|');
-        renderCharToScreen(width + 1, y, '|');
+        renderCharToScreen(viewWidth + 1, y, '|');
     }
 
     // corners
     renderCharToScreen(0, 0, '+');
-    renderCharToScreen(width + 1, 0, '+');
-    renderCharToScreen(0, height + 1, '+');
-    renderCharToScreen(width + 1, height + 1, '+');
+    renderCharToScreen(viewWidth + 1, 0, '+');
+    renderCharToScreen(0, viewHeight + 1, '+');
+    renderCharToScreen(viewWidth + 1, viewHeight + 1, '+');
 }
 
 void SnakeClient::renderPlayers() {
     for (auto & [id, p] : gameState.players) {
-        renderCharToScreen(p.segments[0].first, p.segments[0].second, p.direction);
+        renderCellToScreen(p.segments[0].first, p.segments[0].second, p.direction);
         for (auto it = p.segments.begin() + 1; it < p.segments.end(); it++) {
-            renderCharToScreen(it->first, it->second, 'c', p.color);
+            renderCellToScreen(it->first, it->second, 'c', p.color);
         }
     }
 }
 
 void SnakeClient::renderObjects() {
     for (auto & f : gameState.food) {
-        renderCharToScreen(f.x, f.y, f.icon, f.color);
+        renderCellToScreen(f.x, f.y, f.icon, f.color);
     }
     for (auto & s : gameState.speedBoosts) {
-        renderCharToScreen(s.x, s.y, s.icon, s.color);
+        renderCellToScreen(s.x, s.y, s.icon, s.color);
     }
 }
 
 void SnakeClient::renderScore() {
-    mvprintw(height + 2, 0, "Press 'q' to quit");
-    mvprintw(height + 3, 0, "Press 'r' to reload");
+    mvprintw(viewHeight + 2, 0, "Press 'q' to quit");
+    mvprintw(viewHeight + 3, 0, "Press 'r' to reload");
     std::string serverHighScore {"Server high score is " + gameState.serverHighScore.first + ": " +
                                  std::to_string(gameState.serverHighScore.second)};
-    mvprintw(height + 4, 0, "%s", serverHighScore.c_str());
-    std::vector<client::PlayerData> sortedPlayers {};
-    for (auto & [id, p] : gameState.players) {
-        sortedPlayers.push_back(p);
-    }
+    mvprintw(viewHeight + 4, 0, "%s", serverHighScore.c_str());
+
+    // the server's leaderboard covers the whole arena, whereas we may only be sent the players near us
+    std::vector<client::LeaderboardEntry> sortedPlayers {leaderboard};
+    if (sortedPlayers.empty()) {
+        for (auto & [id, p] : gameState.players) {
+            sortedPlayers.push_back({id, p.name, p.score, p.color});
+        }
 
-    // Sort by score descending
-    std::sort(sortedPlayers.begin(), sortedPlayers.end(),
-              [](const auto & l, const auto & r) { return l.score > r.score; });
+        // Sort by score descending
+        std::sort(sortedPlayers.begin(), sortedPlayers.end(),
+                  [](const auto & l, const auto & r) { return l.score > r.score; });
+    }
 
-    int row = height + 6;
+    int row = viewHeight + 6;
     mvprintw(row++, 0, "+----------- SCOREBOARD -----------+");
 
     int playersPrintedToScoreboard {0};
@@ -190,6 +213,14 @@ void SnakeClient::renderScore() {
     mvprintw(row, 0, "+----------------------------------+");
 }
 
+void SnakeClient::renderCellToScreen(const int x, const int y, const char & character, const int color) {
+    const int column {x - viewOrigin.first + 1};
+    const int row {y - viewOrigin.second + 1};
+    if (1 <= column && column <= viewWidth && 1 <= row && row <= viewHeight) {
+        renderCharToScreen(column, row, character, color);
+    }
+}
+
 void SnakeClient::renderCharToScreen(const int x, const int y, const char & character, const int color) {
     mvaddch(y, x * CLIENT_HORIZONTAL_SCALING,
             static_cast<chtype>(static_cast<unsigned char>(character)) | COLOR_PAIR(color));
@@ -1,10 +1,9 @@
-#include "common/Constants.h"
 #include "common/Log.h"
 #include "snake_client/SnakeClient.h"
 
 int main() {
     initLogging("snake_client", true, false);
-    SnakeClient client {ARENA_WIDTH, ARENA_HEIGHT};
+    SnakeClient client {};
     client.run();
     return 0;
 }
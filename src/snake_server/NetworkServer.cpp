@@ -1,6 +1,7 @@
 #include "snake_server/NetworkServer.h"
 #include "common/Constants.h"
 #include "common/Log.h"
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstring>
@@ -8,18 +9,59 @@
 #include <netinet/in.h>
 #include <stdexcept>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
-NetworkServer::NetworkServer(int port)
+NetworkServer::NetworkServer(int port, const std::size_t queueMaxBytes, const OutboundOverflowPolicy overflowPolicy,
+                             std::shared_ptr<ClientInbox> clientInbox)
     : serverFd {-1},
       epollFd {-1},
+      timerFd {-1},
+      wakeFd {-1},
+      armedWakeup {},
       nextClientId {1},
+      outboundQueueMaxBytes {queueMaxBytes},
+      outboundOverflowPolicy {overflowPolicy},
       fdToClientIdMap {},
       clientIdToFdMap {},
       fdToBufferMap {},
-      fdsToDisconnect {} {
-    startServer(port);
+      fdToOutboundMap {},
+      fdsAwaitingWritable {},
+      fdsToDisconnect {},
+      fdsToResync {},
+      droppedFrames {0},
+      droppedBytes {0},
+      overflowDisconnects {0},
+      previousStatsLog {std::chrono::steady_clock::now()},
+      inbox {std::move(clientInbox)},
+      greeting {} {
+    if (inbox) {
+        startRoom();
+    } else {
+        startServer(port);
+    }
+    startWakeupTimer();
+    startWakeupEvent();
+}
+
+NetworkServer::~NetworkServer() {
+    for (auto & [fd, clientId] : fdToClientIdMap) {
+        close(fd);
+    }
+    if (serverFd != -1) {
+        close(serverFd);
+    }
+    if (timerFd != -1) {
+        close(timerFd);
+    }
+    if (wakeFd != -1) {
+        close(wakeFd);
+    }
+    if (epollFd != -1) {
+        close(epollFd);
+    }
 }
 
 void NetworkServer::startServer(int port) {
@@ -65,21 +107,93 @@ void NetworkServer::startServer(int port) {
     spdlog::info("Server listening on port " + std::to_string(port));
 }
 
-std::vector<std::pair<int, Bytes>> NetworkServer::pollMessages() {
-    assert(fdsToDisconnect.empty() && "fds awaiting destruction at start of fresh pollMessages loop");
+void NetworkServer::startRoom() {
+    // no listening socket, a RoomAcceptor accepts for us and hands clients over through the inbox
+    epollFd = epoll_create1(0);
+    if (epollFd == -1) {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+    spdlog::info("epollFd=" + std::to_string(epollFd));
+    registerFdWithEpoll(inbox->eventFd());
+}
+
+void NetworkServer::startWakeupTimer() {
+    // steady_clock is CLOCK_MONOTONIC, so engine deadlines can be used as absolute expiry times
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd == -1) {
+        throw std::runtime_error("Failed to create wakeup timerfd");
+    }
+    registerFdWithEpoll(timerFd);
+}
+
+void NetworkServer::startWakeupEvent() {
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd == -1) {
+        throw std::runtime_error("Failed to create wakeup eventfd");
+    }
+    registerFdWithEpoll(wakeFd);
+}
 
-    std::vector<std::pair<int, Bytes>> messages;
+void NetworkServer::wake() {
+    const uint64_t one {1};
+    [[maybe_unused]] ssize_t written {write(wakeFd, &one, sizeof(one))};
+}
+
+void NetworkServer::armWakeupTimer(const std::optional<std::chrono::steady_clock::time_point> wakeAt) {
+    if (wakeAt == armedWakeup) {
+        return;
+    }
+    // an all zero itimerspec disarms, and a deadline already passed fires straight away
+    itimerspec spec {};
+    if (wakeAt) {
+        const int64_t ns {std::max<int64_t>(
+            1, std::chrono::duration_cast<std::chrono::nanoseconds>(wakeAt->time_since_epoch()).count())};
+        spec.it_value.tv_sec = ns / 1'000'000'000;
+        spec.it_value.tv_nsec = ns % 1'000'000'000;
+    }
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        throw std::runtime_error("Failed to arm wakeup timerfd");
+    }
+    armedWakeup = wakeAt;
+}
+
+std::vector<std::pair<int, std::string_view>>
+NetworkServer::pollMessages(const std::optional<std::chrono::steady_clock::time_point> wakeAt) {
+    // sends after the last drainDisconnects can leave fds in fdsToDisconnect here, they are
+    // skipped for sending and get drained after this poll
+    logOutboundStats();
+    armWakeupTimer(wakeAt);
+
+    std::vector<std::pair<int, std::string_view>> messages;
     epoll_event events[MAX_EVENTS];
-    int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, EPOLL_BLOCKING_TIMEOUT_MS);
+    int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, -1);
 
     for (int i = 0; i < numEvents; i++) {
         int fd {events[i].data.fd};
         if (fd == serverFd) {
             acceptNewClient();
-        } else {
-            for (Bytes bytes : receiveFromClient(fd)) {
-                messages.push_back({fdToClientIdMap.at(fd), bytes});
-            }
+            continue;
+        }
+        if (fd == timerFd) {
+            uint64_t expirations;
+            [[maybe_unused]] ssize_t readCount {read(timerFd, &expirations, sizeof(expirations))};
+            armedWakeup.reset();
+            continue;
+        }
+        if (fd == wakeFd) {
+            uint64_t count;
+            [[maybe_unused]] ssize_t readCount {read(wakeFd, &count, sizeof(count))};
+            continue;
+        }
+        if (inbox && fd == inbox->eventFd()) {
+            adoptClients(messages);
+            continue;
+        }
+        if (events[i].events & EPOLLOUT) {
+            flushOutbound(fd);
+        }
+        if (events[i].events & ~EPOLLOUT) {
+            receiveFromClient(fd, messages);
         }
     }
     return messages;
@@ -97,6 +211,17 @@ std::vector<int> NetworkServer::drainDisconnects() {
     return clientIds;
 }
 
+std::vector<int> NetworkServer::drainResyncs() {
+    std::vector<int> clientIds;
+    for (int fd : fdsToResync) {
+        if (fdToClientIdMap.contains(fd)) {
+            clientIds.push_back(fdToClientIdMap.at(fd));
+        }
+    }
+    fdsToResync.clear();
+    return clientIds;
+}
+
 void NetworkServer::setNonBlocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
@@ -129,14 +254,32 @@ void NetworkServer::acceptNewClient() {
     } else {
         setNonBlocking(clientFd);
         registerFdWithEpoll(clientFd);
+        addClient(clientFd);
+    }
+}
 
-        int clientId = nextClientId++;
-        fdToClientIdMap[clientFd] = clientId;
-        clientIdToFdMap[clientId] = clientFd;
-        fdToBufferMap[clientFd] = "";
+void NetworkServer::adoptClients(std::vector<std::pair<int, std::string_view>> & messages) {
+    for (auto & [clientFd, received] : inbox->take()) {
+        registerFdWithEpoll(clientFd);
+        addClient(clientFd);
+        // the acceptor has already read the join, and possibly more, off the socket
+        fdToBufferMap.at(clientFd).append(received);
+        takeFrames(clientFd, messages);
+    }
+}
 
-        spdlog::info("Client " + std::to_string(clientId) + " connected (fd: " + std::to_string(clientFd) + ")");
+int NetworkServer::addClient(const int clientFd) {
+    int clientId = nextClientId++;
+    fdToClientIdMap[clientFd] = clientId;
+    clientIdToFdMap[clientId] = clientFd;
+    fdToBufferMap.try_emplace(clientFd, SERVER_RECV_MAX_MESSAGE_SIZE, SERVER_RECV_BUFFER_SIZE);
+    fdToOutboundMap[clientFd] = {};
+    if (greeting) {
+        networkSend(clientFd, greeting);
     }
+
+    spdlog::info("Client " + std::to_string(clientId) + " connected (fd: " + std::to_string(clientFd) + ")");
+    return clientId;
 }
 
 void NetworkServer::disconnectClient(const int fd) {
@@ -149,83 +292,158 @@ void NetworkServer::disconnectClient(const int fd) {
     clientIdToFdMap.erase(fdToClientIdMap.at(fd));
     fdToClientIdMap.erase(fd);
     fdToBufferMap.erase(fd);
+    fdToOutboundMap.erase(fd);
+    fdsAwaitingWritable.erase(fd);
+    fdsToResync.erase(fd);
+    if (inbox) {
+        inbox->connections--;
+    }
 }
 
-std::vector<Bytes> NetworkServer::receiveFromClient(int fd) {
-    ssize_t bytesRead = recv(fd, recvBuffer, sizeof(recvBuffer), 0);
+// drains the socket, so one readiness event takes everything the client has sent so far
+void NetworkServer::receiveFromClient(int fd, std::vector<std::pair<int, std::string_view>> & messages) {
+    const FrameBuffer::FillResult result {fdToBufferMap.at(fd).fill(fd)};
+    if (result == FrameBuffer::FillResult::ERROR) {
+        spdlog::warn("Retrieved errno {} on recv from fd={}", errno, fd);
+        fdsToDisconnect.insert(fd);
+        return;
+    }
+    // whatever arrived before the client hung up is still played
+    takeFrames(fd, messages);
+    if (result == FrameBuffer::FillResult::CLOSED) {
+        fdsToDisconnect.insert(fd);
+    }
+}
 
-    if (bytesRead < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return {};
-        } else {
-            spdlog::warn("Retrieved errno {} on recv from fd={}", errno, fd);
-            fdsToDisconnect.insert(fd);
-            return {};
-        };
-    } else if (bytesRead == 0) {
+void NetworkServer::takeFrames(int fd, std::vector<std::pair<int, std::string_view>> & messages) {
+    FrameBuffer & buffer {fdToBufferMap.at(fd)};
+    const int clientId {fdToClientIdMap.at(fd)};
+    while (std::optional<std::string_view> frame {buffer.next()}) {
+        messages.push_back({clientId, *frame});
+    }
+
+    // DDOS protection - no legit message should be bigger than this
+    if (const std::optional<uint32_t> len {buffer.oversizedFrame()}) {
+        spdlog::error(
+            "Received message of size {}, which is bigger than maximum allowed {}. Disconnecting client fd={}", *len,
+            SERVER_RECV_MAX_MESSAGE_SIZE, fd);
         fdsToDisconnect.insert(fd);
-        return {};
     }
+}
+
+void NetworkServer::sendToClient(const int clientId, std::shared_ptr<const Bytes> bytes) {
+    networkSend(clientIdToFdMap.at(clientId), bytes);
+}
 
-    return parseReceivedPacket(fd, recvBuffer, static_cast<size_t>(bytesRead));
+void NetworkServer::broadcast(const std::shared_ptr<const Bytes> & bytes) {
+    // one buffer, referenced from the queue of every client that can't take it straight away
+    for (const auto & [fd, clientId] : fdToClientIdMap) {
+        networkSend(fd, bytes);
+    }
 }
 
-std::vector<Bytes> NetworkServer::parseReceivedPacket(int fd, char * inputBuffer, size_t size) {
-    std::vector<Bytes> frames {};
-    Bytes & fdBuffer {fdToBufferMap[fd]};
-    fdBuffer += Bytes(inputBuffer, size);
+void NetworkServer::setGreeting(std::shared_ptr<const Bytes> bytes) {
+    greeting = std::move(bytes);
+}
 
-    uint32_t len;
-    while (fdBuffer.size() >= sizeof(len)) {
-        memcpy(&len, fdBuffer.data(), sizeof(len));
+void NetworkServer::networkSend(const int fd, const std::shared_ptr<const Bytes> & bytes) {
+    if (fdsToDisconnect.contains(fd)) {
+        return;
+    }
 
-        // DDOS protection - no legit message should be bigger than this
-        if (len > SERVER_RECV_MAX_MESSAGE_SIZE) {
-            spdlog::error(
-                "Received message of size {}, which is bigger than maximum allowed {}. Disconnecting client fd={}", len,
-                SERVER_RECV_MAX_MESSAGE_SIZE, fd);
+    OutboundQueue & queue {fdToOutboundMap.at(fd)};
+    const std::size_t frameSize {sizeof(uint32_t) + bytes->size()};
+    if (queue.bytes() + frameSize > outboundQueueMaxBytes) {
+        if (outboundOverflowPolicy == OutboundOverflowPolicy::DROP_STALE_STATE) {
+            const std::size_t queuedBefore {queue.bytes()};
+            const std::size_t dropped {queue.dropStaleState()};
+            if (dropped > 0) {
+                droppedFrames += dropped;
+                droppedBytes += queuedBefore - queue.bytes();
+                // the client is missing states, so whatever deltas follow are useless to it
+                fdsToResync.insert(fd);
+            }
+        }
+        if (queue.bytes() + frameSize > outboundQueueMaxBytes) {
+            spdlog::warn("Outbound queue for fd={} is full at {} bytes, disconnecting the client", fd, queue.bytes());
+            overflowDisconnects++;
             fdsToDisconnect.insert(fd);
-            return frames;
+            return;
         }
+    }
 
-        // full frame not here yet - wait
-        if (fdBuffer.size() < sizeof(len) + len) {
-            break;
-        }
+    // if anything is already queued the socket is backed up, so leave the new frame for EPOLLOUT
+    const bool wasEmpty {queue.empty()};
+    queue.push(bytes);
+    if (wasEmpty) {
+        flushOutbound(fd);
+    }
+}
 
-        frames.push_back(fdBuffer.substr(sizeof(len), len));
-        fdBuffer.erase(0, sizeof(len) + len);
+void NetworkServer::flushOutbound(const int fd) {
+    if (fdsToDisconnect.contains(fd)) {
+        return;
+    }
+    switch (fdToOutboundMap.at(fd).flush(fd)) {
+    case OutboundQueue::FlushResult::DRAINED:
+        setWriteInterest(fd, false);
+        break;
+    case OutboundQueue::FlushResult::PENDING:
+        setWriteInterest(fd, true);
+        break;
+    case OutboundQueue::FlushResult::ERROR:
+        spdlog::warn("Error receieved {} on send for fd={}, disconnecting the client", errno, fd);
+        fdsToDisconnect.insert(fd);
+        break;
     }
-    return frames;
 }
 
-void NetworkServer::sendToClient(const int clientId, const Bytes & bytes) {
-    networkSend(clientIdToFdMap.at(clientId), bytes);
+void NetworkServer::setWriteInterest(const int fd, const bool enabled) {
+    if (fdsAwaitingWritable.contains(fd) == enabled) {
+        return;
+    }
+    epoll_event event;
+    event.events = enabled ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        spdlog::warn("Error receieved {} on epoll_ctl for fd={}, disconnecting the client", errno, fd);
+        fdsToDisconnect.insert(fd);
+        return;
+    }
+    if (enabled) {
+        fdsAwaitingWritable.insert(fd);
+    } else {
+        fdsAwaitingWritable.erase(fd);
+    }
 }
 
-void NetworkServer::broadcast(const Bytes & bytes) {
-    for (const auto & [fd, clientId] : fdToClientIdMap) {
-        networkSend(fd, bytes);
+std::vector<int> NetworkServer::clientIds() const {
+    std::vector<int> ids {};
+    ids.reserve(clientIdToFdMap.size());
+    for (const auto & [clientId, fd] : clientIdToFdMap) {
+        ids.push_back(clientId);
     }
+    return ids;
 }
 
-void NetworkServer::networkSend(const int fd, const Bytes & bytes) {
-    uint32_t len {static_cast<uint32_t>(bytes.size())};
-    Bytes frame {};
-    frame.reserve(sizeof(len) + bytes.size());
-    frame.append(reinterpret_cast<const char *>(&len), sizeof(len));
-    frame += bytes;
-    ssize_t sent {send(fd, frame.data(), frame.size(), 0)};
+NetworkServer::OutboundStats NetworkServer::outboundStats() const {
+    OutboundStats stats {0, 0, 0, droppedFrames, droppedBytes, overflowDisconnects};
+    for (const auto & [fd, queue] : fdToOutboundMap) {
+        stats.queuedBytes += queue.bytes();
+        stats.queuedFrames += queue.frames();
+        stats.deepestQueueBytes = std::max(stats.deepestQueueBytes, queue.bytes());
+    }
+    return stats;
+}
 
-    // treat partial sends, and all error codes
-    // as a client disconnect. Buffer + retry on
-    // partial sends and EAGAIN is todo
-    if (0 <= sent && static_cast<size_t>(sent) < frame.size()) {
-        spdlog::warn("Partial send for fd={}, tried to send {} bytes, actually sent {}, disconnecting the client", fd,
-                     frame.size(), sent);
-        fdsToDisconnect.insert(fd);
-    } else if (sent == -1) {
-        spdlog::warn("Error receieved {} on send for fd={}, disconnecting the client", errno, fd);
-        fdsToDisconnect.insert(fd);
+void NetworkServer::logOutboundStats() {
+    const auto now {std::chrono::steady_clock::now()};
+    if (now - previousStatsLog > std::chrono::seconds(STATS_FREQUENCY_SECONDS)) {
+        const OutboundStats stats {outboundStats()};
+        spdlog::info("OUTBOUND queued_bytes={} queued_frames={} deepest_queue_bytes={} dropped_frames={} "
+                     "dropped_bytes={} overflow_disconnects={}",
+                     stats.queuedBytes, stats.queuedFrames, stats.deepestQueueBytes, stats.droppedFrames,
+                     stats.droppedBytes, stats.overflowDisconnects);
+        previousStatsLog = now;
     }
 }
@@ -0,0 +1,168 @@
+#include "snake_server/RoomAcceptor.h"
+#include "common/Log.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+RoomAcceptor::RoomAcceptor(int port, std::vector<std::shared_ptr<ClientInbox>> roomInboxes)
+    : serverFd {-1},
+      epollFd {-1},
+      wakeFd {-1},
+      stopRequested {false},
+      rooms {std::move(roomInboxes)},
+      pendingClients {} {
+    startServer(port);
+}
+
+void RoomAcceptor::startServer(int port) {
+    serverFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverFd == -1) {
+        throw std::runtime_error("Failed to create socket");
+    }
+    int opt {1};
+    setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(serverFd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        close(serverFd);
+        throw std::runtime_error("Bind failed on port " + std::to_string(port));
+    }
+    if (listen(serverFd, SOMAXCONN) < 0) {
+        close(serverFd);
+        throw std::runtime_error("Listen failed");
+    }
+    fcntl(serverFd, F_SETFL, fcntl(serverFd, F_GETFL, 0) | O_NONBLOCK);
+
+    epollFd = epoll_create1(0);
+    if (epollFd == -1) {
+        close(serverFd);
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = serverFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverFd, &event) == -1) {
+        throw std::runtime_error("Failed to add server fd to epoll");
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    event.data.fd = wakeFd;
+    if (wakeFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == -1) {
+        throw std::runtime_error("Failed to add wakeup eventfd to epoll");
+    }
+    spdlog::info("Room acceptor listening on port {} for {} rooms", port, rooms.size());
+}
+
+void RoomAcceptor::stop() {
+    stopRequested = true;
+    const uint64_t one {1};
+    [[maybe_unused]] ssize_t written {write(wakeFd, &one, sizeof(one))};
+}
+
+void RoomAcceptor::run() {
+    epoll_event events[MAX_EVENTS];
+    while (!stopRequested) {
+        int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        for (int i = 0; i < numEvents; i++) {
+            if (events[i].data.fd == wakeFd) {
+                continue;
+            } else if (events[i].data.fd == serverFd) {
+                acceptNewClient();
+            } else {
+                receiveFromClient(events[i].data.fd);
+            }
+        }
+    }
+}
+
+void RoomAcceptor::acceptNewClient() {
+    int clientFd = accept(serverFd, nullptr, nullptr);
+    if (clientFd == -1) {
+        spdlog::error("Accept failed");
+        return;
+    }
+    fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL, 0) | O_NONBLOCK);
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = clientFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &event) == -1) {
+        spdlog::error("Failed to add fd={} to epoll", clientFd);
+        close(clientFd);
+        return;
+    }
+    pendingClients[clientFd] = {};
+}
+
+void RoomAcceptor::receiveFromClient(int fd) {
+    ssize_t bytesRead = recv(fd, recvBuffer, sizeof(recvBuffer), 0);
+    if (bytesRead < 0 && errno == EAGAIN) {
+        return;
+    } else if (bytesRead <= 0) {
+        dropClient(fd);
+        return;
+    }
+
+    PendingClient & client {pendingClients.at(fd)};
+    client.buffer.append(recvBuffer, static_cast<size_t>(bytesRead));
+
+    uint32_t len;
+    while (client.buffer.size() >= sizeof(len)) {
+        memcpy(&len, client.buffer.data(), sizeof(len));
+        if (len > SERVER_RECV_MAX_MESSAGE_SIZE) {
+            spdlog::error("Received message of size {} before join, dropping client fd={}", len, fd);
+            dropClient(fd);
+            return;
+        }
+        if (client.buffer.size() < sizeof(len) + len) {
+            return;
+        }
+
+        protocol::MessageType type;
+        if (len < sizeof(type)) {
+            dropClient(fd);
+            return;
+        }
+        memcpy(&type, client.buffer.data() + sizeof(len), sizeof(type));
+        if (type != protocol::MessageType::CLIENT_ROOM_REQUEST) {
+            // leave this frame and anything after it for the room
+            routeClient(fd);
+            return;
+        }
+        if (len != protocol::CLIENT_ROOM_REQUEST_PACKED_SIZE) {
+            dropClient(fd);
+            return;
+        }
+        client.requestedRoom =
+            std::get<protocol::ClientRoomRequest>(protocol::deserialise(client.buffer.substr(sizeof(len), len))).roomId;
+        client.buffer.erase(0, sizeof(len) + len);
+    }
+}
+
+void RoomAcceptor::routeClient(int fd) {
+    PendingClient client {std::move(pendingClients.at(fd))};
+    pendingClients.erase(fd);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+
+    std::vector<int> loads {};
+    for (auto & room : rooms) {
+        loads.push_back(room->connections.load());
+    }
+    const std::size_t room {chooseRoom(client.requestedRoom, loads)};
+    spdlog::info("Routing client fd={} to room {} (requested {})", fd, room,
+                 client.requestedRoom ? std::to_string(*client.requestedRoom) : "none");
+    rooms[room]->post(fd, std::move(client.buffer));
+}
+
+void RoomAcceptor::dropClient(int fd) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    pendingClients.erase(fd);
+}
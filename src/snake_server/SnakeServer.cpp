@@ -1,47 +1,110 @@
 #include "snake_server/SnakeServer.h"
 #include "common/Constants.h"
+#include "common/Hash.h"
 #include "common/Log.h"
 #include "common/MessageLogWriter.h"
+#include <algorithm>
+#include <cassert>
 #include <chrono>
+#include <cstring>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
-SnakeServer::SnakeServer(const ServerConfig & config, std::optional<MessageLogReader> && reader)
+namespace {
+
+    std::string sequenceOrNone(const std::optional<int64_t> sequence) {
+        return sequence ? std::to_string(*sequence) : "none";
+    }
+
+} // namespace
+
+SnakeServer::SnakeServer(const ServerConfig & config, std::optional<MessageLogReader> && reader,
+                         std::shared_ptr<ClientInbox> inbox)
     : width {config.width},
       height {config.height},
       currentSequence {0},
       movementFrequencyMs(config.movementFrequencyMs),
       boostedMovementFrequencyMs(config.boostedMovementFrequencyMs),
       boostDurationMs(config.boostDurationMs),
+      minFoodInArena {config.minFoodInArena},
+      foodSpawnFromBodySegmentProbability {config.foodSpawnFromBodySegmentProbability},
+      speedBoostProbability {config.speedBoostProbability},
+      speedBoostRatio {config.speedBoostRatio},
+      serverConfigBytes {},
       timer {},
       seed {config.seed},
       gen {seed},
-      msgLogWriter {config.applicationName},
+      msgLogWriter {config.applicationName, config.messageLogEnabled, config.messageLog},
+      logBuffer {},
+      msgLogIndexWriter {config.applicationName + ".bin", config.messageLogEnabled},
+      messageLogTier {config.messageLogTier},
       serverHighScore {},
       replayFile {std::move(reader)},
-      network {config.port},
+      replayBatch {},
+      recordedState {},
+      verifyingStates {true},
+      recordingHasStates {false},
+      statesVerified {0},
+      statesDiverged {0},
+      lastMatchingSequence {},
+      lastRecordedCheckpoint {},
+      firstDivergence {},
+      network {config.port, config.outboundQueueMaxBytes, config.outboundOverflowPolicy, std::move(inbox)},
+      sendBuffers {},
       clientIdToPlayerMap {},
+      moveDeadlines {},
+      boostExpiries {},
       occupiedCellsBodies {},
-      foodMap {},
-      speedBoostMap {} {
-
-    // vector containing count of snake body segments per cell, indexed y*W + x
+      grownTailCells {},
+      occupiedCellsHeads {},
+      firstHeadInCells {},
+      foodLayer {width, height},
+      speedBoostLayer {width, height},
+      lastBroadcastState {},
+      keyframeRequested {true},
+      broadcastsSinceKeyframe {0},
+      interestRadius {config.interestRadius},
+      interestGrid {width, height, INTEREST_BUCKET_SIZE},
+      lastViews {},
+      viewCentres {},
+      lastLeaderboard {},
+      checkpointInterval {config.checkpointIntervalMs},
+      lastCheckpointTime {},
+      recordingHadCheckpoint {false},
+      resumeCheckpoint {},
+      stats {},
+      tickObserver {},
+      tickPhases {},
+      phaseStart {},
+      stopRequested {false} {
+
+    // vectors containing count of snake body segments and heads per cell, indexed y*W + x
     occupiedCellsBodies.resize(static_cast<size_t>(width * height));
+    occupiedCellsHeads.resize(static_cast<size_t>(width * height));
+    firstHeadInCells.resize(static_cast<size_t>(width * height));
 }
 
 void SnakeServer::run() {
     recordServerConfig();
+    if (resumeCheckpoint) {
+        restoreCheckpoint(*resumeCheckpoint);
+        resumeCheckpoint.reset();
+    }
+    lastCheckpointTime = timer.currentTick();
     const std::chrono::time_point<std::chrono::steady_clock> start {std::chrono::steady_clock::now()};
-    int64_t ticks {0};
 
+    startPhase();
     while (std::optional<std::vector<protocol::MessageVariant>> messages = pollMessages()) {
-        ticks++;
+        endPhase(&TickPhases::poll);
+        stats.ticks++;
         replaceFood();
         bool stateChanged = false;
         for (auto & msg : messages.value()) {
             stampMessage(msg);
-            std::string msgBytes {protocol::serialise(msg)};
-            msgLogWriter.log(msgBytes);
+            protocol::serialiseInto(msg, logBuffer);
+            msgLogWriter.log(logBuffer);
             switch (protocol::header(msg).messageType) {
             case protocol::MessageType::CLIENT_JOIN:
                 handleClientJoin(std::get<protocol::ClientJoin>(msg));
@@ -61,17 +124,34 @@ void SnakeServer::run() {
             }
         }
 
-        if (updateSnakes()) {
+        endPhase(&TickPhases::dispatch);
+
+        const bool snakesMoved {updateSnakes()};
+        endPhase(&TickPhases::updateSnakes);
+        if (snakesMoved) {
             checkCollisions();
             placeSpeedBoost();
             stateChanged = true;
         }
+        endPhase(&TickPhases::checkCollisions);
 
         if (stateChanged) {
             broadcastGameState();
         }
+        if (recordedState) {
+            // the recording changed state this tick and the replay didn't
+            recordDivergence(std::exchange(recordedState, std::nullopt)->hdr.sequence);
+        }
+        if (isCheckpointDue()) {
+            writeCheckpoint();
+        }
+        if (tickObserver) {
+            tickObserver(tickPhases);
+            tickPhases = {};
+            startPhase();
+        }
     }
-    logEngineBenchmark(start, ticks);
+    logEngineBenchmark(start);
 }
 
 void SnakeServer::recordServerConfig() {
@@ -80,14 +160,23 @@ void SnakeServer::recordServerConfig() {
     serverConfig.width = width;
     serverConfig.height = height;
     serverConfig.seed = seed;
-    serverConfig.minFoodInArena = MIN_FOOD_IN_ARENA;
-    serverConfig.foodSpawnFromBodySegmentProbability = FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY;
-    serverConfig.speedBoostProbability = SPEED_BOOST_PROBABILITY;
-    serverConfig.speedBoostRatio = SPEED_BOOST_RATIO;
+    serverConfig.minFoodInArena = minFoodInArena;
+    serverConfig.foodSpawnFromBodySegmentProbability = foodSpawnFromBodySegmentProbability;
+    serverConfig.speedBoostProbability = speedBoostProbability;
+    serverConfig.speedBoostRatio = speedBoostRatio;
     serverConfig.movementFrequencyMs = movementFrequencyMs.count();
     serverConfig.boostedMovementFrequencyMs = boostedMovementFrequencyMs.count();
     serverConfig.boostDurationMs = boostDurationMs.count();
-    msgLogWriter.log(protocol::serialise(stamped(serverConfig)));
+    serverConfigBytes = std::make_shared<const Bytes>(protocol::serialise(stamped(serverConfig)));
+    msgLogWriter.log(*serverConfigBytes);
+    // clients get it on connecting, as the arena bounds the size of the keyframes broadcast to them
+    network.setGreeting(serverConfigBytes);
+    spdlog::info("Arena is {}x{} with at least {} food, seed={}", width, height, minFoodInArena, seed);
+}
+
+void SnakeServer::stop() {
+    stopRequested = true;
+    network.wake();
 }
 
 bool SnakeServer::isInReplay() const {
@@ -96,28 +185,62 @@ bool SnakeServer::isInReplay() const {
 
 std::optional<std::vector<protocol::MessageVariant>> SnakeServer::pollMessages() {
     std::vector<protocol::MessageVariant> messages;
+    if (stopRequested) {
+        spdlog::info("Stopping currentSequence=" + std::to_string(currentSequence));
+        return std::nullopt;
+    }
     if (isInReplay()) {
-        std::vector<protocol::MessageVariant> fileMessages {replayFile->nextBatch()};
-        if (!fileMessages.empty()) {
-            for (auto & pm : fileMessages) {
-                protocol::Header & hdr {protocol::header(pm)};
-                timer.setTick(hdr.transactTime);
-                if (hdr.messageType != protocol::MessageType::SERVER_WELCOME &&
-                    hdr.messageType != protocol::MessageType::GAME_STATE) {
-                    messages.push_back(pm);
+        // only client messages are decoded, the recorded outputs are regenerated and just set the clock
+        if (const std::optional<int64_t> transactTime = replayFile->nextBatch(replayBatch, REPLAYED_TYPES)) {
+            timer.setTick(*transactTime);
+            for (const MessageLogReader::Record & record : replayBatch) {
+                switch (record.hdr.messageType) {
+                case protocol::MessageType::ENGINE_CHECKPOINT:
+                    recordingHadCheckpoint = true;
+                    lastRecordedCheckpoint = record.hdr.sequence;
+                    break;
+                case protocol::MessageType::GAME_STATE:
+                case protocol::MessageType::STATE_HASH:
+                    if (verifyingStates) {
+                        recordedState = record;
+                        recordingHasStates = true;
+                    }
+                    break;
+                default:
+                    messages.push_back(protocol::deserialise(record.bytes));
                 }
             }
         } else {
             spdlog::info("Exiting replay mode currentSequence=" + std::to_string(currentSequence));
+            spdlog::info("REPLAY states_verified={} states_diverged={} first_divergence={}", statesVerified,
+                         statesDiverged, sequenceOrNone(firstDivergence));
             replayFile.reset();
             return std::nullopt;
         }
     } else {
-        std::vector<std::pair<int, Bytes>> networkMessages {network.pollMessages()};
-        for (auto & [clientId, frame] : networkMessages) {
-            messages.push_back(protocol::deserialise(frame, clientId));
+        // sleep until the next snake is due to move or lose its boost, unless a client wakes us first.
+        // A part filled log block is due out too, or an idle server would never write it
+        const std::optional<DeadlineQueue::TimePoint> wakeAt {nextDeadline()};
+        std::optional<DeadlineQueue::TimePoint> pollUntil {msgLogWriter.flushDeadline()};
+        if (wakeAt && (!pollUntil || *wakeAt < *pollUntil)) {
+            pollUntil = wakeAt;
+        }
+        const std::vector<std::pair<int, std::string_view>> networkMessages {network.pollMessages(pollUntil)};
+        msgLogWriter.flushIfDue();
+        for (const auto & [clientId, frame] : networkMessages) {
+            // a room request is only meaningful to a RoomAcceptor, by the time a room sees one it is
+            // already placed. Server messages from a client would be replayed as if the server wrote them
+            const protocol::MessageType type {protocol::peekMessageType(frame)};
+            if (MessageLogReader::inMask(CLIENT_TYPES, type)) {
+                messages.push_back(protocol::deserialise(frame, clientId));
+            } else if (type != protocol::MessageType::CLIENT_ROOM_REQUEST) {
+                spdlog::info("Ignoring message of type {} from clientId={}", static_cast<int>(type), clientId);
+            }
         }
         timer.tick();
+        if (wakeAt && *wakeAt <= timer.currentTick()) {
+            timer.recordWakeup(*wakeAt);
+        }
     }
 
     // check for client disconnects and sythesise the messages we need
@@ -132,22 +255,47 @@ void SnakeServer::handleClientJoin(const protocol::ClientJoin & msg) {
     spdlog::info("Received client join request from " + username);
     createNewPlayer(msg);
 
-    // send a SERVER_WELCOME message back to the client, confirming that they are playing
-    std::string msgBytes {protocol::serialise(
-        stamped(protocol::ServerWelcome {{protocol::MessageType::SERVER_WELCOME, msg.hdr.clientId}}))};
-    msgLogWriter.log(msgBytes);
+    // send a SERVER_WELCOME message back to the client, confirming that they are playing and how
+    // its keyframes will be encoded. It had the arena settings on connecting
+    const protocol::StateEncoding stateEncoding {chooseStateEncoding(msg)};
+    if (stateEncoding == protocol::StateEncoding::COMPACT) {
+        compactStateClients.insert(msg.hdr.clientId);
+    }
+    const std::shared_ptr<Bytes> msgBytes {sendBuffers.acquire()};
+    protocol::serialiseInto(
+        stamped(protocol::ServerWelcome {{protocol::MessageType::SERVER_WELCOME, msg.hdr.clientId}, stateEncoding}),
+        *msgBytes);
+    if (messageLogTier == MessageLogTier::FULL) {
+        msgLogWriter.log(*msgBytes);
+    }
     if (!isInReplay()) {
         network.sendToClient(msg.hdr.clientId, msgBytes);
     }
+
+    // the new client has nothing to apply deltas to
+    keyframeRequested = true;
     spdlog::info("Assigned clientId=" + std::to_string(msg.hdr.clientId) + " to new client " + username);
     spdlog::info("Sent client welcome to " + username);
 }
 
+// the compact encoding whenever the client can read it and the arena fits its coordinates
+protocol::StateEncoding SnakeServer::chooseStateEncoding(const protocol::ClientJoin & msg) const {
+    const bool offered {(msg.stateEncodings & protocol::encodingBit(protocol::StateEncoding::COMPACT)) != 0};
+    if (offered && width - 1 <= protocol::COMPACT_MAX_COORDINATE && height - 1 <= protocol::COMPACT_MAX_COORDINATE) {
+        return protocol::StateEncoding::COMPACT;
+    }
+    return protocol::StateEncoding::FULL;
+}
+
 void SnakeServer::handleClientDisconnect(const protocol::ClientDisconnect & msg) {
     if (clientIdToPlayerMap.contains(msg.hdr.clientId)) {
         spdlog::info("Deleting player " + clientIdToPlayerMap.at(msg.hdr.clientId).name);
+        vacatePlayerCells(clientIdToPlayerMap.at(msg.hdr.clientId));
         clientIdToPlayerMap.erase(msg.hdr.clientId);
     }
+    lastViews.erase(msg.hdr.clientId);
+    viewCentres.erase(msg.hdr.clientId);
+    compactStateClients.erase(msg.hdr.clientId);
 }
 
 void SnakeServer::handleClientInput(const protocol::ClientInput & msg) {
@@ -181,27 +329,33 @@ void SnakeServer::handleClientInput(const protocol::ClientInput & msg) {
 void SnakeServer::createNewPlayer(const protocol::ClientJoin & msg) {
     std::uniform_int_distribution<> distX(1 + 5, width - 1 - 5);
     std::uniform_int_distribution<> distY(1 + 5, height - 1 - 5);
-    clientIdToPlayerMap.emplace(msg.hdr.clientId,
-                                Player {PlayerNode {distX(gen), distY(gen)}, '^', '^', msg.username, 1,
-                                        static_cast<Color>((msg.hdr.clientId % 5) + 2), movementFrequencyMs,
-                                        timer.currentTick() + movementFrequencyMs, false, timer.currentTick()});
+    const auto [it, created] {clientIdToPlayerMap.emplace(
+        msg.hdr.clientId, Player {SnakeBody {distX(gen), distY(gen)}, '^', '^', msg.username, 1,
+                                  static_cast<Color>((msg.hdr.clientId % 5) + 2), movementFrequencyMs,
+                                  timer.currentTick() + movementFrequencyMs, false, timer.currentTick()})};
+    if (created) {
+        moveDeadlines.push(it->second.nextMoveTime, msg.hdr.clientId);
+    }
 }
 
+// Only snakes with a deadline that has passed are visited. Every due boost expiry is applied
+// before any due move, so a snake whose boost ran out moves at its normal speed this tick.
+// Queue entries that no longer match the player's deadline (dead, re-boosted) are discarded
 bool SnakeServer::updateSnakes() {
     bool snakeUpdates {false};
-
-    // todo maybe do a differential update to occupiedCells if we need better performance
-    std::fill(occupiedCellsBodies.begin(), occupiedCellsBodies.end(), uint16_t {0});
-    for (auto & [clientId, player] : clientIdToPlayerMap) {
-        if (player.boosted && player.boostExpireTime <= timer.currentTick()) {
-            player.boosted = false;
-            player.movementFrequencyMs = movementFrequencyMs;
+    while (const std::optional<DeadlineQueue::Entry> expiry = boostExpiries.popDue(timer.currentTick())) {
+        auto it {clientIdToPlayerMap.find(expiry->clientId)};
+        if (it != clientIdToPlayerMap.end() && it->second.boosted && it->second.boostExpireTime == expiry->time) {
+            it->second.boosted = false;
+            it->second.movementFrequencyMs = movementFrequencyMs;
         }
-        if (timer.currentTick() >= player.nextMoveTime) {
-            moveSnake(clientId);
+    }
+    while (const std::optional<DeadlineQueue::Entry> move = moveDeadlines.popDue(timer.currentTick())) {
+        auto it {clientIdToPlayerMap.find(move->clientId)};
+        if (it != clientIdToPlayerMap.end() && it->second.nextMoveTime == move->time) {
+            moveSnake(move->clientId);
             snakeUpdates = true;
         }
-        updateOccupiedCells(clientId);
     }
     return snakeUpdates;
 }
@@ -211,90 +365,121 @@ void SnakeServer::moveSnake(const int clientId) {
     player.direction = player.nextDirection;
     switch (player.direction) {
     case '^':
-        player.head.move(0, -1);
+        player.body.move(0, -1);
         break;
     case 'v':
-        player.head.move(0, 1);
+        player.body.move(0, 1);
         break;
     case '<':
-        player.head.move(-1, 0);
+        player.body.move(-1, 0);
         break;
     case '>':
-        player.head.move(1, 0);
+        player.body.move(1, 0);
         break;
     default:
         throw std::runtime_error("Invalid direction: " + std::string(1, player.direction));
     }
+
+    // the old head becomes the neck and the old tail cell is freed - nothing else in the body changes cell
+    if (player.body.length() > 1) {
+        occupyCell(player.body.segment(1));
+        vacateCell(player.body.vacated());
+    }
     player.nextMoveTime = timer.currentTick() + player.movementFrequencyMs;
+    moveDeadlines.push(player.nextMoveTime, clientId);
+}
+
+std::optional<DeadlineQueue::TimePoint> SnakeServer::nextDeadline() const {
+    const std::optional<DeadlineQueue::TimePoint> move {moveDeadlines.earliest()};
+    const std::optional<DeadlineQueue::TimePoint> expiry {boostExpiries.earliest()};
+    if (move && expiry) {
+        return std::min(*move, *expiry);
+    }
+    return move ? move : expiry;
+}
+
+bool SnakeServer::isInArena(const std::pair<int, int> & cell) const {
+    return cell.first >= 1 && cell.first <= width && cell.second >= 1 && cell.second <= height;
+}
+
+size_t SnakeServer::cellIndex(const std::pair<int, int> & cell) const {
+    assert(isInArena(cell) && "cellIndex: cell outside the arena");
+    return static_cast<size_t>((cell.second - 1) * width + cell.first - 1);
+}
+
+uint16_t & SnakeServer::occupiedCell(const std::pair<int, int> & cell) {
+    return occupiedCellsBodies.at(cellIndex(cell));
+}
+
+void SnakeServer::occupyCell(const std::pair<int, int> & cell) {
+    occupiedCell(cell)++;
+}
+
+void SnakeServer::vacateCell(const std::pair<int, int> & cell) {
+    assert(occupiedCell(cell) > 0 && "vacateCell: cell is not occupied");
+    occupiedCell(cell)--;
 }
 
-void SnakeServer::updateOccupiedCells(const int clientId) {
-    std::vector<std::pair<int, int>> segments {};
-    clientIdToPlayerMap.at(clientId).head.getSegments(segments);
-    for (auto it = segments.begin() + 1; it < segments.end(); it++) {
-        occupiedCellsBodies.at(static_cast<size_t>((it->second - 1) * width + it->first - 1))++;
+void SnakeServer::vacatePlayerCells(const Player & player) {
+    for (std::size_t i = 1; i < player.body.length(); i++) {
+        vacateCell(player.body.segment(i));
+    }
+}
+
+bool SnakeServer::occupancyMatchesBodies() const {
+    std::vector<uint16_t> rebuilt(occupiedCellsBodies.size(), 0);
+    for (const auto & [clientId, player] : clientIdToPlayerMap) {
+        for (std::size_t i = 1; i < player.body.length(); i++) {
+            rebuilt[cellIndex(player.body.segment(i))]++;
+        }
     }
+    return rebuilt == occupiedCellsBodies;
 }
 
 void SnakeServer::checkCollisions() {
+    indexPlayerHeads();
     std::vector<int> clientIdsToDestroy;
     for (auto & [clientId, player] : clientIdToPlayerMap) {
-        std::pair<int, int> playerHead {player.head.x(), player.head.y()};
-        const auto playerHeadCells {getPlayerHeadsInCell(playerHead)};
+        std::pair<int, int> playerHead {player.body.x(), player.body.y()};
 
         // collision with arena boundary
-        if (player.head.y() <= 0) {
+        if (player.body.y() <= 0) {
             spdlog::info("Destroying " + player.name + " due to upper boundary collision");
             clientIdsToDestroy.push_back(clientId);
-        } else if (player.head.y() >= height + 1) {
+        } else if (player.body.y() >= height + 1) {
             spdlog::info("Destroying " + player.name + " due to lower boundary collision");
             clientIdsToDestroy.push_back(clientId);
-        } else if (player.head.x() <= 0) {
+        } else if (player.body.x() <= 0) {
             spdlog::info("Destroying " + player.name + " due to left boundary collision");
             clientIdsToDestroy.push_back(clientId);
-        } else if (player.head.x() >= width + 1) {
+        } else if (player.body.x() >= width + 1) {
             spdlog::info("Destroying " + player.name + " due to upper boundary collision");
             clientIdsToDestroy.push_back(clientId);
         }
 
         // collision with another snake's body
-        else if (occupiedCellsBodies.at(static_cast<size_t>((playerHead.second - 1) * width + playerHead.first - 1)) >
-                 0) {
+        else if (occupiedCell(playerHead) > 0) {
             spdlog::info("Destroying " + player.name + " due to snake body collision");
             clientIdsToDestroy.push_back(clientId);
         }
 
         // head-on-head snake collision - whoever arrived into the cell first survives
-        else if (playerHeadCells.size() > 1) {
-            int firstPlayerinCell {
-                *std::min_element(playerHeadCells.begin(), playerHeadCells.end(),
-                                  // Checking who was first in the cell based on nextMoveTime is slightly imperfect.
-                                  // A client with a faster move speed can arrive later and still have a lower
-                                  // nextMoveTime. This is probably good enough though. Deterministically tie break on ID
-                                  [this](const int a, const int b) {
-                                      auto & playerA {clientIdToPlayerMap.at(a)};
-                                      auto & playerB {clientIdToPlayerMap.at(b)};
-                                      if (playerA.nextMoveTime != playerB.nextMoveTime) {
-                                          return playerA.nextMoveTime < playerB.nextMoveTime;
-                                      } else {
-                                          return a < b;
-                                      }
-                                  })};
-            if (clientId != firstPlayerinCell) {
+        else if (headsInCell(playerHead) > 1) {
+            if (clientId != firstHeadInCell(playerHead)) {
                 spdlog::info("Destroying " + player.name + " due to snake head collision");
                 clientIdsToDestroy.push_back(clientId);
             }
         }
 
         // get food
-        else if (foodMap.contains(playerHead)) {
+        else if (foodLayer.contains(playerHead)) {
             spdlog::debug("Feeding player " + player.name + " at " + "(" + std::to_string(playerHead.first) + ", " +
                           std::to_string(playerHead.second) + ")");
             feedPlayer(playerHead, clientId);
         }
 
         // get speed boost
-        else if (speedBoostMap.contains(playerHead)) {
+        else if (speedBoostLayer.contains(playerHead)) {
             spdlog::debug("Boosting player " + player.name + " at " + "(" + std::to_string(playerHead.first) + ", " +
                           std::to_string(playerHead.second) + ")");
             boostPlayer(playerHead, clientId);
@@ -306,55 +491,98 @@ void SnakeServer::checkCollisions() {
             spdlog::debug("New server high score, " + player.name + ": " + std::to_string(player.score));
         }
     }
+
+    // tails grown this tick only occupy their cell once every head has been checked, as if the
+    // grid had been rebuilt at the start of the next tick
+    for (auto & cell : grownTailCells) {
+        occupyCell(cell);
+    }
+    grownTailCells.clear();
+    clearPlayerHeads();
+
     if (!clientIdsToDestroy.empty()) {
         destroyPlayers(clientIdsToDestroy);
     }
 }
 
-std::vector<int> SnakeServer::getPlayerHeadsInCell(const std::pair<int, int> & head) const {
-    std::vector<int> output {};
+void SnakeServer::indexPlayerHeads() {
+    for (auto & [clientId, player] : clientIdToPlayerMap) {
+        const std::pair<int, int> head {player.body.x(), player.body.y()};
+        if (!isInArena(head)) {
+            continue;
+        }
+        const size_t cell {cellIndex(head)};
+        if (occupiedCellsHeads[cell]++ == 0 || arrivedFirst(clientId, firstHeadInCells[cell])) {
+            firstHeadInCells[cell] = clientId;
+        }
+    }
+}
+
+void SnakeServer::clearPlayerHeads() {
     for (auto & [clientId, player] : clientIdToPlayerMap) {
-        if (player.head.x() == head.first && player.head.y() == head.second) {
-            output.push_back(clientId);
+        const std::pair<int, int> head {player.body.x(), player.body.y()};
+        if (isInArena(head)) {
+            occupiedCellsHeads[cellIndex(head)] = 0;
         }
     }
-    return output;
+}
+
+uint16_t SnakeServer::headsInCell(const std::pair<int, int> & cell) const {
+    return occupiedCellsHeads[cellIndex(cell)];
+}
+
+int SnakeServer::firstHeadInCell(const std::pair<int, int> & cell) const {
+    return firstHeadInCells[cellIndex(cell)];
+}
+
+// Checking who was first in the cell based on nextMoveTime is slightly imperfect.
+// A client with a faster move speed can arrive later and still have a lower
+// nextMoveTime. This is probably good enough though. Deterministically tie break on ID
+bool SnakeServer::arrivedFirst(const int a, const int b) const {
+    auto & playerA {clientIdToPlayerMap.at(a)};
+    auto & playerB {clientIdToPlayerMap.at(b)};
+    if (playerA.nextMoveTime != playerB.nextMoveTime) {
+        return playerA.nextMoveTime < playerB.nextMoveTime;
+    } else {
+        return a < b;
+    }
 }
 
 void SnakeServer::destroyPlayers(std::vector<int> & clientIds) {
-    std::uniform_int_distribution<> dist(1, FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY);
+    std::uniform_int_distribution<> dist(1, foodSpawnFromBodySegmentProbability);
     for (auto & id : clientIds) {
 
         // chance to spawn food on player death for each body segment
-        std::vector<std::pair<int, int>> segments {};
         Player & player {clientIdToPlayerMap.at(id)};
-        player.head.getSegments(segments);
-        for (auto it = segments.begin() + 1; it < segments.end(); it++) {
+        for (std::size_t i = 1; i < player.body.length(); i++) {
             if (dist(gen) == 1) {
-                placeFood(it->first, it->second, player.color);
+                placeFood(player.body.segment(i).first, player.body.segment(i).second, player.color);
             }
         }
 
         // delete the player
+        vacatePlayerCells(player);
         clientIdToPlayerMap.erase(id);
     }
 }
 
 void SnakeServer::feedPlayer(std::pair<int, int> & playerCell, const int clientId) {
-    clientIdToPlayerMap.at(clientId).head.grow();
+    clientIdToPlayerMap.at(clientId).body.grow();
+    grownTailCells.push_back(clientIdToPlayerMap.at(clientId).body.vacated());
     clientIdToPlayerMap.at(clientId).score++;
-    foodMap.erase(playerCell);
+    foodLayer.erase(playerCell);
 }
 
 void SnakeServer::boostPlayer(std::pair<int, int> & playerCell, const int clientId) {
     clientIdToPlayerMap.at(clientId).boosted = true;
     clientIdToPlayerMap.at(clientId).movementFrequencyMs = boostedMovementFrequencyMs;
     clientIdToPlayerMap.at(clientId).boostExpireTime = timer.currentTick() + boostDurationMs;
-    speedBoostMap.erase(playerCell);
+    boostExpiries.push(clientIdToPlayerMap.at(clientId).boostExpireTime, clientId);
+    speedBoostLayer.erase(playerCell);
 }
 
 void SnakeServer::replaceFood() {
-    while (foodMap.size() < MIN_FOOD_IN_ARENA) {
+    while (foodLayer.size() < static_cast<std::size_t>(minFoodInArena)) {
         placeFood();
     }
 }
@@ -367,28 +595,153 @@ void SnakeServer::placeFood() {
 
 void SnakeServer::placeFood(const int x, const int y, const Color color) {
     spdlog::debug("Placing food at (" + std::to_string(x) + ", " + std::to_string(y) + ")");
-    foodMap[std::pair<int, int> {x, y}] = Food {x, y, '@', color};
+    foodLayer.place(Food {x, y, SnakeConstants::FOOD_ICON, color});
 }
 
 void SnakeServer::placeSpeedBoost() {
-    if (speedBoostMap.empty()) {
-        std::uniform_int_distribution<> dist(1, SPEED_BOOST_PROBABILITY);
+    if (speedBoostLayer.empty()) {
+        std::uniform_int_distribution<> dist(1, speedBoostProbability);
         if (dist(gen) == 1) {
             std::uniform_int_distribution<> distX(1, width - 1);
             std::uniform_int_distribution<> distY(1, height - 1);
             int x {distX(gen)};
             int y {distY(gen)};
             spdlog::debug("Placing speed boost at (" + std::to_string(x) + ", " + std::to_string(y) + ")");
-            speedBoostMap[std::pair<int, int> {x, y}] = SpeedBoost {x, y, '*', Color::WHITE};
+            speedBoostLayer.place(SpeedBoost {x, y, SnakeConstants::SPEED_BOOST_ICON, SPEED_BOOST_COLOR});
         }
     }
 }
 
+// The full game state is logged, or just its hash in the INPUTS tier. Clients are sent a keyframe
+// (the full state) periodically and whenever someone joins, otherwise just the changes since the
+// previous broadcast
 void SnakeServer::broadcastGameState() {
-    std::string msgBytes {protocol::serialise(stamped(buildGameState()))};
-    msgLogWriter.log(msgBytes);
-    if (!isInReplay()) {
-        network.broadcast(msgBytes);
+    protocol::GameState gameState {stamped(buildGameState())};
+    endPhase(&TickPhases::buildGameState);
+    const std::shared_ptr<Bytes> msgBytes {sendBuffers.acquire()};
+    protocol::serialiseInto(gameState, *msgBytes);
+    if (messageLogTier == MessageLogTier::FULL) {
+        msgLogWriter.log(*msgBytes);
+    } else {
+        // stands in for the state, so it borrows its header rather than taking a sequence number
+        protocol::StateHash stateHash {gameState.hdr, engineHash()};
+        stateHash.hdr.messageType = protocol::MessageType::STATE_HASH;
+        protocol::serialiseInto(stateHash, logBuffer);
+        msgLogWriter.log(logBuffer);
+    }
+    endPhase(&TickPhases::serialise);
+    stats.broadcasts++;
+    stats.stateBytes += static_cast<int64_t>(msgBytes->size());
+    if (isInReplay()) {
+        verifyReplayedState(gameState, *msgBytes);
+        return;
+    }
+
+    // clients that had queued states dropped can't follow deltas any more
+    const std::vector<int> resyncs {network.drainResyncs()};
+    if (interestRadius > 0) {
+        sendInterestViews(gameState, resyncs);
+        return;
+    }
+    if (!resyncs.empty()) {
+        keyframeRequested = true;
+    }
+    if (!lastBroadcastState || keyframeRequested || broadcastsSinceKeyframe >= GAME_STATE_KEYFRAME_INTERVAL) {
+        broadcastKeyframe(gameState, msgBytes);
+        keyframeRequested = false;
+        broadcastsSinceKeyframe = 0;
+    } else {
+        network.broadcast(serialiseForSending(diffGameStates(*lastBroadcastState, gameState)));
+        broadcastsSinceKeyframe++;
+    }
+    lastBroadcastState = std::move(gameState);
+}
+
+void SnakeServer::sendInterestViews(const protocol::GameState & gameState, const std::vector<int> & resyncs) {
+    const bool keyframeDue {broadcastsSinceKeyframe >= GAME_STATE_KEYFRAME_INTERVAL};
+    broadcastsSinceKeyframe = keyframeDue ? 0 : broadcastsSinceKeyframe + 1;
+    keyframeRequested = false; // a joining client has no view yet, so gets a keyframe regardless
+
+    interestGrid.build(gameState);
+    std::vector<int> newViewers {};
+    for (int clientId : network.clientIds()) {
+        // follow the head while there is one, and stay where it died until the client respawns
+        if (auto it {clientIdToPlayerMap.find(clientId)}; it != clientIdToPlayerMap.end()) {
+            viewCentres[clientId] = {it->second.body.x(), it->second.body.y()};
+        }
+        auto centre {viewCentres.find(clientId)};
+        protocol::GameState view {interestGrid.view(
+            gameState, centre != viewCentres.end() ? centre->second : std::pair<int, int> {width / 2, height / 2},
+            interestRadius)};
+
+        auto last {lastViews.find(clientId)};
+        if (last == lastViews.end()) {
+            newViewers.push_back(clientId);
+            network.sendToClient(clientId, serialiseKeyframe(clientId, view));
+            lastViews.emplace(clientId, std::move(view));
+        } else if (keyframeDue || std::find(resyncs.begin(), resyncs.end(), clientId) != resyncs.end()) {
+            network.sendToClient(clientId, serialiseKeyframe(clientId, view));
+            last->second = std::move(view);
+        } else {
+            network.sendToClient(clientId, serialiseForSending(diffGameStates(last->second, view)));
+            last->second = std::move(view);
+        }
+    }
+    broadcastLeaderboard(gameState, newViewers);
+}
+
+// The full state is already serialised for the log, so it only needs encoding again if some client
+// reads the compact encoding
+void SnakeServer::broadcastKeyframe(const protocol::GameState & gameState,
+                                    const std::shared_ptr<const Bytes> & fullBytes) {
+    if (compactStateClients.empty()) {
+        network.broadcast(fullBytes);
+        return;
+    }
+    const std::shared_ptr<const Bytes> compactBytes {serialiseCompactForSending(gameState)};
+    for (int clientId : network.clientIds()) {
+        network.sendToClient(clientId, compactStateClients.contains(clientId) ? compactBytes : fullBytes);
+    }
+}
+
+std::shared_ptr<const Bytes> SnakeServer::serialiseKeyframe(const int clientId, const protocol::GameState & state) {
+    return compactStateClients.contains(clientId) ? serialiseCompactForSending(state) : serialiseForSending(state);
+}
+
+void SnakeServer::broadcastLeaderboard(const protocol::GameState & gameState, const std::vector<int> & newViewers) {
+    std::vector<const protocol::GameState::Player *> ranked {};
+    for (auto & p : gameState.players) {
+        ranked.push_back(&p);
+    }
+    const std::size_t size {std::min(ranked.size(), static_cast<std::size_t>(LEADERBOARD_SIZE))};
+    std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(size), ranked.end(),
+                      [](auto * a, auto * b) {
+                          return a->score != b->score ? a->score > b->score : a->clientId < b->clientId;
+                      });
+
+    protocol::Leaderboard leaderboard {};
+    // derived from the logged game state, so it borrows that header rather than taking a sequence number
+    leaderboard.hdr = gameState.hdr;
+    leaderboard.hdr.messageType = protocol::MessageType::LEADERBOARD;
+    for (std::size_t i = 0; i < size; i++) {
+        protocol::Leaderboard::Entry entry {ranked[i]->clientId, ranked[i]->color, ranked[i]->score, {}};
+        std::memcpy(entry.username, ranked[i]->username, sizeof(entry.username));
+        leaderboard.entries.push_back(entry);
+    }
+
+    const bool changed {!std::equal(leaderboard.entries.begin(), leaderboard.entries.end(), lastLeaderboard.begin(),
+                                    lastLeaderboard.end(), [](auto & a, auto & b) {
+                                        return a.clientId == b.clientId && a.score == b.score &&
+                                               std::memcmp(a.username, b.username, sizeof(a.username)) == 0;
+                                    })};
+    if (changed) {
+        network.broadcast(serialiseForSending(leaderboard));
+        lastLeaderboard = std::move(leaderboard.entries);
+    } else if (!newViewers.empty()) {
+        const std::shared_ptr<const Bytes> msgBytes {serialiseForSending(leaderboard)};
+        for (int clientId : newViewers) {
+            network.sendToClient(clientId, msgBytes);
+        }
     }
 }
 
@@ -400,14 +753,14 @@ protocol::GameState SnakeServer::buildGameState() {
     std::strncpy(gameState.highScoreUsername, serverHighScore.first.c_str(), sizeof(gameState.highScoreUsername));
 
     // food
-    gameState.food.reserve(foodMap.size());
-    for (auto & [_, f] : foodMap) {
+    gameState.food.reserve(foodLayer.size());
+    for (auto & f : foodLayer.all()) {
         gameState.food.emplace_back(static_cast<int32_t>(f.color), f.icon, f.x, f.y);
     }
 
     // speed boosts
-    gameState.speedBoosts.reserve(speedBoostMap.size());
-    for (auto & [_, sb] : speedBoostMap) {
+    gameState.speedBoosts.reserve(speedBoostLayer.size());
+    for (auto & sb : speedBoostLayer.all()) {
         gameState.speedBoosts.emplace_back(static_cast<int32_t>(sb.color), sb.icon, sb.x, sb.y);
     }
 
@@ -421,18 +774,205 @@ protocol::GameState SnakeServer::buildGameState() {
         player.score = p.score;
         // TODO
         std::strncpy(player.username, p.name.c_str(), sizeof(player.username));
-        p.head.getSegments(player.segments);
+        p.body.getSegments(player.segments);
         gameState.players.push_back(std::move(player));
     }
 
     return gameState;
 }
 
-void SnakeServer::logEngineBenchmark(const std::chrono::time_point<std::chrono::steady_clock> & start,
-                                     const int64_t & ticks) {
-    const int64_t ns {
-        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()};
-    const double engineMs {static_cast<double>(ns) / 1.0e6};
-    const double usPerTick {ticks ? static_cast<double>(ns) / 1000.0 / static_cast<double>(ticks) : 0.0};
-    spdlog::info("BENCH ticks={} engine_ms={:.3f} us_per_tick={:.3f}", ticks, engineMs, usPerTick);
+void SnakeServer::logEngineBenchmark(const std::chrono::time_point<std::chrono::steady_clock> & start) {
+    stats.engineNs =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    const double engineMs {static_cast<double>(stats.engineNs) / 1.0e6};
+    const double usPerTick {
+        stats.ticks ? static_cast<double>(stats.engineNs) / 1000.0 / static_cast<double>(stats.ticks) : 0.0};
+    const double bytesPerBroadcast {
+        stats.broadcasts ? static_cast<double>(stats.stateBytes) / static_cast<double>(stats.broadcasts) : 0.0};
+    spdlog::info("BENCH ticks={} engine_ms={:.3f} us_per_tick={:.3f} bytes_per_broadcast={:.0f}", stats.ticks,
+                 engineMs, usPerTick, bytesPerBroadcast);
+    const MessageLogWriter::Stats logStats {msgLogWriter.stats()};
+    // the disk figures cover the blocks written so far, not the one still buffered
+    const MessageLogWriter::DiskStats disk {msgLogWriter.diskStats()};
+    spdlog::info("MESSAGE_LOG bytes={} blocks={} stalls={} stalled_ms={:.3f} max_queued_bytes={} "
+                 "written_bytes={} stored_bytes={} dropped_blocks={}",
+                 msgLogWriter.offset(), logStats.blocks, logStats.stalls,
+                 static_cast<double>(logStats.stalledNs) / 1.0e6, logStats.maxQueuedBytes, disk.rawBytes,
+                 disk.storedBytes, logStats.droppedBlocks);
+}
+
+void SnakeServer::startPhase() {
+    if (tickObserver) {
+        phaseStart = std::chrono::steady_clock::now();
+    }
+}
+
+void SnakeServer::endPhase(int64_t TickPhases::*phase) {
+    if (tickObserver) {
+        const std::chrono::time_point<std::chrono::steady_clock> now {std::chrono::steady_clock::now()};
+        tickPhases.*phase += std::chrono::duration_cast<std::chrono::nanoseconds>(now - phaseStart).count();
+        phaseStart = now;
+    }
+}
+
+bool SnakeServer::isCheckpointDue() const {
+    if (isInReplay()) {
+        return recordingHadCheckpoint;
+    }
+    return checkpointInterval.count() > 0 && timer.currentTick() - lastCheckpointTime >= checkpointInterval;
+}
+
+void SnakeServer::writeCheckpoint() {
+    protocol::EngineCheckpoint checkpoint {};
+    checkpoint.hdr.messageType = protocol::MessageType::ENGINE_CHECKPOINT;
+    checkpoint.highScore = serverHighScore.second;
+    std::strncpy(checkpoint.highScoreUsername, serverHighScore.first.c_str(), sizeof(checkpoint.highScoreUsername));
+    checkpoint.playerBuckets = clientIdToPlayerMap.bucket_count();
+    std::ostringstream rng {};
+    rng << gen;
+    checkpoint.rng = rng.str();
+    // the state hash counts draws from here, where a replay resuming from this checkpoint starts
+    gen.resetDraws();
+
+    for (auto & f : foodLayer.all()) {
+        checkpoint.food.emplace_back(static_cast<int32_t>(f.color), f.icon, f.x, f.y);
+    }
+    for (auto & sb : speedBoostLayer.all()) {
+        checkpoint.speedBoosts.emplace_back(static_cast<int32_t>(sb.color), sb.icon, sb.x, sb.y);
+    }
+    for (auto & [clientId, p] : clientIdToPlayerMap) {
+        protocol::EngineCheckpoint::Player player {};
+        player.clientId = clientId;
+        player.color = static_cast<int32_t>(p.color);
+        player.direction = p.direction;
+        player.nextDirection = p.nextDirection;
+        player.score = p.score;
+        std::strncpy(player.username, p.name.c_str(), sizeof(player.username));
+        player.movementFrequencyMs = p.movementFrequencyMs.count();
+        player.nextMoveTime = p.nextMoveTime.time_since_epoch().count();
+        player.boosted = p.boosted;
+        player.boostExpireTime = p.boostExpireTime.time_since_epoch().count();
+        player.vacated = p.body.vacated();
+        p.body.getSegments(player.segments);
+        checkpoint.players.push_back(std::move(player));
+    }
+
+    stampMessage(checkpoint);
+    logCheckpoint(checkpoint);
+    lastCheckpointTime = timer.currentTick();
+    recordingHadCheckpoint = false;
+}
+
+// The recording carries on from the checkpoint, so the output log does too: the checkpoint is logged
+// again with its original sequence and the sequences that follow it line up with the recording's
+void SnakeServer::logCheckpoint(const protocol::EngineCheckpoint & checkpoint) {
+    const uint64_t offset {msgLogWriter.offset()};
+    protocol::serialiseInto(checkpoint, logBuffer);
+    msgLogWriter.log(logBuffer);
+    // on its way to disk before the index points at it
+    msgLogWriter.flush();
+    msgLogIndexWriter.append({checkpoint.hdr.sequence, checkpoint.hdr.transactTime, offset});
+}
+
+void SnakeServer::restoreCheckpoint(const protocol::EngineCheckpoint & checkpoint) {
+    using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
+    timer.setTick(checkpoint.hdr.transactTime);
+    currentSequence = checkpoint.hdr.sequence + 1;
+    serverHighScore = {std::string(checkpoint.highScoreUsername,
+                                   strnlen(checkpoint.highScoreUsername, sizeof(checkpoint.highScoreUsername))),
+                       checkpoint.highScore};
+    std::istringstream rng {checkpoint.rng};
+    rng >> gen;
+    gen.resetDraws();
+
+    for (auto & f : checkpoint.food) {
+        foodLayer.place(Food {f.x, f.y, f.icon, static_cast<Color>(f.color)});
+    }
+    for (auto & sb : checkpoint.speedBoosts) {
+        speedBoostLayer.place(SpeedBoost {sb.x, sb.y, sb.icon, static_cast<Color>(sb.color)});
+    }
+
+    // with the same bucket count, inserting in reverse gives back the iteration order the engine had
+    clientIdToPlayerMap.clear();
+    clientIdToPlayerMap.rehash(checkpoint.playerBuckets);
+    for (auto it = checkpoint.players.rbegin(); it != checkpoint.players.rend(); ++it) {
+        const TimePoint nextMoveTime {std::chrono::nanoseconds {it->nextMoveTime}};
+        const TimePoint boostExpireTime {std::chrono::nanoseconds {it->boostExpireTime}};
+        const auto [player, created] {clientIdToPlayerMap.emplace(
+            it->clientId,
+            Player {SnakeBody {it->segments, it->vacated}, it->direction, it->nextDirection,
+                    std::string(it->username, strnlen(it->username, sizeof(it->username))), it->score,
+                    static_cast<Color>(it->color), std::chrono::milliseconds {it->movementFrequencyMs}, nextMoveTime,
+                    it->boosted != 0, boostExpireTime})};
+        for (std::size_t i = 1; i < player->second.body.length(); i++) {
+            occupyCell(player->second.body.segment(i));
+        }
+        moveDeadlines.push(nextMoveTime, it->clientId);
+        if (player->second.boosted) {
+            boostExpiries.push(boostExpireTime, it->clientId);
+        }
+    }
+    std::size_t i {0};
+    for (auto & [clientId, p] : clientIdToPlayerMap) {
+        if (i >= checkpoint.players.size() || checkpoint.players[i++].clientId != clientId) {
+            spdlog::error("Player order differs from the checkpoint, the replay will diverge from the recording");
+            break;
+        }
+    }
+
+    logCheckpoint(checkpoint);
+    spdlog::info("Resumed from checkpoint sequence={} with {} players", checkpoint.hdr.sequence,
+                 checkpoint.players.size());
+}
+
+// Players are summed, so the hash doesn't depend on the order they are visited in. Bodies and
+// items keep their digests up to date as they change, so this is O(players) not O(cells)
+uint64_t SnakeServer::engineHash() const {
+    uint64_t players {0};
+    for (const auto & [clientId, p] : clientIdToPlayerMap) {
+        players += hash::of(static_cast<uint64_t>(clientId), p.body.digest(),
+                            hash::cell(p.body.vacated().first, p.body.vacated().second),
+                            static_cast<uint8_t>(p.direction), static_cast<uint8_t>(p.nextDirection), p.score,
+                            static_cast<int>(p.color), p.movementFrequencyMs.count(),
+                            p.nextMoveTime.time_since_epoch().count(), p.boosted,
+                            p.boostExpireTime.time_since_epoch().count());
+    }
+    return hash::of(players, foodLayer.digest(), speedBoostLayer.digest(), serverHighScore.second, gen.draws());
+}
+
+// A full recording has the GAME_STATE to compare byte for byte, an inputs one the STATE_HASH.
+// A recording with no states at all, eg a synthetic one, can't be checked
+void SnakeServer::verifyReplayedState(const protocol::GameState & state, const std::string & stateBytes) {
+    const std::optional<MessageLogReader::Record> recorded {std::exchange(recordedState, std::nullopt)};
+    if (!recorded) {
+        if (recordingHasStates) {
+            recordDivergence(state.hdr.sequence); // a state the recording didn't have
+        }
+        return;
+    }
+    const bool matches {
+        recorded->hdr.messageType == protocol::MessageType::GAME_STATE
+            ? recorded->bytes == stateBytes
+            : recorded->hdr.sequence == state.hdr.sequence &&
+                  std::get<protocol::StateHash>(protocol::deserialise(recorded->bytes)).hash == engineHash()};
+    if (matches) {
+        statesVerified++;
+        lastMatchingSequence = recorded->hdr.sequence;
+    } else {
+        recordDivergence(recorded->hdr.sequence);
+    }
+}
+
+// The first divergence is reported with where to look: states are checked every tick that has
+// one, so the cause is in the ticks after the last matching state, and a replay can be started
+// from the checkpoint before it with SNAKE_REPLAY_FROM_SEQUENCE
+void SnakeServer::recordDivergence(const int64_t sequence) {
+    statesDiverged++;
+    if (firstDivergence) {
+        return;
+    }
+    firstDivergence = sequence;
+    spdlog::error("Replay diverged from the recording at sequence {}, the last matching state was sequence {} and "
+                  "the last checkpoint before it sequence {}",
+                  sequence, sequenceOrNone(lastMatchingSequence), sequenceOrNone(lastRecordedCheckpoint));
 }
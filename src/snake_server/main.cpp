@@ -1,15 +1,82 @@
 #include "common/Log.h"
+#include "common/MessageLogIndex.h"
 #include "common/MessageLogReader.h"
+#include "snake_server/RoomAcceptor.h"
+#include "snake_server/ServerConfig.h"
 #include "snake_server/SnakeServer.h"
 
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <pthread.h>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+namespace {
+
+    // SNAKE_REPLAY_FROM_SEQUENCE or SNAKE_REPLAY_FROM_TIME (transactTime nanos) start the replay at the
+    // last checkpoint at or before that point, leaving the reader just past the checkpoint
+    std::optional<protocol::EngineCheckpoint> seekReplay(const std::string & replayPath, MessageLogReader & reader) {
+        const char * fromSequence {std::getenv("SNAKE_REPLAY_FROM_SEQUENCE")};
+        const char * fromTime {std::getenv("SNAKE_REPLAY_FROM_TIME")};
+        const bool bySequence {fromSequence != nullptr && fromSequence[0] != '\0'};
+        if (!bySequence && (fromTime == nullptr || fromTime[0] == '\0')) {
+            return std::nullopt;
+        }
+        // checked like any other setting, a typo mustn't quietly replay from the start
+        const int64_t target {bySequence ? envOr<int64_t>("SNAKE_REPLAY_FROM_SEQUENCE", 0, 0)
+                                         : envOr<int64_t>("SNAKE_REPLAY_FROM_TIME", 0, 0)};
+        const MessageLogIndex index {MessageLogIndex::load(replayPath)};
+        const std::optional<MessageLogIndex::Entry> entry {bySequence ? index.atOrBeforeSequence(target)
+                                                                      : index.atOrBeforeTime(target)};
+        if (!entry) {
+            spdlog::info("No checkpoint before the requested point, replaying from the start");
+            return std::nullopt;
+        }
+        reader.seek(entry->offset);
+        std::optional<protocol::MessageVariant> msg {reader.first()};
+        if (!msg || !std::holds_alternative<protocol::EngineCheckpoint>(*msg)) {
+            throw std::runtime_error("Message log index does not point at a checkpoint in " + replayPath);
+        }
+        return std::get<protocol::EngineCheckpoint>(std::move(*msg));
+    }
+
+    // SIGINT and SIGTERM are blocked in every thread, so this must run before any are started
+    sigset_t blockShutdownSignals() {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        return signals;
+    }
+
+    // The first SIGINT or SIGTERM stops the servers between ticks, so their message logs are
+    // written out in full. A second one exits straight away
+    void stopOnShutdownSignal(const sigset_t signals, std::function<void()> stop) {
+        std::thread {[signals, stop = std::move(stop)] {
+            int signal {0};
+            sigwait(&signals, &signal);
+            spdlog::info("Received signal {}, stopping", signal);
+            stop();
+            sigwait(&signals, &signal);
+            std::_Exit(128 + signal);
+        }}.detach();
+    }
+
+} // namespace
 
 int main() {
     // Process wide setting - don't crash the server when trying to write to a 
     // closed socket. Just move on and let epoll surface the client disconnect
     signal(SIGPIPE, SIG_IGN);
+    const sigset_t shutdownSignals {blockShutdownSignals()};
 
     const std::string applicationName {"snake_server"};
     initLogging(applicationName, false, true);
@@ -18,12 +85,53 @@ int main() {
     // is the replay file path. If it is unset, run in normal mode
     std::optional<MessageLogReader> reader;
     std::optional<protocol::MessageVariant> firstMessage;
+    std::optional<protocol::EngineCheckpoint> checkpoint;
     if (const char * replayPath = std::getenv("SNAKE_REPLAY"); replayPath != nullptr && replayPath[0] != '\0') {
         reader.emplace(replayPath);
         firstMessage = reader->first();
+        checkpoint = seekReplay(replayPath, *reader);
     }
 
-    SnakeServer server {initServerConfig(applicationName, firstMessage), std::move(reader)};
-    server.run();
+    // SNAKE_ROOMS=N runs N independent arenas, each with its own seed (SNAKE_SEED + i when set),
+    // message log and simulation thread, behind one acceptor on the usual port. A room's log
+    // replays on its own through SNAKE_REPLAY like any single server log
+    const int rooms {envOr("SNAKE_ROOMS", 1, 1, MAX_ROOMS)};
+
+    if (reader || rooms == 1) {
+        SnakeServer server {initServerConfig(applicationName, firstMessage), std::move(reader)};
+        if (checkpoint) {
+            server.resumeFrom(std::move(*checkpoint));
+        }
+        stopOnShutdownSignal(shutdownSignals, [&server] { server.stop(); });
+        server.run();
+        // a replay that didn't reproduce its recording fails, so it can gate a build or a log check
+        return server.replayDivergence() ? 1 : 0;
+    }
+
+    std::vector<std::shared_ptr<ClientInbox>> inboxes {};
+    std::vector<std::unique_ptr<SnakeServer>> servers {};
+    int port {SERVER_PORT};
+    for (int i = 0; i < rooms; i++) {
+        inboxes.push_back(std::make_shared<ClientInbox>());
+        const ServerConfig config {initServerConfig(applicationName + "_room" + std::to_string(i), std::nullopt, i)};
+        servers.push_back(std::make_unique<SnakeServer>(config, std::nullopt, inboxes.back()));
+        port = config.port;
+    }
+    RoomAcceptor acceptor {port, inboxes};
+    stopOnShutdownSignal(shutdownSignals, [&servers, &acceptor] {
+        for (auto & server : servers) {
+            server->stop();
+        }
+        acceptor.stop();
+    });
+
+    std::vector<std::thread> threads {};
+    for (auto & server : servers) {
+        threads.emplace_back([&server] { server->run(); });
+    }
+    acceptor.run();
+    for (auto & thread : threads) {
+        thread.join();
+    }
     return 0;
 }
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common/MessageLogReader.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// the records as serialised, whichever layout the log is in
+inline std::vector<std::string> readMessages(const std::filesystem::path & path) {
+    MessageLogReader reader {path.string()};
+    std::vector<std::string> messages;
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        messages.emplace_back(record->bytes);
+    }
+    return messages;
+}
@@ -0,0 +1,255 @@
+#include "MessageLogRecords.h"
+#include "common/MessageLogIndex.h"
+#include "common/MessageLogReader.h"
+#include "common/MessageLogWriter.h"
+#include "common/Protocol.h"
+#include "snake_server/ClientInbox.h"
+#include "snake_server/ServerConfig.h"
+#include "snake_server/SnakeServer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace {
+
+    constexpr int64_t START_NS {1'000'000'000'000'000};
+    constexpr int64_t TICK_NS {10'000'000};
+    constexpr int TICKS {600};
+    constexpr int CHECKPOINT_EVERY {100};
+    constexpr int PLAYERS {6};
+
+    template <typename T>
+    T at(const int64_t transactTime, const int clientId, T msg) {
+        msg.hdr.clientId = clientId;
+        msg.hdr.transactTime = transactTime;
+        return msg;
+    }
+
+    // players join, rejoin and steer on a fixed pattern. The recorded states and checkpoints are
+    // placeholders. A replay of this diverges at once, and writes real checkpoints in the same ticks
+    void writeRecording(const std::string & name) {
+        MessageLogWriter writer {name};
+        protocol::ServerConfig config {};
+        config.hdr.messageType = protocol::MessageType::SERVER_CONFIG;
+        config.width = 40;
+        config.height = 40;
+        config.seed = 1234;
+        config.minFoodInArena = MIN_FOOD_IN_ARENA;
+        config.foodSpawnFromBodySegmentProbability = FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY;
+        config.speedBoostProbability = SPEED_BOOST_PROBABILITY;
+        config.speedBoostRatio = SPEED_BOOST_RATIO;
+        config.movementFrequencyMs = MOVEMENT_FREQUENCY_MS;
+        config.boostedMovementFrequencyMs = BOOSTED_MOVEMENT_FREQUENCY_MS;
+        config.boostDurationMs = SPEED_BOOST_DURATION_MS;
+        writer.log(protocol::serialise(at(START_NS, -1, config)));
+
+        protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN}, {}, 0};
+        std::strncpy(join.username, "bot", sizeof(join.username) - 1);
+        const char directions[] {'^', '<', 'v', '>'};
+        protocol::GameState clock {};
+        clock.hdr.messageType = protocol::MessageType::GAME_STATE;
+        protocol::EngineCheckpoint checkpoint {};
+        checkpoint.hdr.messageType = protocol::MessageType::ENGINE_CHECKPOINT;
+
+        for (int tick = 0; tick < TICKS; tick++) {
+            const int64_t now {START_NS + (tick + 1) * TICK_NS};
+            for (int clientId = 1; clientId <= PLAYERS; clientId++) {
+                if (tick % 150 == 0) {
+                    writer.log(protocol::serialise(at(now, clientId, join)));
+                } else if ((tick + clientId * 7) % 23 == 0) {
+                    writer.log(protocol::serialise(at(now, clientId,
+                                                      protocol::ClientInput {{protocol::MessageType::CLIENT_INPUT},
+                                                                             directions[(tick / 23 + clientId) % 4]})));
+                }
+            }
+            writer.log(protocol::serialise(at(now, -1, clock)));
+            if ((tick + 1) % CHECKPOINT_EVERY == 0) {
+                writer.log(protocol::serialise(at(now, -1, checkpoint)));
+            }
+        }
+    }
+
+    // replays the recording in process, from the start or from a checkpoint, and says where it
+    // first diverged from the recorded states
+    std::optional<int64_t> replay(const std::string & recording, const std::string & output,
+                                  std::optional<MessageLogIndex::Entry> from = std::nullopt) {
+        std::optional<MessageLogReader> reader {std::in_place, recording};
+        const std::optional<protocol::MessageVariant> recordedConfig {reader->first()};
+        std::optional<protocol::MessageVariant> checkpoint {};
+        if (from) {
+            reader->seek(from->offset);
+            checkpoint = reader->first();
+        }
+        auto server {std::make_unique<SnakeServer>(initServerConfig(output, recordedConfig), std::move(reader),
+                                                   std::make_shared<ClientInbox>())};
+        if (checkpoint) {
+            server->resumeFrom(std::get<protocol::EngineCheckpoint>(*checkpoint));
+        }
+        server->run();
+        return server->replayDivergence();
+    }
+
+    class CheckpointReplay : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            std::filesystem::remove_all(workDir);
+            std::filesystem::create_directories(workDir);
+            writeRecording(path("recording"));
+            replay(path("recording") + ".bin", path("full"));
+        }
+
+        void TearDown() override { std::filesystem::remove_all(workDir); }
+
+        std::string path(const std::string & name) const { return (workDir / name).string(); }
+
+        const std::filesystem::path workDir {std::filesystem::temp_directory_path() / "snake_checkpoint_replay_test"};
+    };
+
+} // namespace
+
+TEST_F(CheckpointReplay, IndexMatchesScanOfTheLog) {
+    const MessageLogIndex index {MessageLogIndex::load(path("full") + ".bin")};
+    const MessageLogIndex scanned {MessageLogIndex::scan(path("full") + ".bin")};
+
+    ASSERT_EQ(index.entries().size(), static_cast<std::size_t>(TICKS / CHECKPOINT_EVERY));
+    ASSERT_EQ(scanned.entries().size(), index.entries().size());
+    for (std::size_t i {0}; i < index.entries().size(); ++i) {
+        EXPECT_EQ(index.entries()[i].sequence, scanned.entries()[i].sequence);
+        EXPECT_EQ(index.entries()[i].transactTime, scanned.entries()[i].transactTime);
+        EXPECT_EQ(index.entries()[i].offset, scanned.entries()[i].offset);
+    }
+}
+
+TEST_F(CheckpointReplay, LooksUpTheLastCheckpointBeforeATarget) {
+    const MessageLogIndex index {MessageLogIndex::load(path("full") + ".bin")};
+    const std::vector<MessageLogIndex::Entry> & entries {index.entries()};
+    ASSERT_GE(entries.size(), 2u);
+
+    EXPECT_FALSE(index.atOrBeforeSequence(entries[0].sequence - 1));
+    EXPECT_EQ(index.atOrBeforeSequence(entries[0].sequence)->offset, entries[0].offset);
+    EXPECT_EQ(index.atOrBeforeSequence(entries[1].sequence - 1)->offset, entries[0].offset);
+    EXPECT_EQ(index.atOrBeforeTime(entries[1].transactTime)->offset, entries[1].offset);
+    EXPECT_EQ(index.atOrBeforeTime(entries.back().transactTime + TICK_NS)->offset, entries.back().offset);
+}
+
+// Replaying the replay's own output reproduces it, checkpoints included
+TEST_F(CheckpointReplay, FullReplayReproducesCheckpoints) {
+    replay(path("full") + ".bin", path("again"));
+
+    const std::vector<std::string> expected {readMessages(path("full") + ".bin")};
+    const std::vector<std::string> actual {readMessages(path("again") + ".bin")};
+    ASSERT_EQ(actual.size(), expected.size());
+    for (std::size_t i {1}; i < expected.size(); ++i) {
+        EXPECT_EQ(actual[i], expected[i]) << "divergence at record " << (i + 1);
+    }
+}
+
+// Starting from any checkpoint gives the same records as the full replay from that checkpoint on
+TEST_F(CheckpointReplay, ResumingFromACheckpointMatchesTheFullReplay) {
+    const std::vector<std::string> full {readMessages(path("full") + ".bin")};
+    const MessageLogIndex index {MessageLogIndex::load(path("full") + ".bin")};
+
+    for (const MessageLogIndex::Entry & entry : index.entries()) {
+        replay(path("full") + ".bin", path("resumed"), entry);
+        const std::vector<std::string> resumed {readMessages(path("resumed") + ".bin")};
+
+        std::size_t start {0};
+        while (start < full.size() &&
+               protocol::deserialiseHeader(full[start].substr(0, protocol::HEADER_PACKED_SIZE)).sequence !=
+                   entry.sequence) {
+            start++;
+        }
+        ASSERT_LT(start, full.size());
+        ASSERT_EQ(resumed.size() - 1, full.size() - start) << "from sequence " << entry.sequence;
+        for (std::size_t i {1}; i < resumed.size(); ++i) {
+            ASSERT_EQ(resumed[i], full[start + i - 1]) << "from sequence " << entry.sequence << " record " << i;
+        }
+    }
+}
+
+// An inputs tier log has a STATE_HASH for each GAME_STATE and no SERVER_WELCOMEs, and replaying it
+// with the full tier writes the full log again
+TEST_F(CheckpointReplay, InputsTierReplaysToTheFullLog) {
+    setenv("SNAKE_MESSAGE_LOG_TIER", "inputs", 1);
+    replay(path("full") + ".bin", path("inputs"));
+    unsetenv("SNAKE_MESSAGE_LOG_TIER");
+
+    const std::vector<std::string> full {readMessages(path("full") + ".bin")};
+    const std::vector<std::string> inputs {readMessages(path("inputs") + ".bin")};
+    // checkpoints are in both and left out of the sums. The states in this arena are small, so the
+    // saving is nothing like a real server's
+    std::size_t fullBytes {0};
+    std::size_t inputsBytes {0};
+    std::size_t states {0};
+    std::size_t hashes {0};
+    for (const std::string & msg : full) {
+        const protocol::MessageType type {protocol::deserialiseHeader(msg).messageType};
+        fullBytes += type == protocol::MessageType::ENGINE_CHECKPOINT ? 0 : msg.size();
+        states += type == protocol::MessageType::GAME_STATE;
+    }
+    for (const std::string & msg : inputs) {
+        const protocol::MessageType type {protocol::deserialiseHeader(msg).messageType};
+        inputsBytes += type == protocol::MessageType::ENGINE_CHECKPOINT ? 0 : msg.size();
+        hashes += type == protocol::MessageType::STATE_HASH;
+        EXPECT_NE(type, protocol::MessageType::GAME_STATE);
+        EXPECT_NE(type, protocol::MessageType::SERVER_WELCOME);
+    }
+    EXPECT_EQ(hashes, states);
+    EXPECT_LT(inputsBytes * 2, fullBytes);
+
+    replay(path("inputs") + ".bin", path("regenerated"));
+    const std::vector<std::string> regenerated {readMessages(path("regenerated") + ".bin")};
+    ASSERT_EQ(regenerated.size(), full.size());
+    for (std::size_t i {1}; i < full.size(); ++i) {
+        ASSERT_EQ(regenerated[i], full[i]) << "divergence at record " << (i + 1);
+    }
+}
+
+// Both tiers check every state a replay produces against the recording, with nothing to report
+// when they match
+TEST_F(CheckpointReplay, ReplaysVerifyTheRecordedStates) {
+    EXPECT_EQ(replay(path("full") + ".bin", path("again")), std::nullopt);
+
+    setenv("SNAKE_MESSAGE_LOG_TIER", "inputs", 1);
+    replay(path("full") + ".bin", path("inputs"));
+    EXPECT_EQ(replay(path("inputs") + ".bin", path("again")), std::nullopt);
+    unsetenv("SNAKE_MESSAGE_LOG_TIER");
+
+    const MessageLogIndex index {MessageLogIndex::load(path("inputs") + ".bin")};
+    EXPECT_EQ(replay(path("inputs") + ".bin", path("resumed"), index.entries()[2]), std::nullopt);
+}
+
+// A recorded state the replay doesn't reproduce is reported at its own sequence
+TEST_F(CheckpointReplay, ReportsTheFirstDivergentState) {
+    setenv("SNAKE_MESSAGE_LOG_TIER", "inputs", 1);
+    replay(path("full") + ".bin", path("inputs"));
+    unsetenv("SNAKE_MESSAGE_LOG_TIER");
+
+    std::optional<int64_t> corrupted {};
+    {
+        MessageLogWriter writer {path("corrupt")};
+        int hashes {0};
+        for (const std::string & msg : readMessages(path("inputs") + ".bin")) {
+            const protocol::MessageVariant variant {protocol::deserialise(msg)};
+            if (const auto * stateHash = std::get_if<protocol::StateHash>(&variant); stateHash && ++hashes == 20) {
+                protocol::StateHash wrong {*stateHash};
+                wrong.hash ^= 1;
+                corrupted = wrong.hdr.sequence;
+                writer.log(protocol::serialise(wrong));
+            } else {
+                writer.log(msg);
+            }
+        }
+    }
+    ASSERT_TRUE(corrupted);
+    EXPECT_EQ(replay(path("corrupt") + ".bin", path("again")), corrupted);
+}
@@ -0,0 +1,240 @@
+#include "MessageLogRecords.h"
+#include "common/Constants.h"
+#include "common/MessageLogReader.h"
+#include "common/MessageLogWriter.h"
+#include "common/Protocol.h"
+#include "snake_server/ClientInbox.h"
+#include "snake_server/ServerConfig.h"
+#include "snake_server/SnakeServer.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+namespace {
+
+    constexpr int64_t START_NS {1'000'000'000'000'000};
+    constexpr int64_t MS_NS {1'000'000};
+    constexpr int64_t MOVE_NS {MOVEMENT_FREQUENCY_MS * MS_NS};
+
+    struct Snake {
+        int clientId;
+        std::vector<protocol::GameState::Player::Segment> segments; // head first
+        char direction;
+        int64_t nextMoveTime;
+        int64_t movementFrequencyMs {MOVEMENT_FREQUENCY_MS};
+    };
+
+    // The rule checkCollisions has always used for heads that meet: the snake whose next move is
+    // due soonest, after this move, got there first, and on a tie the lower client id
+    int expectedSurvivor(const std::vector<Snake> & snakes, const int64_t tickNs) {
+        const auto arrival {[tickNs](const Snake & s) {
+            const int64_t nextMove {s.nextMoveTime <= tickNs ? tickNs + s.movementFrequencyMs * MS_NS : s.nextMoveTime};
+            return std::tuple {nextMove, s.clientId};
+        }};
+        return std::min_element(snakes.begin(), snakes.end(),
+                                [&arrival](const Snake & a, const Snake & b) { return arrival(a) < arrival(b); })
+            ->clientId;
+    }
+
+    protocol::MessageVariant clock(const int64_t transactTime) {
+        // a recorded state only stands for the time passing, the replay's own goes in its log
+        return protocol::GameState {{protocol::MessageType::GAME_STATE, -1, 0, transactTime}};
+    }
+
+    protocol::MessageVariant disconnect(const int64_t transactTime, const int clientId) {
+        return protocol::ClientDisconnect {{protocol::MessageType::CLIENT_DISCONNECT, clientId, 0, transactTime}};
+    }
+
+    class EngineScenario : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            std::filesystem::remove_all(workDir);
+            std::filesystem::create_directories(workDir);
+        }
+
+        void TearDown() override { std::filesystem::remove_all(workDir); }
+
+        std::string path(const std::string & name) const { return (workDir / name).string(); }
+
+        // A recording that starts from a checkpoint holding just these snakes and food, followed by
+        // the given records in time order
+        void record(const std::vector<Snake> & snakes, const std::vector<protocol::GameState::Food> & food,
+                    const std::vector<protocol::MessageVariant> & records) {
+            MessageLogWriter writer {path("recording")};
+            protocol::ServerConfig config {};
+            config.hdr = {protocol::MessageType::SERVER_CONFIG, -1, 0, START_NS};
+            config.width = 40;
+            config.height = 40;
+            config.seed = 1234;
+            config.minFoodInArena = 0;
+            config.foodSpawnFromBodySegmentProbability = FOOD_SPAWN_FROM_BODY_SEGMENT_PROBABILITY;
+            config.speedBoostProbability = SPEED_BOOST_PROBABILITY;
+            config.speedBoostRatio = SPEED_BOOST_RATIO;
+            config.movementFrequencyMs = MOVEMENT_FREQUENCY_MS;
+            config.boostedMovementFrequencyMs = BOOSTED_MOVEMENT_FREQUENCY_MS;
+            config.boostDurationMs = SPEED_BOOST_DURATION_MS;
+            writer.log(protocol::serialise(config));
+
+            protocol::EngineCheckpoint checkpoint {};
+            checkpoint.hdr = {protocol::MessageType::ENGINE_CHECKPOINT, -1, 1, START_NS};
+            std::ostringstream rng {};
+            rng << std::mt19937 {1234};
+            checkpoint.rng = rng.str();
+            checkpoint.food = food;
+            for (const Snake & snake : snakes) {
+                protocol::EngineCheckpoint::Player player {};
+                player.clientId = snake.clientId;
+                player.direction = snake.direction;
+                player.nextDirection = snake.direction;
+                player.score = static_cast<int32_t>(snake.segments.size());
+                std::strncpy(player.username, ("snake" + std::to_string(snake.clientId)).c_str(),
+                             sizeof(player.username) - 1);
+                player.movementFrequencyMs = snake.movementFrequencyMs;
+                player.nextMoveTime = snake.nextMoveTime;
+                player.boosted = snake.movementFrequencyMs != MOVEMENT_FREQUENCY_MS;
+                player.boostExpireTime = player.boosted ? START_NS + 100 * MOVE_NS : 0;
+                player.vacated = snake.segments.back();
+                player.segments = snake.segments;
+                checkpoint.players.push_back(std::move(player));
+            }
+            checkpointOffset = writer.offset();
+            writer.log(protocol::serialise(checkpoint));
+
+            int64_t sequence {2};
+            for (protocol::MessageVariant msg : records) {
+                std::visit([&sequence](auto & m) { m.hdr.sequence = sequence++; }, msg);
+                writer.log(protocol::serialise(msg));
+            }
+        }
+
+        // Resumes an engine from the recorded checkpoint and replays the rest, calling afterTick at the
+        // end of each tick. Returns the last state it logged
+        protocol::GameState replay(const std::function<void(const SnakeServer &)> & afterTick = {}) {
+            std::optional<MessageLogReader> reader {std::in_place, path("recording") + ".bin"};
+            const std::optional<protocol::MessageVariant> recordedConfig {reader->first()};
+            reader->seek(checkpointOffset);
+            const std::optional<protocol::MessageVariant> checkpoint {reader->first()};
+            {
+                // the log is only whole once the server is gone
+                SnakeServer server {initServerConfig(path("replay"), recordedConfig), std::move(reader),
+                                    std::make_shared<ClientInbox>()};
+                server.resumeFrom(std::get<protocol::EngineCheckpoint>(*checkpoint));
+                server.setVerifyReplayedStates(false);
+                if (afterTick) {
+                    server.setTickObserver(
+                        [&server, &afterTick](const SnakeServer::TickPhases &) { afterTick(server); });
+                }
+                server.run();
+            }
+
+            protocol::GameState last {};
+            for (const std::string & msg : readMessages(path("replay") + ".bin")) {
+                if (protocol::deserialiseHeader(msg).messageType == protocol::MessageType::GAME_STATE) {
+                    last = std::get<protocol::GameState>(protocol::deserialise(msg));
+                }
+            }
+            return last;
+        }
+
+        // the client ids still playing after one tick at tickNs
+        std::vector<int> survivorsAfter(const std::vector<Snake> & snakes, const int64_t tickNs) {
+            record(snakes, {}, {clock(tickNs)});
+            std::vector<int> survivors {};
+            for (const protocol::GameState::Player & player : replay().players) {
+                survivors.push_back(player.clientId);
+            }
+            std::sort(survivors.begin(), survivors.end());
+            return survivors;
+        }
+
+        const std::filesystem::path workDir {std::filesystem::temp_directory_path() / "snake_collision_test"};
+        uint64_t checkpointOffset {0};
+    };
+
+    class HeadOnCollision : public EngineScenario {};
+    class CellOccupancy : public EngineScenario {};
+
+} // namespace
+
+// Two snakes at the same speed move into (20, 20) in the same tick, so they arrive together and
+// the lower client id keeps the cell whatever order the engine visits them in
+TEST_F(HeadOnCollision, SameTickSameSpeedKeepsTheLowerClientId) {
+    const int64_t tick {START_NS + MOVE_NS};
+    const std::vector<Snake> snakes {
+        {7, {{19, 20}, {18, 20}}, '>', tick},
+        {3, {{21, 20}, {22, 20}}, '<', tick},
+    };
+    ASSERT_EQ(expectedSurvivor(snakes, tick), 3);
+    EXPECT_EQ(survivorsAfter(snakes, tick), std::vector<int> {3});
+}
+
+// Three heads meet in one tick. The boosted snake's next move comes round soonest, so it counts
+// as arriving first even with the highest client id
+TEST_F(HeadOnCollision, ThreeHeadsKeepTheOneThatArrivedFirst) {
+    const int64_t tick {START_NS + MOVE_NS};
+    const std::vector<Snake> snakes {
+        {2, {{19, 20}, {18, 20}}, '>', tick},
+        {9, {{21, 20}, {22, 20}}, '<', tick, BOOSTED_MOVEMENT_FREQUENCY_MS},
+        {5, {{20, 19}, {20, 18}}, 'v', tick},
+    };
+    ASSERT_EQ(expectedSurvivor(snakes, tick), 9);
+    EXPECT_EQ(survivorsAfter(snakes, tick), std::vector<int> {9});
+}
+
+// A head already in the cell from an earlier tick beats a lower client id moving in on top of it
+TEST_F(HeadOnCollision, HeadAlreadyInTheCellSurvives) {
+    const int64_t tick {START_NS + MOVE_NS};
+    const std::vector<Snake> snakes {
+        {8, {{20, 20}, {19, 20}}, '>', tick + MOVE_NS / 2},
+        {4, {{21, 20}, {22, 20}}, '<', tick},
+    };
+    ASSERT_EQ(expectedSurvivor(snakes, tick), 8);
+    EXPECT_EQ(survivorsAfter(snakes, tick), std::vector<int> {8});
+}
+
+// The body grid is updated cell by cell as snakes move, grow and die. After every tick it must
+// match a count taken from the bodies themselves
+TEST_F(CellOccupancy, MatchesTheBodiesThroughGrowthMovesAndDeaths) {
+    const int64_t first {START_NS + MOVE_NS};
+    const std::vector<Snake> snakes {
+        {1, {{10, 20}, {9, 20}, {8, 20}}, '>', first},             // eats twice
+        {2, {{30, 2}, {30, 3}, {30, 4}}, '^', first},              // runs into the top edge
+        {3, {{11, 22}, {11, 23}, {11, 24}}, '^', first},           // runs into snake 1's neck
+        {4, {{20, 30}, {21, 30}, {22, 30}, {23, 30}}, '<', first}, // disconnects
+    };
+    const std::vector<protocol::GameState::Food> food {
+        {static_cast<int32_t>(Color::RED), SnakeConstants::FOOD_ICON, 11, 20},
+        {static_cast<int32_t>(Color::RED), SnakeConstants::FOOD_ICON, 12, 20},
+    };
+    std::vector<protocol::MessageVariant> records {};
+    for (int tick = 0; tick < 6; tick++) {
+        if (tick == 3) {
+            records.push_back(disconnect(first + tick * MOVE_NS, 4));
+        }
+        records.push_back(clock(first + tick * MOVE_NS));
+    }
+    record(snakes, food, records);
+
+    int ticks {0};
+    const protocol::GameState last {replay([&ticks](const SnakeServer & server) {
+        EXPECT_TRUE(server.occupancyMatchesBodies()) << "after tick " << ticks;
+        ticks++;
+    })};
+    EXPECT_EQ(ticks, 6);
+    ASSERT_EQ(last.players.size(), 1u);
+    EXPECT_EQ(last.players[0].clientId, 1);
+    EXPECT_GE(last.players[0].segments.size(), 5u);
+}
@@ -0,0 +1,174 @@
+#include "common/CompactGameState.h"
+#include "common/Constants.h"
+#include "common/Protocol.h"
+#include "snake_client/GameState.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    protocol::GameState makeState() {
+        const int32_t boostColor {static_cast<int32_t>(SPEED_BOOST_COLOR)};
+        return {{protocol::MessageType::GAME_STATE, -1, 123456789, 987654321012345},
+                8,
+                "alice",
+                {{3, '@', 2, 18}, {1, '@', 24, 8}},
+                {{boostColor, '*', 10, 12}},
+                {{7, 3, '>', 5, "alice", {{26, 22}, {26, 23}, {27, 23}, {28, 23}, {28, 22}, {28, 21}}},
+                 {9, 4, '^', 0, "bob", {}},
+                 {11, 5, 'v', 2, "carol", {{0, 0}}}}};
+    }
+
+    void expectSameState(const protocol::GameState & a, const protocol::GameState & b) {
+        EXPECT_EQ(a.hdr.messageType, b.hdr.messageType);
+        EXPECT_EQ(a.hdr.sequence, b.hdr.sequence);
+        EXPECT_EQ(a.hdr.transactTime, b.hdr.transactTime);
+        EXPECT_EQ(a.highScore, b.highScore);
+        EXPECT_EQ(std::memcmp(a.highScoreUsername, b.highScoreUsername, sizeof(a.highScoreUsername)), 0);
+        ASSERT_EQ(a.food.size(), b.food.size());
+        for (std::size_t i = 0; i < a.food.size(); i++) {
+            EXPECT_EQ(a.food[i].color, b.food[i].color);
+            EXPECT_EQ(a.food[i].icon, b.food[i].icon);
+            EXPECT_EQ(a.food[i].x, b.food[i].x);
+            EXPECT_EQ(a.food[i].y, b.food[i].y);
+        }
+        ASSERT_EQ(a.speedBoosts.size(), b.speedBoosts.size());
+        for (std::size_t i = 0; i < a.speedBoosts.size(); i++) {
+            EXPECT_EQ(a.speedBoosts[i].color, b.speedBoosts[i].color);
+            EXPECT_EQ(a.speedBoosts[i].icon, b.speedBoosts[i].icon);
+            EXPECT_EQ(a.speedBoosts[i].x, b.speedBoosts[i].x);
+            EXPECT_EQ(a.speedBoosts[i].y, b.speedBoosts[i].y);
+        }
+        ASSERT_EQ(a.players.size(), b.players.size());
+        for (std::size_t i = 0; i < a.players.size(); i++) {
+            EXPECT_EQ(a.players[i].clientId, b.players[i].clientId);
+            EXPECT_EQ(a.players[i].color, b.players[i].color);
+            EXPECT_EQ(a.players[i].direction, b.players[i].direction);
+            EXPECT_EQ(a.players[i].score, b.players[i].score);
+            EXPECT_EQ(std::memcmp(a.players[i].username, b.players[i].username, sizeof(a.players[i].username)), 0);
+            EXPECT_EQ(a.players[i].segments, b.players[i].segments);
+        }
+    }
+
+} // namespace
+
+TEST(CompactGameState, RoundTripsAGameState) {
+    protocol::GameState original {makeState()};
+    std::memcpy(original.players[1].username, "sixteen_letters_", sizeof(original.players[1].username)); // no NUL
+    const Bytes frame {protocol::serialiseCompact(original)};
+
+    EXPECT_EQ(protocol::peekHeader(frame).messageType, protocol::MessageType::GAME_STATE_COMPACT);
+    EXPECT_EQ(frame.size(), protocol::compactEncodedSize(original));
+    expectSameState(protocol::deserialiseCompact(frame), original);
+}
+
+TEST(CompactGameState, BodyThatJumpsStartsANewRun) {
+    protocol::GameState state {makeState()};
+    std::vector<protocol::GameState::Player::Segment> & body {state.players[0].segments};
+    const Bytes contiguous {protocol::serialiseCompact(state)};
+    body.insert(body.begin() + 3, {{40, 2}, {40, 3}});
+
+    const Bytes jumped {protocol::serialiseCompact(state)};
+    // two more runs, for the jump out and the jump back, and their steps no longer share a byte
+    EXPECT_EQ(jumped.size(), contiguous.size() + 2 * protocol::compact::RUN_PACKED_SIZE + 1);
+    expectSameState(protocol::deserialiseCompact(jumped), state);
+}
+
+TEST(CompactGameState, LongBodiesTakeTwoBitsAStep) {
+    protocol::GameState state {makeState()};
+    std::vector<protocol::GameState::Player::Segment> & body {state.players[0].segments};
+    body.clear();
+    // back and forth across 20 rows
+    for (int i = 0; i < 400; i++) {
+        const int row {i / 20};
+        body.push_back({row % 2 == 0 ? 100 + i % 20 : 119 - i % 20, 100 + row});
+    }
+    body.insert(body.begin() + 200, body[199]); // a repeated cell, as no step at all, still round trips
+
+    const Bytes compact {protocol::serialiseCompact(state)};
+    EXPECT_LT(compact.size() * 10, protocol::serialise(state).size());
+    expectSameState(protocol::deserialiseCompact(compact), state);
+}
+
+TEST(CompactGameState, RejectsWhatItCannotCarry) {
+    protocol::GameState state {makeState()};
+    state.food[0].x = protocol::COMPACT_MAX_COORDINATE + 1;
+    EXPECT_THROW(protocol::serialiseCompact(state), std::invalid_argument);
+
+    state = makeState();
+    state.speedBoosts[0].icon = '@';
+    EXPECT_THROW(protocol::serialiseCompact(state), std::invalid_argument);
+}
+
+TEST(CompactGameState, MalformedFramesThrow) {
+    const Bytes frame {protocol::serialiseCompact(makeState())};
+    EXPECT_THROW(protocol::deserialiseCompact(frame.substr(0, frame.size() - 1)), std::runtime_error);
+    EXPECT_THROW(protocol::deserialiseCompact(protocol::serialise(makeState())), std::runtime_error);
+
+    Bytes newer {frame};
+    newer[protocol::HEADER_PACKED_SIZE] = static_cast<char>(protocol::COMPACT_STATE_VERSION + 1);
+    EXPECT_THROW(protocol::deserialiseCompact(newer), std::runtime_error);
+}
+
+TEST(CompactGameState, ClientStateMatchesTheDeserialisedOne) {
+    const Bytes frame {protocol::serialiseCompact(makeState())};
+    const client::GameState inPlace {client::fromCompact(frame)};
+    const client::GameState expected {client::fromProtocol(protocol::deserialiseCompact(frame))};
+
+    EXPECT_EQ(inPlace.sequence, expected.sequence);
+    EXPECT_EQ(inPlace.serverHighScore, expected.serverHighScore);
+    ASSERT_EQ(inPlace.food.size(), expected.food.size());
+    for (std::size_t i = 0; i < expected.food.size(); i++) {
+        EXPECT_EQ(inPlace.food[i].x, expected.food[i].x);
+        EXPECT_EQ(inPlace.food[i].y, expected.food[i].y);
+        EXPECT_EQ(inPlace.food[i].icon, expected.food[i].icon);
+        EXPECT_EQ(inPlace.food[i].color, expected.food[i].color);
+    }
+    ASSERT_EQ(inPlace.speedBoosts.size(), expected.speedBoosts.size());
+    EXPECT_EQ(inPlace.speedBoosts[0].icon, expected.speedBoosts[0].icon);
+    EXPECT_EQ(inPlace.speedBoosts[0].color, expected.speedBoosts[0].color);
+    ASSERT_EQ(inPlace.players.size(), expected.players.size());
+    for (auto & [clientId, p] : expected.players) {
+        const client::PlayerData & v {inPlace.players.at(clientId)};
+        EXPECT_EQ(v.name, p.name);
+        EXPECT_EQ(v.direction, p.direction);
+        EXPECT_EQ(v.score, p.score);
+        EXPECT_EQ(v.color, p.color);
+        EXPECT_EQ(v.segments, p.segments);
+    }
+}
+
+// a count is only trusted as far as the bytes left could hold, so a corrupt one can't make either
+// reader reserve gigabytes before finding the frame is short
+TEST(CompactGameState, CountsPastTheEndOfTheFrameThrow) {
+    protocol::GameState state {makeState()};
+    state.food.clear();
+    const Bytes frame {protocol::serialiseCompact(state)};
+    const std::size_t foodCount {protocol::HEADER_PACKED_SIZE + sizeof(protocol::COMPACT_STATE_VERSION) +
+                                 sizeof(state.highScore) + 1 + std::strlen(state.highScoreUsername)};
+    Bytes corrupt {frame};
+    const uint32_t huge {UINT32_MAX};
+    std::memcpy(corrupt.data() + foodCount, &huge, sizeof(huge));
+    EXPECT_THROW(protocol::deserialiseCompact(corrupt), std::runtime_error);
+    EXPECT_THROW(client::fromCompact(corrupt), std::runtime_error);
+
+    // the first player's body, claiming far more cells than its runs could carry
+    state = makeState();
+    state.food.clear();
+    state.speedBoosts.clear();
+    const Bytes withPlayers {protocol::serialiseCompact(state)};
+    const std::size_t bodyCount {foodCount + 3 * protocol::COUNT_PACKED_SIZE + protocol::compact::PLAYER_PACKED_SIZE +
+                                 1 + std::strlen(state.players[0].username)};
+    uint32_t cells;
+    std::memcpy(&cells, withPlayers.data() + bodyCount, sizeof(cells));
+    ASSERT_EQ(cells, state.players[0].segments.size());
+    corrupt = withPlayers;
+    std::memcpy(corrupt.data() + bodyCount, &huge, sizeof(huge));
+    EXPECT_THROW(protocol::deserialiseCompact(corrupt), std::runtime_error);
+    EXPECT_THROW(client::fromCompact(corrupt), std::runtime_error);
+}
@@ -0,0 +1,89 @@
+#include "snake_server/DeadlineQueue.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <optional>
+#include <vector>
+
+namespace {
+
+    using TimePoint = DeadlineQueue::TimePoint;
+
+    TimePoint at(const int ms) {
+        return TimePoint {std::chrono::milliseconds {ms}};
+    }
+
+    std::vector<int> popAllDue(DeadlineQueue & queue, const TimePoint now) {
+        std::vector<int> clientIds {};
+        while (const std::optional<DeadlineQueue::Entry> entry = queue.popDue(now)) {
+            clientIds.push_back(entry->clientId);
+        }
+        return clientIds;
+    }
+
+    // pops what is due the way updateSnakes does, keeping only entries that still match the
+    // player's current deadline
+    std::vector<int> popCurrent(DeadlineQueue & queue, const TimePoint now,
+                                const std::map<int, TimePoint> & deadlines) {
+        std::vector<int> clientIds {};
+        while (const std::optional<DeadlineQueue::Entry> entry = queue.popDue(now)) {
+            const auto it {deadlines.find(entry->clientId)};
+            if (it != deadlines.end() && it->second == entry->time) {
+                clientIds.push_back(entry->clientId);
+            }
+        }
+        return clientIds;
+    }
+
+} // namespace
+
+TEST(DeadlineQueue, PopsOnlyWhatIsDueInDeadlineOrder) {
+    DeadlineQueue queue {};
+    EXPECT_EQ(queue.earliest(), std::nullopt);
+    queue.push(at(30), 1);
+    queue.push(at(10), 2);
+    queue.push(at(20), 3);
+
+    EXPECT_EQ(queue.earliest(), at(10));
+    EXPECT_EQ(popAllDue(queue, at(5)), std::vector<int> {});
+    EXPECT_EQ(popAllDue(queue, at(20)), (std::vector<int> {2, 3}));
+    EXPECT_EQ(queue.earliest(), at(30));
+    EXPECT_EQ(queue.size(), 1u);
+}
+
+// equal deadlines pop in clientId order, whatever order they were pushed in
+TEST(DeadlineQueue, TiesPopInClientIdOrder) {
+    DeadlineQueue queue {};
+    for (const int clientId : {7, 3, 9, 1, 5}) {
+        queue.push(at(10), clientId);
+    }
+    queue.push(at(5), 8);
+    queue.push(at(15), 2);
+
+    EXPECT_EQ(popAllDue(queue, at(20)), (std::vector<int> {8, 1, 3, 5, 7, 9, 2}));
+}
+
+// a rescheduled player's old entry and a removed player's entry stay queued, and are dropped
+// when they come up because they no longer match a current deadline
+TEST(DeadlineQueue, StaleEntriesAreSkippedOnPop) {
+    DeadlineQueue queue {};
+    std::map<int, TimePoint> deadlines {{1, at(10)}, {2, at(10)}, {3, at(20)}};
+    for (const auto & [clientId, time] : deadlines) {
+        queue.push(time, clientId);
+    }
+
+    // player 1 is boosted to an earlier deadline, player 2 pushed back, player 3 leaves
+    deadlines[1] = at(5);
+    queue.push(at(5), 1);
+    deadlines[2] = at(25);
+    queue.push(at(25), 2);
+    deadlines.erase(3);
+    EXPECT_EQ(queue.size(), 5u);
+
+    EXPECT_EQ(popCurrent(queue, at(10), deadlines), std::vector<int> {1});
+    EXPECT_EQ(popCurrent(queue, at(20), deadlines), std::vector<int> {});
+    EXPECT_EQ(popCurrent(queue, at(30), deadlines), std::vector<int> {2});
+    EXPECT_EQ(queue.size(), 0u);
+}
@@ -0,0 +1,130 @@
+#include "common/FrameBuffer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <fcntl.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+    // a connected pair of sockets, reads from fds[1] don't block
+    struct SocketPair {
+        SocketPair() {
+            EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+            fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+        }
+        ~SocketPair() {
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        void send(const std::string & bytes) const {
+            EXPECT_EQ(write(fds[0], bytes.data(), bytes.size()), static_cast<ssize_t>(bytes.size()));
+        }
+
+        int fds[2];
+    };
+
+    std::string framed(const std::string & payload) {
+        const uint32_t len {static_cast<uint32_t>(payload.size())};
+        return std::string(reinterpret_cast<const char *>(&len), sizeof(len)) + payload;
+    }
+
+    std::vector<std::string> takeAll(FrameBuffer & buffer) {
+        std::vector<std::string> frames {};
+        while (std::optional<std::string_view> frame {buffer.next()}) {
+            frames.emplace_back(*frame);
+        }
+        return frames;
+    }
+
+} // namespace
+
+TEST(FrameBuffer, SplitsABurstAndKeepsThePartialFrame) {
+    SocketPair sockets {};
+    FrameBuffer buffer {64, 4096};
+    std::string burst {};
+    for (int i = 0; i < 100; i++) {
+        burst += framed("frame " + std::to_string(i));
+    }
+    const std::string last {framed("the last one")};
+    sockets.send(burst + last.substr(0, 7));
+
+    EXPECT_EQ(buffer.fill(sockets.fds[1]), FrameBuffer::FillResult::DRAINED);
+    const std::vector<std::string> frames {takeAll(buffer)};
+    ASSERT_EQ(frames.size(), 100u);
+    EXPECT_EQ(frames.front(), "frame 0");
+    EXPECT_EQ(frames.back(), "frame 99");
+    EXPECT_EQ(buffer.buffered(), 7u);
+
+    sockets.send(last.substr(7));
+    EXPECT_EQ(buffer.fill(sockets.fds[1]), FrameBuffer::FillResult::DRAINED);
+    EXPECT_EQ(takeAll(buffer), std::vector<std::string> {"the last one"});
+    EXPECT_EQ(buffer.buffered(), 0u);
+}
+
+TEST(FrameBuffer, StopsWhenFullAndPicksUpTheRestNextTime) {
+    SocketPair sockets {};
+    FrameBuffer buffer {16, 64};
+    std::string sent {};
+    for (int i = 0; i < 20; i++) {
+        sent += framed("frame " + std::to_string(i));
+    }
+    sockets.send(sent);
+
+    std::vector<std::string> frames {};
+    FrameBuffer::FillResult result {FrameBuffer::FillResult::FULL};
+    while (result == FrameBuffer::FillResult::FULL) {
+        result = buffer.fill(sockets.fds[1]);
+        for (const std::string & frame : takeAll(buffer)) {
+            frames.push_back(frame);
+        }
+    }
+    EXPECT_EQ(result, FrameBuffer::FillResult::DRAINED);
+    ASSERT_EQ(frames.size(), 20u);
+    EXPECT_EQ(frames[19], "frame 19");
+}
+
+TEST(FrameBuffer, AppendedBytesComeBeforeTheSocket) {
+    SocketPair sockets {};
+    FrameBuffer buffer {64, 4096};
+    const std::string second {framed("second")};
+    buffer.append(framed("first") + second.substr(0, 3));
+    sockets.send(second.substr(3));
+
+    EXPECT_EQ(buffer.fill(sockets.fds[1]), FrameBuffer::FillResult::DRAINED);
+    EXPECT_EQ(takeAll(buffer), (std::vector<std::string> {"first", "second"}));
+}
+
+TEST(FrameBuffer, ReportsAnOversizedFrameAndTheClose) {
+    SocketPair sockets {};
+    FrameBuffer buffer {8, 4096};
+    sockets.send(framed("fits") + framed("far too long"));
+    shutdown(sockets.fds[0], SHUT_WR);
+
+    EXPECT_EQ(buffer.fill(sockets.fds[1]), FrameBuffer::FillResult::CLOSED);
+    EXPECT_EQ(takeAll(buffer), std::vector<std::string> {"fits"});
+    EXPECT_EQ(buffer.oversizedFrame(), std::optional<uint32_t> {12});
+}
+
+TEST(FrameBuffer, GrowsForAFrameOnceTheLimitAllowsIt) {
+    SocketPair sockets {};
+    FrameBuffer buffer {8, 16};
+    const std::string big(1000, 'x');
+    sockets.send(framed("limit") + framed(big));
+
+    EXPECT_EQ(buffer.fill(sockets.fds[1]), FrameBuffer::FillResult::FULL);
+    EXPECT_EQ(takeAll(buffer), std::vector<std::string> {"limit"});
+    EXPECT_EQ(buffer.oversizedFrame(), std::optional<uint32_t> {1000});
+
+    buffer.setMaxFrameSize(big.size());
+    EXPECT_EQ(buffer.oversizedFrame(), std::nullopt);
+    EXPECT_EQ(buffer.fill(sockets.fds[1]), FrameBuffer::FillResult::FULL);
+    EXPECT_EQ(takeAll(buffer), std::vector<std::string> {big});
+}
@@ -0,0 +1,131 @@
+#include "common/Protocol.h"
+#include "snake_client/GameState.h"
+#include "snake_server/GameStateDiff.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <deque>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    protocol::GameState makeState(int64_t sequence, std::vector<protocol::GameState::Food> food,
+                                  std::vector<protocol::GameState::Player> players) {
+        return {{protocol::MessageType::GAME_STATE, -1, sequence, sequence * 1000}, 3, "bot", std::move(food), {},
+                std::move(players)};
+    }
+
+    // applying the diff of base -> next to a client holding base must give the client next
+    void expectDiffReproduces(const protocol::GameState & base, const protocol::GameState & next) {
+        client::GameState state {client::fromProtocol(base)};
+        const protocol::GameStateDelta delta {
+            std::get<protocol::GameStateDelta>(protocol::deserialise(protocol::serialise(diffGameStates(base, next))))};
+        ASSERT_TRUE(client::applyDelta(state, delta));
+
+        const client::GameState expected {client::fromProtocol(next)};
+        EXPECT_EQ(state.sequence, expected.sequence);
+        ASSERT_EQ(state.players.size(), expected.players.size());
+        for (auto & [id, p] : expected.players) {
+            ASSERT_TRUE(state.players.contains(id));
+            EXPECT_EQ(state.players.at(id).segments, p.segments);
+            EXPECT_EQ(state.players.at(id).direction, p.direction);
+            EXPECT_EQ(state.players.at(id).score, p.score);
+        }
+
+        auto cells = [](const client::GameState & s) {
+            std::vector<std::pair<int, int>> out {};
+            for (auto & f : s.food) {
+                out.push_back({f.x, f.y});
+            }
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+        EXPECT_EQ(cells(state), cells(expected));
+    }
+
+} // namespace
+
+TEST(GameStateDelta, MoveAndGrow) {
+    const protocol::GameState base {makeState(10, {{3, '@', 5, 4}, {3, '@', 9, 9}},
+                                              {{1, 2, '^', 1, "a", {{5, 5}, {5, 6}}}, {2, 3, '<', 0, "b", {{8, 8}}}})};
+    const protocol::GameState next {makeState(11, {{3, '@', 9, 9}, {3, '@', 1, 1}},
+                                              {{1, 2, '^', 2, "a", {{5, 4}, {5, 5}, {5, 6}}},
+                                               {2, 3, '<', 0, "b", {{7, 8}}}})};
+    expectDiffReproduces(base, next);
+
+    const protocol::GameStateDelta delta {diffGameStates(base, next)};
+    EXPECT_TRUE(delta.playersJoined.empty());
+    EXPECT_EQ(delta.playersUpdated.size(), 2u);
+    EXPECT_EQ(delta.foodRemoved.size(), 1u);
+    EXPECT_EQ(delta.foodAdded.size(), 1u);
+}
+
+TEST(GameStateDelta, JoinAndDeath) {
+    const protocol::GameState base {makeState(10, {}, {{1, 2, '^', 1, "a", {{5, 5}}}, {2, 3, '<', 0, "b", {{8, 8}}}})};
+    const protocol::GameState next {makeState(12, {}, {{2, 3, '<', 0, "b", {{7, 8}}}, {4, 5, '^', 1, "c", {{3, 3}}}})};
+    expectDiffReproduces(base, next);
+}
+
+TEST(GameStateDelta, RejectsDeltaAgainstAnotherBase) {
+    const protocol::GameState base {makeState(10, {}, {{1, 2, '^', 1, "a", {{5, 5}}}})};
+    const protocol::GameState next {makeState(11, {}, {{1, 2, '^', 1, "a", {{5, 4}}}})};
+    client::GameState state {client::fromProtocol(makeState(9, {}, {}))};
+    EXPECT_FALSE(client::applyDelta(state, diffGameStates(base, next)));
+    EXPECT_EQ(state.sequence, 9);
+}
+
+TEST(GameStateDelta, RejectsUpdatesItCannotApply) {
+    const protocol::GameState base {makeState(10, {}, {{1, 2, '^', 1, "a", {{5, 5}, {5, 6}}}})};
+    const protocol::GameState next {makeState(11, {}, {{1, 2, '^', 1, "a", {{5, 4}, {5, 5}}}})};
+    const protocol::GameStateDelta good {diffGameStates(base, next)};
+    ASSERT_EQ(good.playersUpdated.size(), 1u);
+
+    protocol::GameStateDelta unknown {good};
+    unknown.playersUpdated[0].clientId = 7;
+    protocol::GameStateDelta overTrimmed {good};
+    overTrimmed.playersUpdated[0].tailTrim = 3;
+    protocol::GameStateDelta removed {good};
+    removed.playersRemoved.push_back(1);
+
+    for (const protocol::GameStateDelta & bad : {unknown, overTrimmed, removed}) {
+        client::GameState state {client::fromProtocol(base)};
+        EXPECT_FALSE(client::applyDelta(state, bad));
+        EXPECT_EQ(state.sequence, 10);
+        EXPECT_EQ(state.players.at(1).segments, (std::deque<std::pair<int, int>> {{5, 5}, {5, 6}}));
+    }
+}
+
+// a batch is applied from its latest keyframe on, and everything that isn't a state reaches the
+// caller in order
+TEST(GameStateDelta, ApplyFramesStartsFromTheLatestKeyframe) {
+    const protocol::GameState old {makeState(8, {}, {{1, 2, '^', 1, "a", {{5, 7}}}})};
+    const protocol::GameState base {makeState(10, {}, {{1, 2, '^', 1, "a", {{5, 5}}}})};
+    const protocol::GameState next {makeState(11, {}, {{1, 2, '^', 1, "a", {{5, 4}}}})};
+    const std::vector<Bytes> encoded {
+        protocol::serialise(old),
+        protocol::serialise(protocol::ServerWelcome {{protocol::MessageType::SERVER_WELCOME, 1}, {}}),
+        protocol::serialise(diffGameStates(old, makeState(9, {}, {{1, 2, '^', 1, "a", {{5, 6}}}}))),
+        protocol::serialise(base),
+        protocol::serialise(diffGameStates(base, next)),
+        protocol::serialise(protocol::Leaderboard {{protocol::MessageType::LEADERBOARD}, {}}),
+    };
+    const std::vector<std::string_view> frames(encoded.begin(), encoded.end());
+
+    client::GameState state {};
+    std::vector<protocol::MessageType> others {};
+    EXPECT_TRUE(client::applyFrames(state, frames, [&others](const protocol::MessageVariant & msg) {
+        others.push_back(protocol::header(msg).messageType);
+    }));
+    EXPECT_EQ(state.sequence, 11);
+    EXPECT_EQ(state.players.at(1).segments, (std::deque<std::pair<int, int>> {{5, 4}}));
+    EXPECT_EQ(others, (std::vector<protocol::MessageType> {protocol::MessageType::SERVER_WELCOME,
+                                                           protocol::MessageType::LEADERBOARD}));
+
+    // nothing but a delta against a state it doesn't hold leaves it as it was
+    const std::vector<std::string_view> stale {frames[2]};
+    EXPECT_FALSE(client::applyFrames(state, stale, [](const protocol::MessageVariant &) {}));
+    EXPECT_EQ(state.sequence, 11);
+}
@@ -0,0 +1,89 @@
+#include "common/GameStateView.h"
+#include "common/Protocol.h"
+#include "snake_client/GameState.h"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    protocol::GameState makeState() {
+        return {{protocol::MessageType::GAME_STATE, -1, 123456789, 987654321012345},
+                8,
+                "alice",
+                {{3, '@', 2, 18}, {1, '@', 24, 8}},
+                {{5, '*', 10, 12}},
+                {{7, 3, '>', 5, "alice", {{26, 22}, {26, 23}, {27, 23}}}, {9, 4, '^', 0, "bob", {}}}};
+    }
+
+} // namespace
+
+TEST(GameStateView, ReadsEveryFieldInPlace) {
+    const protocol::GameState original {makeState()};
+    const Bytes frame {protocol::serialise(original)};
+    const protocol::GameStateView view {frame};
+
+    EXPECT_EQ(view.header().sequence, 123456789);
+    EXPECT_EQ(view.highScore(), 8);
+    EXPECT_EQ(view.highScoreUsername(), "alice");
+
+    ASSERT_EQ(view.food().size(), 2u);
+    std::vector<std::pair<int, int>> food {};
+    for (const protocol::GameState::Food f : view.food()) {
+        food.push_back({f.x, f.y});
+        EXPECT_EQ(f.icon, '@');
+    }
+    EXPECT_EQ(food, (std::vector<std::pair<int, int>> {{2, 18}, {24, 8}}));
+    ASSERT_EQ(view.speedBoosts().size(), 1u);
+    EXPECT_EQ((*view.speedBoosts().begin()).color, 5);
+
+    ASSERT_EQ(view.players().size(), 2u);
+    auto player {view.players().begin()};
+    EXPECT_EQ((*player).clientId(), 7);
+    EXPECT_EQ((*player).color(), 3);
+    EXPECT_EQ((*player).direction(), '>');
+    EXPECT_EQ((*player).score(), 5);
+    EXPECT_EQ((*player).username(), "alice");
+    const protocol::CellRange segments {(*player).segments()};
+    EXPECT_EQ((std::vector<protocol::GameState::Player::Segment>(segments.begin(), segments.end())),
+              original.players[0].segments);
+    ++player;
+    EXPECT_EQ((*player).username(), "bob");
+    EXPECT_TRUE((*player).segments().empty());
+    EXPECT_EQ(++player, view.players().end());
+}
+
+TEST(GameStateView, ClientStateMatchesTheDeserialisedOne) {
+    const protocol::GameState original {makeState()};
+    const client::GameState fromView {client::fromProtocol(protocol::GameStateView {protocol::serialise(original)})};
+    const client::GameState expected {client::fromProtocol(original)};
+
+    EXPECT_EQ(fromView.sequence, expected.sequence);
+    EXPECT_EQ(fromView.serverHighScore, expected.serverHighScore);
+    EXPECT_EQ(fromView.food.size(), expected.food.size());
+    EXPECT_EQ(fromView.speedBoosts.size(), expected.speedBoosts.size());
+    ASSERT_EQ(fromView.players.size(), expected.players.size());
+    for (auto & [clientId, p] : expected.players) {
+        const client::PlayerData & v {fromView.players.at(clientId)};
+        EXPECT_EQ(v.name, p.name);
+        EXPECT_EQ(v.direction, p.direction);
+        EXPECT_EQ(v.score, p.score);
+        EXPECT_EQ(v.color, p.color);
+        EXPECT_EQ(v.segments, p.segments);
+    }
+}
+
+TEST(GameStateView, RejectsTruncatedFramesAndOtherTypes) {
+    const Bytes frame {protocol::serialise(makeState())};
+    for (std::size_t size {0}; size < frame.size(); size++) {
+        EXPECT_THROW(protocol::GameStateView {std::string_view {frame}.substr(0, size)}, std::runtime_error)
+            << "cut to " << size << " bytes";
+    }
+    EXPECT_THROW(protocol::GameStateView {protocol::serialise(
+                     protocol::ClientInput {{protocol::MessageType::CLIENT_INPUT, 1, 2, 3}, '^'})},
+                 std::runtime_error);
+}
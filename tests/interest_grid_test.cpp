@@ -0,0 +1,66 @@
+#include "common/Protocol.h"
+#include "snake_server/InterestGrid.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    protocol::GameState makeState(std::vector<protocol::GameState::Food> food,
+                                  std::vector<protocol::GameState::Player> players) {
+        return {{protocol::MessageType::GAME_STATE, -1, 5, 5000}, 3, "bot", std::move(food), {}, std::move(players)};
+    }
+
+    std::vector<int32_t> idsOf(const protocol::GameState & state) {
+        std::vector<int32_t> ids {};
+        for (auto & p : state.players) {
+            ids.push_back(p.clientId);
+        }
+        return ids;
+    }
+
+} // namespace
+
+TEST(InterestGrid, ViewHoldsOnlyItemsWithinTheRadius) {
+    InterestGrid grid {100, 100, 16};
+    const protocol::GameState state {
+        makeState({{1, '*', 50, 50}, {1, '*', 55, 45}, {1, '*', 56, 50}, {1, '*', 1, 1}, {1, '*', 100, 100}}, {})};
+    grid.build(state);
+
+    const protocol::GameState view {grid.view(state, {50, 50}, 5)};
+    std::vector<std::pair<int32_t, int32_t>> cells {};
+    for (auto & f : view.food) {
+        cells.push_back({f.x, f.y});
+    }
+    std::sort(cells.begin(), cells.end());
+    EXPECT_EQ(cells, (std::vector<std::pair<int32_t, int32_t>> {{50, 50}, {55, 45}}));
+    EXPECT_EQ(view.hdr.sequence, state.hdr.sequence);
+    EXPECT_EQ(view.highScore, state.highScore);
+
+    // the corners of the arena are reachable too
+    EXPECT_EQ(grid.view(state, {100, 100}, 3).food.size(), 1u);
+    EXPECT_EQ(grid.view(state, {1, 1}, 3).food.size(), 1u);
+}
+
+TEST(InterestGrid, SnakeTouchingTheViewIsSentWholeAndOnce) {
+    InterestGrid grid {100, 100, 16};
+    const protocol::GameState state {makeState({}, {{7, 1, '>', 3, "near", {{40, 40}, {39, 40}, {38, 40}}},
+                                                    {2, 1, '<', 0, "tail", {{70, 40}, {71, 40}, {72, 40}, {73, 40}}},
+                                                    {4, 1, 'v', 9, "edge", {{30, 10}, {30, 9}, {30, 8}}}})};
+    grid.build(state);
+
+    const protocol::GameState view {grid.view(state, {33, 42}, 10)};
+    EXPECT_EQ(idsOf(view), (std::vector<int32_t> {7}));
+    EXPECT_EQ(view.players[0].segments.size(), 3u);
+
+    // only the tail of snake 2 is in range, and it still comes with its head
+    const protocol::GameState tailView {grid.view(state, {80, 40}, 7)};
+    ASSERT_EQ(idsOf(tailView), (std::vector<int32_t> {2}));
+    EXPECT_EQ(tailView.players[0].segments.front(), (std::pair<int32_t, int32_t> {70, 40}));
+
+    // views keep the order of the global state
+    EXPECT_EQ(idsOf(grid.view(state, {50, 25}, 30)), (std::vector<int32_t> {7, 2, 4}));
+}
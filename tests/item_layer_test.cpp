@@ -0,0 +1,122 @@
+#include "common/Constants.h"
+#include "snake_server/ItemLayer.h"
+#include "snake_server/Player.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    Food food(const int x, const int y, const Color color = Color::RED) {
+        return {x, y, SnakeConstants::FOOD_ICON, color};
+    }
+
+    std::vector<std::pair<int, int>> cellsOf(const ItemLayer<Food> & layer) {
+        std::vector<std::pair<int, int>> cells {};
+        for (const Food & f : layer.all()) {
+            cells.emplace_back(f.x, f.y);
+        }
+        return cells;
+    }
+
+    // the digest a layer holding just these items has, built from scratch
+    uint64_t digestOf(const std::vector<Food> & items) {
+        ItemLayer<Food> layer {10, 10};
+        for (const Food & f : items) {
+            layer.place(f);
+        }
+        return layer.digest();
+    }
+
+} // namespace
+
+TEST(ItemLayer, PlaceFillsOnlyItsCell) {
+    ItemLayer<Food> layer {10, 10};
+    EXPECT_TRUE(layer.empty());
+    layer.place(food(1, 1));
+    layer.place(food(10, 10));
+    layer.place(food(4, 7));
+
+    EXPECT_EQ(layer.size(), 3u);
+    EXPECT_TRUE(layer.contains({1, 1}));
+    EXPECT_TRUE(layer.contains({10, 10}));
+    EXPECT_TRUE(layer.contains({4, 7}));
+    EXPECT_FALSE(layer.contains({7, 4}));
+    EXPECT_FALSE(layer.contains({2, 1}));
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{1, 1}, {10, 10}, {4, 7}}));
+}
+
+// erase fills the hole with the last item, and the moved item can still be found and erased
+TEST(ItemLayer, EraseSwapsTheLastItemIntoTheHole) {
+    ItemLayer<Food> layer {10, 10};
+    for (int x = 1; x <= 4; x++) {
+        layer.place(food(x, 1));
+    }
+
+    layer.erase({2, 1});
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{1, 1}, {4, 1}, {3, 1}}));
+    layer.erase({1, 1});
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{3, 1}, {4, 1}}));
+    layer.erase({4, 1});
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{3, 1}}));
+
+    EXPECT_FALSE(layer.contains({1, 1}));
+    EXPECT_FALSE(layer.contains({2, 1}));
+    EXPECT_TRUE(layer.contains({3, 1}));
+    EXPECT_FALSE(layer.contains({4, 1}));
+
+    // erasing an empty cell leaves the layer as it was
+    layer.erase({2, 1});
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{3, 1}}));
+    layer.erase({3, 1});
+    EXPECT_TRUE(layer.empty());
+}
+
+TEST(ItemLayer, PlaceReusesAFreedCell) {
+    ItemLayer<Food> layer {10, 10};
+    layer.place(food(5, 5, Color::RED));
+    layer.place(food(6, 5));
+    layer.erase({5, 5});
+    layer.place(food(5, 5, Color::GREEN));
+
+    EXPECT_EQ(layer.size(), 2u);
+    EXPECT_TRUE(layer.contains({5, 5}));
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{6, 5}, {5, 5}}));
+    EXPECT_EQ(layer.all()[1].color, Color::GREEN);
+
+    // placing onto an occupied cell replaces the item where it is
+    layer.place(food(6, 5, Color::CYAN));
+    EXPECT_EQ(layer.size(), 2u);
+    EXPECT_EQ(cellsOf(layer), (std::vector<std::pair<int, int>> {{6, 5}, {5, 5}}));
+    EXPECT_EQ(layer.all()[0].color, Color::CYAN);
+}
+
+// after any mix of operations the digest is the one the remaining items give on their own
+TEST(ItemLayer, DigestStaysInStepWithTheItems) {
+    ItemLayer<Food> layer {10, 10};
+    EXPECT_EQ(layer.digest(), 0u);
+
+    layer.place(food(1, 1));
+    layer.place(food(2, 2));
+    layer.place(food(3, 3));
+    EXPECT_EQ(layer.digest(), digestOf(layer.all()));
+    EXPECT_EQ(layer.digest(), digestOf({food(3, 3), food(1, 1), food(2, 2)}));
+
+    layer.erase({1, 1});
+    EXPECT_EQ(layer.digest(), digestOf({food(2, 2), food(3, 3)}));
+
+    layer.place(food(2, 2, Color::YELLOW));
+    EXPECT_EQ(layer.digest(), digestOf({food(2, 2, Color::YELLOW), food(3, 3)}));
+    EXPECT_NE(layer.digest(), digestOf({food(2, 2), food(3, 3)}));
+
+    layer.place(food(1, 1));
+    layer.erase({1, 1});
+    EXPECT_EQ(layer.digest(), digestOf({food(2, 2, Color::YELLOW), food(3, 3)}));
+
+    layer.erase({2, 2});
+    layer.erase({3, 3});
+    EXPECT_EQ(layer.digest(), 0u);
+}
@@ -0,0 +1,61 @@
+#include "common/Lz.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+    std::string roundTrip(const std::string & raw) {
+        lz::Compressor compressor {};
+        std::string compressed {};
+        compressor.compress(raw, compressed);
+        std::string decompressed {};
+        lz::decompress(compressed, raw.size(), decompressed);
+        return decompressed;
+    }
+
+} // namespace
+
+TEST(Lz, RoundTripsEdgeCases) {
+    for (const std::string & raw : {std::string {}, std::string {"a"}, std::string {"abcd"}, std::string(1000, 'x'),
+                                    std::string {"abcabcabcabcabcabcabcabc"}}) {
+        EXPECT_EQ(roundTrip(raw), raw);
+    }
+}
+
+TEST(Lz, RoundTripsRandomAndRepetitiveData) {
+    std::mt19937 rng {7};
+    std::string noise(100000, '\0');
+    for (char & c : noise) {
+        c = static_cast<char>(rng());
+    }
+    EXPECT_EQ(roundTrip(noise), noise);
+
+    // long literal runs and long matches both need the 255-continued lengths
+    std::string repetitive {};
+    for (int i = 0; i < 2000; i++) {
+        repetitive += noise.substr(static_cast<std::size_t>(i % 13) * 300, 300);
+        repetitive += std::to_string(i);
+    }
+    lz::Compressor compressor {};
+    std::string compressed {};
+    compressor.compress(repetitive, compressed);
+    EXPECT_LT(compressed.size() * 10, repetitive.size());
+    EXPECT_EQ(roundTrip(repetitive), repetitive);
+}
+
+TEST(Lz, MalformedInputThrows) {
+    const std::string raw(500, 'z');
+    lz::Compressor compressor {};
+    std::string compressed {};
+    compressor.compress(raw, compressed);
+    std::string out {};
+
+    EXPECT_THROW(lz::decompress(compressed, raw.size() + 1, out), std::runtime_error);
+    EXPECT_THROW(lz::decompress(compressed.substr(0, compressed.size() / 2), raw.size(), out), std::runtime_error);
+    // a match reaching back before the start of the block
+    EXPECT_THROW(lz::decompress(std::string {"\x10" "a" "\x05"}, 5, out), std::runtime_error);
+}
@@ -0,0 +1,214 @@
+#include "common/MessageLogReader.h"
+#include "common/MessageLogWriter.h"
+#include "common/Protocol.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+
+    class MessageLogReaderTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            std::filesystem::remove_all(workDir);
+            std::filesystem::create_directories(workDir);
+        }
+
+        void TearDown() override { std::filesystem::remove_all(workDir); }
+
+        std::string name() const { return (workDir / "log").string(); }
+
+        // two inputs and a game state at t=100, a disconnect at t=200
+        void writeLog(const MessageLogWriter::Options & options = {}) {
+            MessageLogWriter writer {name(), true, options};
+            writer.log(protocol::serialise(
+                protocol::ClientInput {{protocol::MessageType::CLIENT_INPUT, 1, 0, 100}, '^'}));
+            writer.log(protocol::serialise(
+                protocol::ClientInput {{protocol::MessageType::CLIENT_INPUT, 2, 1, 100}, '<'}));
+            protocol::GameState state {};
+            state.hdr = {protocol::MessageType::GAME_STATE, -1, 2, 100};
+            state.highScore = 5;
+            writer.log(protocol::serialise(state));
+            writer.log(protocol::serialise(
+                protocol::ClientDisconnect {{protocol::MessageType::CLIENT_DISCONNECT, 1, 3, 200}}));
+        }
+
+        // a game state a tick for a snake crawling along a row, so each state repeats most of the last one
+        std::vector<Bytes> writeGame(const std::string & file, const MessageLogWriter::Options & options) {
+            std::vector<Bytes> records {};
+            MessageLogWriter writer {file, true, options};
+            for (int64_t tick = 0; tick < 400; tick++) {
+                protocol::GameState state {};
+                state.hdr = {protocol::MessageType::GAME_STATE, -1, tick, tick * 10};
+                state.highScore = static_cast<int32_t>(tick / 50);
+                protocol::GameState::Player player {};
+                player.clientId = 1;
+                player.direction = '>';
+                for (int32_t x = 0; x < 20; x++) {
+                    player.segments.emplace_back(static_cast<int32_t>(tick) + 20 - x, 7);
+                }
+                state.players.push_back(player);
+                records.push_back(protocol::serialise(state));
+                writer.log(records.back());
+            }
+            return records;
+        }
+
+        const std::filesystem::path workDir {std::filesystem::temp_directory_path() / "snake_message_log_reader_test"};
+    };
+
+} // namespace
+
+TEST_F(MessageLogReaderTest, RecordsAreViewsWithDecodedHeaders) {
+    writeLog();
+    MessageLogReader reader {name() + ".bin"};
+
+    std::vector<MessageLogReader::Record> records {};
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        records.push_back(*record);
+    }
+    ASSERT_EQ(records.size(), 4u);
+    EXPECT_EQ(records[0].offset, 0u);
+    EXPECT_EQ(records[1].offset, sizeof(uint32_t) + records[0].bytes.size());
+    EXPECT_EQ(records[2].hdr.messageType, protocol::MessageType::GAME_STATE);
+    EXPECT_EQ(records[3].hdr.sequence, 3);
+    EXPECT_EQ(records[3].hdr.transactTime, 200);
+    EXPECT_EQ(reader.size(), records[3].offset + sizeof(uint32_t) + records[3].bytes.size());
+
+    const protocol::GameState state {std::get<protocol::GameState>(protocol::deserialise(records[2].bytes))};
+    EXPECT_EQ(state.highScore, 5);
+}
+
+TEST_F(MessageLogReaderTest, BatchesByTransactTimeAndFiltersByType) {
+    writeLog();
+    MessageLogReader reader {name() + ".bin"};
+    std::vector<MessageLogReader::Record> batch {};
+    const MessageLogReader::TypeMask inputs {MessageLogReader::typeMask({protocol::MessageType::CLIENT_INPUT})};
+
+    EXPECT_EQ(reader.nextBatch(batch, inputs), 100);
+    ASSERT_EQ(batch.size(), 2u);
+    EXPECT_EQ(batch[0].hdr.clientId, 1);
+    EXPECT_EQ(batch[1].hdr.clientId, 2);
+
+    // nothing matches at t=200, but the batch is still there to keep the clock
+    EXPECT_EQ(reader.nextBatch(batch, inputs), 200);
+    EXPECT_TRUE(batch.empty());
+
+    EXPECT_FALSE(reader.nextBatch(batch, inputs));
+}
+
+TEST_F(MessageLogReaderTest, DecodedBatchesAndSeek) {
+    writeLog();
+    MessageLogReader reader {name() + ".bin"};
+
+    EXPECT_EQ(reader.nextBatch().size(), 3u);
+    const std::vector<protocol::MessageVariant> last {reader.nextBatch()};
+    ASSERT_EQ(last.size(), 1u);
+    EXPECT_TRUE(std::holds_alternative<protocol::ClientDisconnect>(last[0]));
+    EXPECT_TRUE(reader.nextBatch().empty());
+
+    reader.seek(0);
+    const std::optional<protocol::MessageVariant> first {reader.first()};
+    ASSERT_TRUE(first);
+    EXPECT_EQ(std::get<protocol::ClientInput>(*first).input, '^');
+}
+
+TEST_F(MessageLogReaderTest, EmptyLog) {
+    { MessageLogWriter writer {name()}; }
+    MessageLogReader reader {name() + ".bin"};
+    EXPECT_FALSE(reader.next());
+    EXPECT_TRUE(reader.nextBatch().empty());
+}
+
+TEST_F(MessageLogReaderTest, TruncatedRecordThrows) {
+    writeLog({.compressed = false});
+    std::filesystem::resize_file(name() + ".bin", std::filesystem::file_size(name() + ".bin") - 3);
+    MessageLogReader reader {name() + ".bin"};
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(reader.next());
+    }
+    EXPECT_THROW(reader.next(), std::runtime_error);
+}
+
+// the same records, whether the file holds them raw or in compressed blocks, at the same logical offsets
+TEST_F(MessageLogReaderTest, LegacyAndCompressedLogsReadTheSame) {
+    const std::vector<Bytes> written {writeGame(name() + "_legacy", {.compressed = false})};
+    writeGame(name(), {.blockBytes = 4096});
+    MessageLogReader legacy {name() + "_legacy.bin"};
+    MessageLogReader compressed {name() + ".bin"};
+
+    EXPECT_EQ(legacy.size(), compressed.size());
+    EXPECT_EQ(legacy.storedSize(), legacy.size());
+    EXPECT_LT(compressed.storedSize() * 4, compressed.size());
+    EXPECT_GT(compressed.blockCount(), 1u);
+
+    for (const Bytes & bytes : written) {
+        const std::optional<MessageLogReader::Record> a {legacy.next()};
+        const std::optional<MessageLogReader::Record> b {compressed.next()};
+        ASSERT_TRUE(a && b);
+        EXPECT_EQ(a->bytes, bytes);
+        EXPECT_EQ(b->bytes, bytes);
+        EXPECT_EQ(a->offset, b->offset);
+    }
+    EXPECT_FALSE(legacy.next());
+    EXPECT_FALSE(compressed.next());
+}
+
+TEST_F(MessageLogReaderTest, SeeksAcrossCompressedBlocks) {
+    writeGame(name(), {.blockBytes = 4096});
+    MessageLogReader reader {name() + ".bin"};
+    std::vector<std::pair<uint64_t, int64_t>> offsets {};
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        offsets.emplace_back(record->offset, record->hdr.sequence);
+    }
+
+    // backwards, so nearly every seek changes block
+    for (auto it = offsets.rbegin(); it != offsets.rend(); ++it) {
+        reader.seek(it->first);
+        const std::optional<MessageLogReader::Record> record {reader.next()};
+        ASSERT_TRUE(record);
+        EXPECT_EQ(record->hdr.sequence, it->second);
+    }
+
+    const uint64_t blockStart {reader.seekSequence(250)};
+    std::optional<MessageLogReader::Record> record {reader.next()};
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->offset, blockStart);
+    EXPECT_LE(record->hdr.sequence, 250);
+    while (record && record->hdr.sequence < 250) {
+        record = reader.next();
+    }
+    ASSERT_TRUE(record);
+    EXPECT_EQ(record->hdr.sequence, 250);
+}
+
+// a server killed mid write leaves no footer and maybe half a block: the whole blocks are still read
+TEST_F(MessageLogReaderTest, CompressedLogWithoutFooterKeepsItsWholeBlocks) {
+    const std::vector<Bytes> written {writeGame(name(), {.blockBytes = 4096})};
+    const std::size_t blocks {MessageLogReader {name() + ".bin"}.blockCount()};
+    const std::string file {name() + ".bin"};
+    const std::uintmax_t footerBytes {sizeof(logformat::Trailer) + blocks * sizeof(logformat::FooterEntry)};
+    std::filesystem::resize_file(file, std::filesystem::file_size(file) - footerBytes - 10);
+
+    MessageLogReader reader {file};
+    EXPECT_EQ(reader.blockCount(), blocks - 1);
+    std::size_t read {0};
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        ASSERT_LT(read, written.size());
+        EXPECT_EQ(record->bytes, written[read++]);
+    }
+    EXPECT_GT(read, 0u);
+    EXPECT_LT(read, written.size());
+}
+
+TEST_F(MessageLogReaderTest, MissingFileThrows) {
+    EXPECT_THROW(MessageLogReader {name() + ".missing"}, std::runtime_error);
+}
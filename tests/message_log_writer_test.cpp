@@ -0,0 +1,148 @@
+#include "common/MessageLogReader.h"
+#include "common/MessageLogWriter.h"
+#include "common/Protocol.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+
+namespace {
+
+    class MessageLogWriterTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            std::filesystem::remove_all(workDir);
+            std::filesystem::create_directories(workDir);
+        }
+
+        void TearDown() override { std::filesystem::remove_all(workDir); }
+
+        std::string name() const { return (workDir / "log").string(); }
+
+        const std::filesystem::path workDir {std::filesystem::temp_directory_path() / "snake_message_log_writer_test"};
+    };
+
+    protocol::ClientInput input(const int64_t sequence) {
+        return {{protocol::MessageType::CLIENT_INPUT, static_cast<int32_t>(sequence % 7), sequence, sequence / 3},
+                "^<v>"[sequence % 4]};
+    }
+
+} // namespace
+
+// blocks far smaller than a record and a queue of two blocks, so nearly every record is a
+// hand-off and the logging thread keeps waiting on the disk. Nothing may be lost or reordered
+TEST_F(MessageLogWriterTest, EveryRecordArrivesInOrderUnderBackpressure) {
+    constexpr int64_t RECORDS {20000};
+    uint64_t expectedBytes {0};
+    MessageLogWriter::Stats stats {};
+    {
+        MessageLogWriter writer {name(), true,
+                                 {.fsync = MessageLogFsync::NEVER, .blockBytes = 16, .maxQueuedBytes = 64}};
+        for (int64_t i = 0; i < RECORDS; i++) {
+            ASSERT_EQ(writer.offset(), expectedBytes);
+            const Bytes bytes {protocol::serialise(input(i))};
+            writer.log(bytes);
+            expectedBytes += sizeof(uint32_t) + bytes.size();
+        }
+        stats = writer.stats();
+    }
+    EXPECT_EQ(stats.blocks, static_cast<uint64_t>(RECORDS));
+    EXPECT_LE(stats.maxQueuedBytes, 64u + 64u);
+
+    MessageLogReader reader {name() + ".bin"};
+    EXPECT_EQ(reader.size(), expectedBytes);
+    int64_t sequence {0};
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        ASSERT_EQ(record->bytes, protocol::serialise(input(sequence))) << "record " << sequence;
+        sequence++;
+    }
+    EXPECT_EQ(sequence, RECORDS);
+}
+
+TEST_F(MessageLogWriterTest, FsyncEveryBlockWritesTheSameLog) {
+    {
+        MessageLogWriter writer {name(), true, {.fsync = MessageLogFsync::EVERY_BLOCK, .blockBytes = 256}};
+        for (int64_t i = 0; i < 100; i++) {
+            writer.log(protocol::serialise(input(i)));
+        }
+    }
+    MessageLogReader reader {name() + ".bin"};
+    int64_t records {0};
+    while (reader.next()) {
+        records++;
+    }
+    EXPECT_EQ(records, 100);
+}
+
+TEST_F(MessageLogWriterTest, DisabledWriterCreatesNoFile) {
+    {
+        MessageLogWriter writer {name(), false};
+        writer.log(protocol::serialise(input(1)));
+        writer.flush();
+        EXPECT_EQ(writer.stats().blocks, 0u);
+    }
+    EXPECT_FALSE(std::filesystem::exists(name() + ".bin"));
+}
+
+// nothing else calls log() to notice the block is due, as on a server with no clients
+TEST_F(MessageLogWriterTest, IdleWriterHandsOverThePartFilledBlockWhenDue) {
+    MessageLogWriter writer {name(), true, {.flushInterval = std::chrono::milliseconds {100}}};
+    EXPECT_EQ(writer.flushDeadline(), std::nullopt);
+    writer.log(protocol::serialise(input(0)));
+    writer.log(protocol::serialise(input(1)));
+    const std::optional<std::chrono::time_point<std::chrono::steady_clock>> deadline {writer.flushDeadline()};
+    ASSERT_TRUE(deadline.has_value());
+
+    writer.flushIfDue();
+    EXPECT_EQ(writer.stats().blocks, 0u);
+    std::this_thread::sleep_until(*deadline);
+    writer.flushIfDue();
+    EXPECT_EQ(writer.stats().blocks, 1u);
+    EXPECT_EQ(writer.flushDeadline(), std::nullopt);
+}
+
+// a file size limit makes a write fail part way through a block, as a full disk would
+TEST_F(MessageLogWriterTest, FailedWriteEndsTheLogAtTheLastWholeBlock) {
+    constexpr rlim_t LIMIT {4096};
+    rlimit saved {};
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &saved), 0);
+    const rlimit limited {LIMIT, saved.rlim_max};
+    const auto previousHandler {std::signal(SIGXFSZ, SIG_IGN)};
+
+    for (const bool compressed : {false, true}) {
+        SCOPED_TRACE(compressed ? "compressed" : "legacy layout");
+        MessageLogWriter::Stats stats {};
+        ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limited), 0);
+        {
+            MessageLogWriter writer {name(), true, {.blockBytes = 256, .compressed = compressed}};
+            for (int64_t i = 0; i < 1000; i++) {
+                writer.log(protocol::serialise(input(i)));
+            }
+            writer.flush();
+            for (int i = 0; i < 200 && !writer.stats().writeFailed; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds {5});
+            }
+            stats = writer.stats();
+        }
+        setrlimit(RLIMIT_FSIZE, &saved);
+
+        EXPECT_TRUE(stats.writeFailed);
+        EXPECT_GT(stats.droppedBlocks, 0u);
+        EXPECT_LE(std::filesystem::file_size(name() + ".bin"), LIMIT);
+        MessageLogReader reader {name() + ".bin"};
+        int64_t sequence {0};
+        while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+            ASSERT_EQ(record->bytes, protocol::serialise(input(sequence))) << "record " << sequence;
+            sequence++;
+        }
+        EXPECT_GT(sequence, 0);
+        EXPECT_LT(sequence, 1000);
+    }
+    std::signal(SIGXFSZ, previousHandler);
+}
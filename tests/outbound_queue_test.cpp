@@ -0,0 +1,107 @@
+#include "snake_server/OutboundQueue.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+    // a connected pair of non-blocking sockets with the send buffer squeezed down
+    struct SocketPair {
+        SocketPair() {
+            EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+            int sndbuf {4096};
+            setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+            fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+        }
+        ~SocketPair() {
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        std::string readAll() const {
+            std::string out {};
+            char buf[4096];
+            ssize_t n;
+            while ((n = read(fds[1], buf, sizeof(buf))) > 0) {
+                out.append(buf, static_cast<std::size_t>(n));
+            }
+            return out;
+        }
+
+        int fds[2];
+    };
+
+    std::shared_ptr<const Bytes> payload(const protocol::MessageType type, const std::size_t size) {
+        Bytes bytes(size, static_cast<char>('a' + static_cast<int>(type)));
+        std::memcpy(bytes.data(), &type, sizeof(type));
+        return std::make_shared<const Bytes>(std::move(bytes));
+    }
+
+    std::string framed(const Bytes & bytes) {
+        const uint32_t len {static_cast<uint32_t>(bytes.size())};
+        return std::string {reinterpret_cast<const char *>(&len), sizeof(len)} + bytes;
+    }
+
+} // namespace
+
+TEST(OutboundQueue, FlushWritesLengthPrefixedFramesInOrder) {
+    SocketPair sockets {};
+    OutboundQueue queue {};
+    auto welcome {payload(protocol::MessageType::SERVER_WELCOME, 24)};
+    auto state {payload(protocol::MessageType::GAME_STATE, 100)};
+    queue.push(welcome);
+    queue.push(state);
+    EXPECT_EQ(queue.bytes(), 2 * sizeof(uint32_t) + 124);
+
+    EXPECT_EQ(queue.flush(sockets.fds[0]), OutboundQueue::FlushResult::DRAINED);
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.bytes(), 0u);
+    EXPECT_EQ(sockets.readAll(), framed(*welcome) + framed(*state));
+}
+
+TEST(OutboundQueue, ResumesPartialFramesAfterTheSocketDrains) {
+    SocketPair sockets {};
+    OutboundQueue queue {};
+    std::string expected {};
+    for (int i = 0; i < 20; i++) {
+        auto state {payload(protocol::MessageType::GAME_STATE, 10000)};
+        expected += framed(*state);
+        queue.push(state);
+    }
+
+    std::string received {};
+    while (queue.flush(sockets.fds[0]) == OutboundQueue::FlushResult::PENDING) {
+        received += sockets.readAll();
+    }
+    received += sockets.readAll();
+    EXPECT_EQ(received, expected);
+}
+
+TEST(OutboundQueue, DropStaleStateKeepsOtherMessagesAndTheFrameOnTheWire) {
+    SocketPair sockets {};
+    OutboundQueue queue {};
+    auto first {payload(protocol::MessageType::GAME_STATE, 100000)};
+    auto welcome {payload(protocol::MessageType::SERVER_WELCOME, 24)};
+    queue.push(first);
+    queue.push(payload(protocol::MessageType::GAME_STATE, 1000));
+    queue.push(welcome);
+    queue.push(payload(protocol::MessageType::GAME_STATE_DELTA, 500));
+    ASSERT_EQ(queue.flush(sockets.fds[0]), OutboundQueue::FlushResult::PENDING);
+
+    EXPECT_EQ(queue.dropStaleState(), 2u);
+    EXPECT_EQ(queue.frames(), 2u);
+
+    std::string received {};
+    while (queue.flush(sockets.fds[0]) == OutboundQueue::FlushResult::PENDING) {
+        received += sockets.readAll();
+    }
+    received += sockets.readAll();
+    EXPECT_EQ(received, framed(*first) + framed(*welcome));
+}
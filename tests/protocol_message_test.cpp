@@ -2,6 +2,10 @@
 
 #include <gtest/gtest.h>
 
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
 TEST(ProtocolBinary, HeaderRoundTrip) {
     const protocol::Header original {protocol::MessageType::CLIENT_INPUT, 7, 123456789, 987654321012345};
 
@@ -13,6 +17,22 @@ TEST(ProtocolBinary, HeaderRoundTrip) {
     EXPECT_EQ(decoded.transactTime, original.transactTime);
 }
 
+TEST(ProtocolBinary, PeekHeaderReadsAWholeFrame) {
+    protocol::GameState state {};
+    state.hdr = {protocol::MessageType::GAME_STATE, -1, 42, 987654321012345};
+    state.food.push_back({1, 'o', 3, 4});
+    const Bytes frame {protocol::serialise(state)};
+
+    const protocol::Header peeked {protocol::peekHeader(frame)};
+
+    EXPECT_EQ(peeked.messageType, protocol::MessageType::GAME_STATE);
+    EXPECT_EQ(peeked.clientId, -1);
+    EXPECT_EQ(peeked.sequence, 42);
+    EXPECT_EQ(peeked.transactTime, 987654321012345);
+    EXPECT_THROW(protocol::peekHeader(std::string_view {frame}.substr(0, protocol::HEADER_PACKED_SIZE - 1)),
+                 std::runtime_error);
+}
+
 TEST(ProtocolBinary, ClientInputRoundTrip) {
     const protocol::ClientInput original {{protocol::MessageType::CLIENT_INPUT, 7, 123456789, 987654321012345}, 'w'};
 
@@ -28,7 +48,7 @@ TEST(ProtocolBinary, ClientInputRoundTrip) {
 
 TEST(ProtocolBinary, ClientJoinRoundTrip) {
     const protocol::ClientJoin original {{protocol::MessageType::CLIENT_JOIN, 7, 123456789, 987654321012345},
-                                         "alexpearson"};
+                                         "alexpearson", 0};
 
     const protocol::ClientJoin decoded {
         std::get<protocol::ClientJoin>(protocol::deserialise(protocol::serialise(original)))};
@@ -40,6 +60,34 @@ TEST(ProtocolBinary, ClientJoinRoundTrip) {
     EXPECT_STREQ(decoded.username, original.username);
 }
 
+TEST(ProtocolBinary, StateEncodingIsOnlyWrittenWhenNegotiated) {
+    protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN, -1, 0, 0}, "alexpearson", 0};
+    EXPECT_EQ(protocol::serialise(join).size(), protocol::CLIENT_JOIN_PACKED_SIZE);
+    EXPECT_EQ(std::get<protocol::ClientJoin>(protocol::deserialise(protocol::serialise(join))).stateEncodings, 0);
+    join.stateEncodings = protocol::encodingBit(protocol::StateEncoding::COMPACT);
+    const Bytes offered {protocol::serialise(join)};
+    EXPECT_EQ(offered.size(), protocol::CLIENT_JOIN_WITH_ENCODINGS_PACKED_SIZE);
+    EXPECT_EQ(std::get<protocol::ClientJoin>(protocol::deserialise(offered)).stateEncodings, join.stateEncodings);
+
+    protocol::ServerWelcome welcome {{protocol::MessageType::SERVER_WELCOME, 3, 1, 2}, protocol::StateEncoding::FULL};
+    EXPECT_EQ(protocol::serialise(welcome).size(), protocol::SERVER_WELCOME_PACKED_SIZE);
+    EXPECT_EQ(std::get<protocol::ServerWelcome>(protocol::deserialise(protocol::serialise(welcome))).stateEncoding,
+              protocol::StateEncoding::FULL);
+    welcome.stateEncoding = protocol::StateEncoding::COMPACT;
+    EXPECT_EQ(std::get<protocol::ServerWelcome>(protocol::deserialise(protocol::serialise(welcome))).stateEncoding,
+              protocol::StateEncoding::COMPACT);
+}
+
+TEST(ProtocolBinary, ClientRoomRequestRoundTrip) {
+    const protocol::ClientRoomRequest original {{protocol::MessageType::CLIENT_ROOM_REQUEST, -1, 0, 0}, 3};
+
+    const protocol::ClientRoomRequest decoded {
+        std::get<protocol::ClientRoomRequest>(protocol::deserialise(protocol::serialise(original)))};
+
+    EXPECT_EQ(decoded.hdr.messageType, original.hdr.messageType);
+    EXPECT_EQ(decoded.roomId, original.roomId);
+}
+
 TEST(ProtocolBinary, ClientDisconnectRoundTrip) {
     const protocol::ClientDisconnect original {
         {protocol::MessageType::CLIENT_DISCONNECT, 7, 123456789, 987654321012345}};
@@ -54,7 +102,8 @@ TEST(ProtocolBinary, ClientDisconnectRoundTrip) {
 }
 
 TEST(ProtocolBinary, ServerWelcomeRoundTrip) {
-    const protocol::ServerWelcome original {{protocol::MessageType::SERVER_WELCOME, 7, 123456789, 987654321012345}};
+    const protocol::ServerWelcome original {{protocol::MessageType::SERVER_WELCOME, 7, 123456789, 987654321012345},
+                                            protocol::StateEncoding::FULL};
 
     const protocol::ServerWelcome decoded {
         std::get<protocol::ServerWelcome>(protocol::deserialise(protocol::serialise(original)))};
@@ -178,3 +227,187 @@ TEST(ProtocolBinary, GameStateFullMixedSegments) {
                                         {{7, 3, '>', 5, "alice", {{26, 22}, {26, 23}}}, {9, 4, '^', 0, "bob", {}}}};
     expectGameStateEq(gameStateRoundTrip(original), original);
 }
+
+TEST(ProtocolBinary, GameStateDeltaRoundTrip) {
+    const protocol::GameStateDelta original {{protocol::MessageType::GAME_STATE_DELTA, -1, 123456790, 987654321012399},
+                                             123456789,
+                                             9,
+                                             "alice",
+                                             {{2, 18}},
+                                             {{3, '@', 4, 5}, {6, '@', 7, 8}},
+                                             {},
+                                             {{1, '*', 10, 12}},
+                                             {9},
+                                             {{11, 2, '^', 1, "carol", {{20, 20}}}},
+                                             {{7, '<', 6, 1, {{25, 22}}}, {8, 'v', 3, 0, {}}}};
+
+    const protocol::GameStateDelta decoded {
+        std::get<protocol::GameStateDelta>(protocol::deserialise(protocol::serialise(original)))};
+
+    EXPECT_EQ(decoded.hdr.messageType, original.hdr.messageType);
+    EXPECT_EQ(decoded.hdr.sequence, original.hdr.sequence);
+    EXPECT_EQ(decoded.hdr.transactTime, original.hdr.transactTime);
+    EXPECT_EQ(decoded.baseSequence, original.baseSequence);
+    EXPECT_EQ(decoded.highScore, original.highScore);
+    EXPECT_STREQ(decoded.highScoreUsername, original.highScoreUsername);
+    EXPECT_EQ(decoded.foodRemoved, original.foodRemoved);
+    ASSERT_EQ(decoded.foodAdded.size(), original.foodAdded.size());
+    for (size_t i {0}; i < original.foodAdded.size(); ++i) {
+        expectFoodEq(decoded.foodAdded[i], original.foodAdded[i]);
+    }
+    EXPECT_TRUE(decoded.speedBoostsRemoved.empty());
+    ASSERT_EQ(decoded.speedBoostsAdded.size(), 1u);
+    expectFoodEq(decoded.speedBoostsAdded[0], original.speedBoostsAdded[0]);
+    EXPECT_EQ(decoded.playersRemoved, original.playersRemoved);
+    ASSERT_EQ(decoded.playersJoined.size(), 1u);
+    EXPECT_EQ(decoded.playersJoined[0].clientId, 11);
+    EXPECT_STREQ(decoded.playersJoined[0].username, "carol");
+    EXPECT_EQ(decoded.playersJoined[0].segments, original.playersJoined[0].segments);
+    ASSERT_EQ(decoded.playersUpdated.size(), original.playersUpdated.size());
+    for (size_t i {0}; i < original.playersUpdated.size(); ++i) {
+        EXPECT_EQ(decoded.playersUpdated[i].clientId, original.playersUpdated[i].clientId);
+        EXPECT_EQ(decoded.playersUpdated[i].direction, original.playersUpdated[i].direction);
+        EXPECT_EQ(decoded.playersUpdated[i].score, original.playersUpdated[i].score);
+        EXPECT_EQ(decoded.playersUpdated[i].tailTrim, original.playersUpdated[i].tailTrim);
+        EXPECT_EQ(decoded.playersUpdated[i].headAdvance, original.playersUpdated[i].headAdvance);
+    }
+}
+
+TEST(ProtocolBinary, LeaderboardRoundTrip) {
+    protocol::Leaderboard original {{protocol::MessageType::LEADERBOARD, -1, 42, 987654321012345}, {}};
+    original.entries.push_back({3, 2, 120, "alexpearson"});
+    original.entries.push_back({9, 5, 40, "bot"});
+
+    const protocol::Leaderboard decoded {
+        std::get<protocol::Leaderboard>(protocol::deserialise(protocol::serialise(original)))};
+
+    EXPECT_EQ(decoded.hdr.messageType, original.hdr.messageType);
+    EXPECT_EQ(decoded.hdr.sequence, original.hdr.sequence);
+    ASSERT_EQ(decoded.entries.size(), 2u);
+    EXPECT_EQ(decoded.entries[0].clientId, 3);
+    EXPECT_EQ(decoded.entries[0].color, 2);
+    EXPECT_EQ(decoded.entries[0].score, 120);
+    EXPECT_STREQ(decoded.entries[0].username, "alexpearson");
+    EXPECT_STREQ(decoded.entries[1].username, "bot");
+}
+
+TEST(ProtocolBinary, EngineCheckpointRoundTrip) {
+    protocol::EngineCheckpoint original {};
+    original.hdr = {protocol::MessageType::ENGINE_CHECKPOINT, -1, 4242, 987654321012345};
+    original.highScore = 12;
+    std::strncpy(original.highScoreUsername, "alice", sizeof(original.highScoreUsername));
+    original.playerBuckets = 13;
+    original.rng = "5489 1 2 3 624";
+    original.food = {{3, '@', 4, 5}};
+    original.speedBoosts = {{1, '*', 10, 12}};
+    protocol::EngineCheckpoint::Player player {};
+    player.clientId = 7;
+    player.color = 4;
+    player.direction = '<';
+    player.nextDirection = '^';
+    player.score = 3;
+    std::strncpy(player.username, "bot", sizeof(player.username));
+    player.movementFrequencyMs = 50;
+    player.nextMoveTime = 987654371012345;
+    player.boosted = 1;
+    player.boostExpireTime = 987659321012345;
+    player.vacated = {9, 7};
+    player.segments = {{6, 7}, {7, 7}, {8, 7}};
+    original.players.push_back(player);
+
+    const protocol::EngineCheckpoint decoded {
+        std::get<protocol::EngineCheckpoint>(protocol::deserialise(protocol::serialise(original)))};
+
+    EXPECT_EQ(decoded.hdr.messageType, original.hdr.messageType);
+    EXPECT_EQ(decoded.hdr.sequence, original.hdr.sequence);
+    EXPECT_EQ(decoded.hdr.transactTime, original.hdr.transactTime);
+    EXPECT_EQ(decoded.highScore, 12);
+    EXPECT_STREQ(decoded.highScoreUsername, "alice");
+    EXPECT_EQ(decoded.playerBuckets, 13u);
+    EXPECT_EQ(decoded.rng, original.rng);
+    ASSERT_EQ(decoded.food.size(), 1u);
+    expectFoodEq(decoded.food[0], original.food[0]);
+    ASSERT_EQ(decoded.speedBoosts.size(), 1u);
+    expectFoodEq(decoded.speedBoosts[0], original.speedBoosts[0]);
+    ASSERT_EQ(decoded.players.size(), 1u);
+    const protocol::EngineCheckpoint::Player & p {decoded.players[0]};
+    EXPECT_EQ(p.clientId, 7);
+    EXPECT_EQ(p.color, 4);
+    EXPECT_EQ(p.direction, '<');
+    EXPECT_EQ(p.nextDirection, '^');
+    EXPECT_EQ(p.score, 3);
+    EXPECT_STREQ(p.username, "bot");
+    EXPECT_EQ(p.movementFrequencyMs, 50);
+    EXPECT_EQ(p.nextMoveTime, player.nextMoveTime);
+    EXPECT_EQ(p.boosted, 1);
+    EXPECT_EQ(p.boostExpireTime, player.boostExpireTime);
+    EXPECT_EQ(p.vacated, player.vacated);
+    EXPECT_EQ(p.segments, player.segments);
+}
+
+TEST(ProtocolBinary, StateHashRoundTrip) {
+    const protocol::StateHash original {{protocol::MessageType::STATE_HASH, -1, 77, 123456789}, 0xfedcba9876543210};
+    const Bytes bytes {protocol::serialise(original)};
+    EXPECT_EQ(bytes.size(), protocol::STATE_HASH_PACKED_SIZE);
+
+    const protocol::StateHash decoded {std::get<protocol::StateHash>(protocol::deserialise(bytes))};
+    EXPECT_EQ(decoded.hdr.sequence, 77);
+    EXPECT_EQ(decoded.hdr.transactTime, 123456789);
+    EXPECT_EQ(decoded.hash, 0xfedcba9876543210);
+    EXPECT_THROW(protocol::deserialise(bytes.substr(0, bytes.size() - 1)), std::runtime_error);
+}
+
+TEST(ProtocolBinary, SerialiseIntoReusesTheBuffer) {
+    const protocol::GameState large {{protocol::MessageType::GAME_STATE, -1, 1, 2},
+                                     8,
+                                     "bot",
+                                     {{3, '@', 2, 18}, {1, '@', 24, 8}},
+                                     {{5, '*', 10, 12}},
+                                     {{7, 3, '>', 5, "alice", {{26, 22}, {26, 23}, {26, 24}}}}};
+    const protocol::GameStateDelta small {{protocol::MessageType::GAME_STATE_DELTA, -1, 3, 4}, 1, 8, "bot", {{2, 18}},
+                                          {}, {}, {}, {}, {}, {{7, '>', 5, 1, {{27, 22}}}}};
+    Bytes buffer {};
+    protocol::serialiseInto(large, buffer);
+    EXPECT_EQ(buffer.size(), protocol::encodedSize(large));
+    EXPECT_EQ(buffer, protocol::serialise(large));
+    const char * const data {buffer.data()};
+
+    protocol::serialiseInto(small, buffer);
+    EXPECT_EQ(buffer.size(), protocol::encodedSize(small));
+    EXPECT_EQ(buffer, protocol::serialise(small));
+    protocol::serialiseInto(protocol::MessageVariant {large}, buffer);
+    EXPECT_EQ(buffer, protocol::serialise(large));
+    EXPECT_EQ(buffer.data(), data);
+}
+
+TEST(ProtocolBinary, SchemaCopiesFieldsThatAreAdjacentInOneRun) {
+    using PlayerSchema = protocol::Schema<protocol::GameState::Player>;
+    // clientId, color and direction, then padding, then score and username, then the cells
+    EXPECT_EQ(PlayerSchema::runs[0], 4u + 4u + 1u);
+    EXPECT_EQ(PlayerSchema::runs[3], 4u + sizeof(protocol::GameState::Player::username));
+    EXPECT_EQ(protocol::PLAYER_PACKED_SIZE, PlayerSchema::runs[0] + PlayerSchema::runs[3]);
+    using Cell = protocol::GameState::Player::Segment;
+    using Food = protocol::GameState::Food;
+    EXPECT_TRUE(protocol::Schema<Cell>::isDenseFor<Cell>);
+    EXPECT_FALSE(protocol::Schema<Food>::isDenseFor<Food>); // its icon is followed by padding
+}
+
+TEST(ProtocolBinary, TruncatedFramesThrow) {
+    const protocol::GameState state {{protocol::MessageType::GAME_STATE, -1, 1, 2},
+                                     8,
+                                     "bot",
+                                     {{3, '@', 2, 18}},
+                                     {},
+                                     {{7, 3, '>', 5, "alice", {{26, 22}, {26, 23}}}}};
+    const Bytes frame {protocol::serialise(state)};
+    for (size_t size {protocol::HEADER_PACKED_SIZE}; size < frame.size(); ++size) {
+        EXPECT_THROW(protocol::deserialise(std::string_view {frame}.substr(0, size)), std::runtime_error) << size;
+    }
+
+    // a count far beyond the bytes left is rejected before anything is allocated for it
+    Bytes huge {frame};
+    const uint32_t count {UINT32_MAX};
+    std::memcpy(huge.data() + protocol::HEADER_PACKED_SIZE + sizeof(state.highScore) + sizeof(state.highScoreUsername),
+                &count, sizeof(count));
+    EXPECT_THROW(protocol::deserialise(huge), std::runtime_error);
+}
@@ -1,3 +1,4 @@
+#include "MessageLogRecords.h"
 #include "common/Protocol.h"
 
 #include <gtest/gtest.h>
@@ -5,31 +6,9 @@
 #include <algorithm>
 #include <cstdlib>
 #include <filesystem>
-#include <fstream>
-#include <stdexcept>
 #include <string>
 #include <vector>
 
-namespace {
-
-    std::vector<std::string> readMessages(const std::filesystem::path & path) {
-        std::ifstream in {path, std::ios::binary};
-        std::vector<std::string> messages;
-
-        uint32_t len;
-        std::string msg;
-        while (in.read(reinterpret_cast<char *>(&len), sizeof(len))) {
-            msg.resize(len);
-            if (!in.read(msg.data(), len)) {
-                throw std::runtime_error("truncated record in " + path.string());
-            }
-            messages.push_back(msg);
-        }
-        return messages;
-    }
-
-} // namespace
-
 // Replaying a recording should reproduce the recording byte-for-byte. The one
 // exception is record 1 (SERVER_CONFIG): its transact_time is wall clock
 TEST(ReplayDeterminism, ReproducesRecording) {
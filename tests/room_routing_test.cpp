@@ -0,0 +1,97 @@
+#include "common/MessageLogReader.h"
+#include "common/Protocol.h"
+#include "snake_server/ClientInbox.h"
+#include "snake_server/RoomAcceptor.h"
+#include "snake_server/ServerConfig.h"
+#include "snake_server/SnakeServer.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+    Bytes framed(const Bytes & payload) {
+        const uint32_t len {static_cast<uint32_t>(payload.size())};
+        return Bytes(reinterpret_cast<const char *>(&len), sizeof(len)) + payload;
+    }
+
+} // namespace
+
+TEST(ChooseRoom, HonoursAValidRequest) {
+    EXPECT_EQ(chooseRoom(2, {5, 0, 9}), 2u);
+}
+
+TEST(ChooseRoom, FallsBackToTheLeastLoadedRoom) {
+    EXPECT_EQ(chooseRoom(std::nullopt, {3, 1, 1}), 1u);
+    EXPECT_EQ(chooseRoom(7, {3, 1, 0}), 2u);
+    EXPECT_EQ(chooseRoom(-1, {0, 0}), 0u);
+}
+
+TEST(ClientInbox, PostWakesTheRoomAndHandsOverPendingBytes) {
+    ClientInbox inbox {};
+    pollfd pfd {inbox.eventFd(), POLLIN, 0};
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+
+    inbox.post(11, "join");
+    inbox.post(12, "");
+    EXPECT_EQ(inbox.connections.load(), 2);
+    EXPECT_EQ(poll(&pfd, 1, 0), 1);
+
+    const auto clients {inbox.take()};
+    ASSERT_EQ(clients.size(), 2u);
+    EXPECT_EQ(clients[0], (std::pair<int, Bytes> {11, "join"}));
+    EXPECT_EQ(clients[1].first, 12);
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+}
+
+// Only client messages are logged from a connection, as a replay would take a state hash or
+// checkpoint in the log for one the server wrote. Anything bigger is cut off by the frame limit
+TEST(Room, DropsServerMessagesFromClients) {
+    const std::filesystem::path workDir {std::filesystem::temp_directory_path() / "snake_room_test"};
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+    const std::string name {(workDir / "room").string()};
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    protocol::StateHash hash {};
+    hash.hdr.messageType = protocol::MessageType::STATE_HASH;
+    protocol::ClientJoin join {{protocol::MessageType::CLIENT_JOIN}, {}, 0};
+    std::strncpy(join.username, "bot", sizeof(join.username) - 1);
+    const Bytes sent {framed(protocol::serialise(hash)) +
+                      framed(protocol::serialise(protocol::ServerWelcome {{protocol::MessageType::SERVER_WELCOME}})) +
+                      framed(protocol::serialise(join))};
+
+    const auto inbox {std::make_shared<ClientInbox>()};
+    {
+        SnakeServer server {initServerConfig(name, std::nullopt), std::nullopt, inbox};
+        inbox->post(fds[1], sent);
+        std::thread room {[&server] { server.run(); }};
+        std::this_thread::sleep_for(std::chrono::milliseconds {300});
+        server.stop();
+        room.join();
+    }
+    close(fds[0]);
+
+    MessageLogReader reader {name + ".bin"};
+    int joins {0};
+    int welcomes {0};
+    while (const std::optional<MessageLogReader::Record> record = reader.next()) {
+        EXPECT_NE(record->hdr.messageType, protocol::MessageType::STATE_HASH);
+        joins += record->hdr.messageType == protocol::MessageType::CLIENT_JOIN;
+        welcomes += record->hdr.messageType == protocol::MessageType::SERVER_WELCOME;
+    }
+    EXPECT_EQ(joins, 1);
+    EXPECT_EQ(welcomes, 1); // the one the server sent back
+    std::filesystem::remove_all(workDir);
+}
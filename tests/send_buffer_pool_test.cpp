@@ -0,0 +1,35 @@
+#include "snake_server/SendBufferPool.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+TEST(SendBufferPool, ReusesABufferOnceNothingHoldsIt) {
+    SendBufferPool pool {};
+    std::shared_ptr<Bytes> first {pool.acquire()};
+    first->assign(1000, 'x');
+    const char * const data {first->data()};
+    std::shared_ptr<const Bytes> queued {first};
+    first.reset();
+
+    // still queued, so a second buffer
+    const std::shared_ptr<Bytes> second {pool.acquire()};
+    EXPECT_NE(second->data(), data);
+    EXPECT_EQ(pool.size(), 2u);
+
+    queued.reset();
+    const std::shared_ptr<Bytes> reused {pool.acquire()};
+    EXPECT_EQ(reused->data(), data);
+    EXPECT_EQ(pool.size(), 2u);
+}
+
+TEST(SendBufferPool, StopsGrowingBehindSlowClients) {
+    SendBufferPool pool {};
+    std::vector<std::shared_ptr<Bytes>> held {};
+    for (int i = 0; i < 100; i++) {
+        held.push_back(pool.acquire());
+    }
+    EXPECT_EQ(pool.size(), 64u);
+    EXPECT_EQ(held.back().use_count(), 1);
+}
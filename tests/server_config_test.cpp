@@ -2,8 +2,11 @@
 #include "common/Protocol.h"
 #include "snake_server/ServerConfig.h"
 
+#include <cstdlib>
 #include <gtest/gtest.h>
 #include <optional>
+#include <stdexcept>
+#include <utility>
 
 TEST(InitServerConfig, UsesSeedFromHeader) {
     protocol::ServerConfig sc {};
@@ -20,3 +23,106 @@ TEST(InitServerConfig, FallsBackToConstantsWhenNoHeader) {
     EXPECT_EQ(cfg.width, ARENA_WIDTH);
     EXPECT_EQ(cfg.height, ARENA_HEIGHT);
 }
+
+TEST(InitServerConfig, ReplayTakesEveryGameplaySettingFromTheRecording) {
+    protocol::ServerConfig sc {};
+    sc.hdr.messageType = protocol::MessageType::SERVER_CONFIG;
+    sc.width = 500;
+    sc.height = 300;
+    sc.minFoodInArena = 100;
+    sc.foodSpawnFromBodySegmentProbability = 2;
+    sc.speedBoostProbability = 40;
+    sc.speedBoostRatio = 2.0f;
+    sc.movementFrequencyMs = 100;
+    sc.boostedMovementFrequencyMs = 50;
+    sc.boostDurationMs = 4000;
+    ServerConfig cfg {initServerConfig("test", protocol::MessageVariant {sc})};
+    EXPECT_EQ(cfg.width, 500);
+    EXPECT_EQ(cfg.height, 300);
+    EXPECT_EQ(cfg.minFoodInArena, 100);
+    EXPECT_EQ(cfg.foodSpawnFromBodySegmentProbability, 2);
+    EXPECT_EQ(cfg.speedBoostProbability, 40);
+    EXPECT_EQ(cfg.speedBoostRatio, 2.0f);
+    EXPECT_EQ(cfg.movementFrequencyMs.count(), 100);
+    EXPECT_EQ(cfg.boostedMovementFrequencyMs.count(), 50);
+    EXPECT_EQ(cfg.boostDurationMs.count(), 4000);
+}
+
+TEST(InitServerConfig, ArenaSizeFromEnvironmentScalesFood) {
+    setenv("SNAKE_ARENA_WIDTH", "400", 1);
+    setenv("SNAKE_ARENA_HEIGHT", "200", 1);
+    ServerConfig cfg {initServerConfig("test", std::nullopt)};
+    unsetenv("SNAKE_ARENA_WIDTH");
+    unsetenv("SNAKE_ARENA_HEIGHT");
+    EXPECT_EQ(cfg.width, 400);
+    EXPECT_EQ(cfg.height, 200);
+    EXPECT_EQ(cfg.minFoodInArena, MIN_FOOD_IN_ARENA * 50);
+    EXPECT_EQ(cfg.movementFrequencyMs.count(), MOVEMENT_FREQUENCY_MS);
+    EXPECT_EQ(cfg.boostedMovementFrequencyMs.count(), BOOSTED_MOVEMENT_FREQUENCY_MS);
+}
+
+TEST(InitServerConfig, EachRoomSeedsItsOwnArena) {
+    setenv("SNAKE_SEED", "1000", 1);
+    const ServerConfig room0 {initServerConfig("test_room0", std::nullopt, 0)};
+    const ServerConfig room3 {initServerConfig("test_room3", std::nullopt, 3)};
+    unsetenv("SNAKE_SEED");
+    EXPECT_EQ(room0.seed, 1000u);
+    EXPECT_EQ(room3.seed, 1003u);
+}
+
+TEST(InitServerConfig, MessageLogCanBeTurnedOff) {
+    EXPECT_TRUE(initServerConfig("test", std::nullopt).messageLogEnabled);
+    setenv("SNAKE_MESSAGE_LOG", "0", 1);
+    ServerConfig cfg {initServerConfig("test", std::nullopt)};
+    unsetenv("SNAKE_MESSAGE_LOG");
+    EXPECT_FALSE(cfg.messageLogEnabled);
+}
+
+TEST(InitServerConfig, MessageLogFsyncPolicyFromEnvironment) {
+    EXPECT_EQ(initServerConfig("test", std::nullopt).messageLog.fsync, MessageLogFsync::NEVER);
+    setenv("SNAKE_MESSAGE_LOG_FSYNC_MS", "0", 1);
+    EXPECT_EQ(initServerConfig("test", std::nullopt).messageLog.fsync, MessageLogFsync::EVERY_BLOCK);
+    setenv("SNAKE_MESSAGE_LOG_FSYNC_MS", "250", 1);
+    ServerConfig cfg {initServerConfig("test", std::nullopt)};
+    unsetenv("SNAKE_MESSAGE_LOG_FSYNC_MS");
+    EXPECT_EQ(cfg.messageLog.fsync, MessageLogFsync::INTERVAL);
+    EXPECT_EQ(cfg.messageLog.fsyncInterval.count(), 250);
+}
+
+TEST(InitServerConfig, MessageLogCompressionFromEnvironment) {
+    EXPECT_TRUE(initServerConfig("test", std::nullopt).messageLog.compressed);
+    setenv("SNAKE_MESSAGE_LOG_COMPRESS", "0", 1);
+    const ServerConfig cfg {initServerConfig("test", std::nullopt)};
+    unsetenv("SNAKE_MESSAGE_LOG_COMPRESS");
+    EXPECT_FALSE(cfg.messageLog.compressed);
+}
+
+TEST(InitServerConfig, MessageLogTierFromEnvironment) {
+    EXPECT_EQ(initServerConfig("test", std::nullopt).messageLogTier, MessageLogTier::FULL);
+    setenv("SNAKE_MESSAGE_LOG_TIER", "inputs", 1);
+    EXPECT_EQ(initServerConfig("test", std::nullopt).messageLogTier, MessageLogTier::INPUTS);
+    setenv("SNAKE_MESSAGE_LOG_TIER", "most", 1);
+    EXPECT_THROW(initServerConfig("test", std::nullopt), std::invalid_argument);
+    unsetenv("SNAKE_MESSAGE_LOG_TIER");
+}
+
+TEST(InitServerConfig, RejectsSettingsItCannotRunWith) {
+    for (const auto & [name, value] : {std::pair {"SNAKE_ARENA_WIDTH", "abc"}, std::pair {"SNAKE_ARENA_WIDTH", "11"},
+                                       std::pair {"SNAKE_ARENA_HEIGHT", "40x"}, std::pair {"SNAKE_ARENA_HEIGHT", "5000"},
+                                       std::pair {"SNAKE_MOVEMENT_FREQUENCY_MS", "0"},
+                                       std::pair {"SNAKE_MIN_FOOD_IN_ARENA", "10000"},
+                                       std::pair {"SNAKE_SERVER_PORT", "99999999999999999999"},
+                                       std::pair {"SNAKE_SEED", "-1"}}) {
+        setenv(name, value, 1);
+        EXPECT_THROW(initServerConfig("test", std::nullopt), std::invalid_argument) << name << "=" << value;
+        unsetenv(name);
+    }
+
+    setenv("SNAKE_ARENA_WIDTH", "12", 1);
+    setenv("SNAKE_MOVEMENT_FREQUENCY_MS", "2", 1);
+    ServerConfig cfg {initServerConfig("test", std::nullopt)};
+    unsetenv("SNAKE_ARENA_WIDTH");
+    unsetenv("SNAKE_MOVEMENT_FREQUENCY_MS");
+    EXPECT_EQ(cfg.width, ARENA_MIN_SIDE);
+    EXPECT_EQ(cfg.boostedMovementFrequencyMs.count(), 1);
+}
@@ -0,0 +1,70 @@
+#include "snake_server/Player.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    std::vector<std::pair<int, int>> segmentsOf(const SnakeBody & body) {
+        std::vector<std::pair<int, int>> segments {};
+        body.getSegments(segments);
+        return segments;
+    }
+
+} // namespace
+
+TEST(SnakeBody, MoveShiftsEverySegmentAlong) {
+    SnakeBody body {5, 5};
+    body.move(1, 0);
+    body.grow();
+    body.move(1, 0);
+    body.grow();
+    body.move(0, 1);
+
+    EXPECT_EQ(segmentsOf(body), (std::vector<std::pair<int, int>> {{7, 6}, {7, 5}, {6, 5}}));
+    EXPECT_EQ(body.vacated(), (std::pair<int, int> {5, 5}));
+    EXPECT_EQ(body.x(), 7);
+    EXPECT_EQ(body.y(), 6);
+}
+
+TEST(SnakeBody, GrowWithoutMovingStacksOnTheTail) {
+    SnakeBody body {3, 4};
+    body.grow();
+    body.grow();
+
+    EXPECT_EQ(segmentsOf(body), (std::vector<std::pair<int, int>> {{3, 4}, {3, 4}, {3, 4}}));
+}
+
+TEST(SnakeBody, GrowsPastInitialCapacityAfterWrapping) {
+    SnakeBody body {1, 1};
+    std::vector<std::pair<int, int>> expected {{1, 1}};
+    for (int x = 2; x <= 40; x++) {
+        body.move(1, 0);
+        body.grow();
+        expected.insert(expected.begin(), {x, 1});
+    }
+
+    EXPECT_EQ(body.length(), expected.size());
+    EXPECT_EQ(segmentsOf(body), expected);
+}
+
+TEST(SnakeBody, DigestFollowsTheCellsNotTheMoves) {
+    SnakeBody body {2, 2};
+    const uint64_t start {body.digest()};
+    body.move(1, 0);
+    EXPECT_NE(body.digest(), start);
+    body.grow();
+    body.move(0, 1);
+    body.grow();
+
+    // a body rebuilt from the same cells, as from a checkpoint, has the same digest
+    const SnakeBody rebuilt {segmentsOf(body), body.vacated()};
+    EXPECT_EQ(rebuilt.digest(), body.digest());
+
+    SnakeBody back {3, 2};
+    back.move(-1, 0);
+    EXPECT_EQ(back.digest(), start);
+}